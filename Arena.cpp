@@ -0,0 +1,94 @@
+#include "Arena.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+
+Arena::Arena(size_t block_size)
+    : head(nullptr), cursor(nullptr), limit(nullptr), block_size(block_size), bytes_allocated(0) {}
+
+
+Arena::~Arena() {
+    freeBlocks(head);
+}
+
+
+Arena::Arena(Arena&& other) noexcept
+    : head(other.head), cursor(other.cursor), limit(other.limit), block_size(other.block_size), bytes_allocated(other.bytes_allocated) {
+    other.head = nullptr;
+    other.cursor = other.limit = nullptr;
+    other.bytes_allocated = 0;
+}
+
+
+Arena& Arena::operator=(Arena&& other) noexcept {
+    if (this != &other) {
+        freeBlocks(head);
+        head = other.head;
+        cursor = other.cursor;
+        limit = other.limit;
+        block_size = other.block_size;
+        bytes_allocated = other.bytes_allocated;
+        other.head = nullptr;
+        other.cursor = other.limit = nullptr;
+        other.bytes_allocated = 0;
+    }
+    return *this;
+}
+
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (!cursor || aligned + size > reinterpret_cast<uintptr_t>(limit)) {
+        addBlock(size + alignment);
+        aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    }
+    cursor = reinterpret_cast<char*>(aligned + size);
+    bytes_allocated += size;
+    return reinterpret_cast<void*>(aligned);
+}
+
+
+std::string_view Arena::copyString(std::string_view text) {
+    char* copy = allocateArray<char>(text.size());
+    if (!text.empty()) std::memcpy(copy, text.data(), text.size());
+    return std::string_view(copy, text.size());
+}
+
+
+void Arena::reset() {
+    if (!head) return;
+    freeBlocks(head->next);
+    head->next = nullptr;
+    cursor = reinterpret_cast<char*>(head + 1);
+    limit = reinterpret_cast<char*>(head + 1) + head->size;
+    bytes_allocated = 0;
+}
+
+
+void Arena::addBlock(size_t min_size) {
+    size_t size = min_size > block_size ? min_size : block_size;
+    Block* block = static_cast<Block*>(std::malloc(sizeof(Block) + size));
+    if (!block) throw std::bad_alloc();
+    block->size = size;
+
+    // Keep the first block at the head of the list so reset() can reuse it.
+    if (head) {
+        block->next = head->next;
+        head->next = block;
+    } else {
+        block->next = nullptr;
+        head = block;
+    }
+    cursor = reinterpret_cast<char*>(block + 1);
+    limit = cursor + size;
+}
+
+
+void Arena::freeBlocks(Block* block) {
+    while (block) {
+        Block* next = block->next;
+        std::free(block);
+        block = next;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+
+#include <cstddef>
+#include <new>
+#include <string_view>
+#include <utility>
+
+
+// Bump allocator. Objects are never destroyed individually; dropping or resetting
+// the arena frees everything at once, so only trivially-destructible data (or data
+// whose destructor may safely be skipped) should live here.
+class Arena {
+public:
+    explicit Arena(size_t block_size = 64 * 1024);
+    ~Arena();
+    Arena(Arena&& other) noexcept;
+    Arena& operator=(Arena&& other) noexcept;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+
+    void* allocate(size_t size, size_t alignment);
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    T* allocateArray(size_t count) {
+        if (count == 0) return nullptr;
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    std::string_view copyString(std::string_view text);
+
+    // Releases every allocation but keeps the first block for reuse.
+    void reset();
+    size_t bytesAllocated() const { return bytes_allocated; }
+
+
+private:
+    struct Block {
+        Block* next;
+        size_t size;
+    };
+
+    Block* head;
+    char* cursor;
+    char* limit;
+    size_t block_size;
+    size_t bytes_allocated;
+
+    void addBlock(size_t min_size);
+    void freeBlocks(Block* block);
+};
+
+
+#endif
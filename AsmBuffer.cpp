@@ -0,0 +1,318 @@
+#include "AsmBuffer.h"
+#include <charconv>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+
+LabelId AsmBuffer::newLabel(std::string name) {
+    label_names.push_back(std::move(name));
+    return static_cast<LabelId>(label_names.size() - 1);
+}
+
+
+void AsmBuffer::bind(LabelId label) {
+    AsmItem item;
+    item.kind = AsmItem::Kind::LABEL;
+    item.label = label;
+    code.push_back(item);
+}
+
+
+void AsmBuffer::emit(Opcode op, Reg reg, uint16_t operand) {
+    AsmItem item;
+    item.instr = {op, reg, operand};
+    item.source = source;
+    code.push_back(item);
+}
+
+
+void AsmBuffer::emitJump(Opcode op, LabelId target) {
+    AsmItem item;
+    item.instr = {op, Reg::A, 0};
+    item.label = target;
+    item.source = source;
+    code.push_back(item);
+}
+
+
+void AsmBuffer::comment(std::string text) {
+    if (!keep_comments) return;
+    AsmItem item;
+    item.kind = AsmItem::Kind::COMMENT;
+    item.comment = static_cast<uint32_t>(comments.size());
+    comments.push_back(std::move(text));
+    code.push_back(item);
+}
+
+
+void AsmBuffer::annotate(std::string text) {
+    if (!keep_comments || code.empty()) return;
+    code.back().comment = static_cast<uint32_t>(comments.size());
+    comments.push_back(std::move(text));
+}
+
+
+void AsmBuffer::append(const AsmBuffer& other) {
+    LabelId label_base = static_cast<LabelId>(label_names.size());
+    uint32_t comment_base = static_cast<uint32_t>(comments.size());
+    label_names.insert(label_names.end(), other.label_names.begin(), other.label_names.end());
+    if (keep_comments) comments.insert(comments.end(), other.comments.begin(), other.comments.end());
+
+    code.reserve(code.size() + other.code.size());
+    for (AsmItem item : other.code) {
+        if (item.comment != AsmItem::NONE) {
+            if (!keep_comments && item.kind == AsmItem::Kind::COMMENT) continue;
+            item.comment = keep_comments ? item.comment + comment_base : AsmItem::NONE;
+        }
+        if (item.label != AsmItem::NONE) item.label += label_base;
+        code.push_back(item);
+    }
+}
+
+
+// Labels nothing jumps to are dropped, since the peephole optimizer treats every label
+// as a barrier.
+void AsmBuffer::removeUnusedLabels() {
+    std::vector<bool> used(label_names.size(), false);
+    for (const AsmItem& item : code) {
+        if (item.kind == AsmItem::Kind::INSTRUCTION && item.label != AsmItem::NONE) used[item.label] = true;
+    }
+    size_t write = 0;
+    for (const AsmItem& item : code) {
+        if (item.kind == AsmItem::Kind::LABEL && !used[item.label]) continue;
+        code[write++] = item;
+    }
+    code.resize(write);
+}
+
+
+size_t AsmBuffer::instructionCount() const {
+    size_t count = 0;
+    for (const AsmItem& item : code) {
+        if (item.kind == AsmItem::Kind::INSTRUCTION) count++;
+    }
+    return count;
+}
+
+
+std::string AsmBuffer::labelName(LabelId label) const {
+    if (!label_names[label].empty()) return label_names[label];
+    return "L" + std::to_string(label);
+}
+
+
+std::string AsmBuffer::toText() const {
+    std::ostringstream out;
+    for (const AsmItem& item : code) {
+        switch (item.kind) {
+            case AsmItem::Kind::LABEL:
+                out << labelName(item.label) << ":\n";
+                continue;
+            case AsmItem::Kind::COMMENT:
+                out << "; " << comments[item.comment] << "\n";
+                continue;
+            case AsmItem::Kind::INSTRUCTION:
+                break;
+        }
+
+        const MachineInstr& instr = item.instr;
+        out << opcodeName(instr.op);
+        switch (instr.op) {
+            case Opcode::LDI:
+                out << " " << registerName(instr.reg) << " " << instr.operand;
+                break;
+            case Opcode::LDA:
+            case Opcode::STA:
+                out << " " << instr.operand;
+                break;
+            case Opcode::MOV:
+                out << " " << registerName(instr.reg) << " " << registerName(static_cast<Reg>(instr.operand));
+                break;
+            case Opcode::JMP:
+            case Opcode::JNE:
+                out << " " << labelName(item.label);
+                break;
+            case Opcode::PUSH:
+            case Opcode::POP:
+                out << " " << registerName(instr.reg);
+                break;
+            case Opcode::ADD:
+            case Opcode::SUB:
+            case Opcode::CMP:
+            case Opcode::HLT:
+                break;
+        }
+        if (item.comment != AsmItem::NONE) out << " ; " << comments[item.comment];
+        out << "\n";
+    }
+    return out.str();
+}
+
+
+std::vector<MachineInstr> assemble(const AsmBuffer& code) {
+    const std::vector<AsmItem>& items = code.items();
+    std::vector<int> position;
+    size_t count = 0;
+    for (const AsmItem& item : items) {
+        if (item.kind == AsmItem::Kind::LABEL) {
+            if (item.label >= position.size()) position.resize(item.label + 1, -1);
+            position[item.label] = static_cast<int>(count);
+        } else if (item.kind == AsmItem::Kind::INSTRUCTION) {
+            count++;
+        }
+    }
+
+    std::vector<MachineInstr> program;
+    program.reserve(count);
+    for (const AsmItem& item : items) {
+        if (item.kind != AsmItem::Kind::INSTRUCTION) continue;
+        MachineInstr instr = item.instr;
+        if (item.label != AsmItem::NONE) {
+            if (item.label >= position.size() || position[item.label] < 0) {
+                throw std::runtime_error("Assembler Error: Undefined label '" + code.labelName(item.label) + "'");
+            }
+            instr.operand = static_cast<uint16_t>(position[item.label]);
+        }
+        program.push_back(instr);
+    }
+    return program;
+}
+
+
+std::vector<uint32_t> sourceOffsets(const AsmBuffer& code) {
+    std::vector<uint32_t> offsets;
+    offsets.reserve(code.items().size());
+    for (const AsmItem& item : code.items()) {
+        if (item.kind == AsmItem::Kind::INSTRUCTION) offsets.push_back(item.source);
+    }
+    return offsets;
+}
+
+
+namespace {
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && isSpace(text.front())) text.remove_prefix(1);
+    while (!text.empty() && isSpace(text.back())) text.remove_suffix(1);
+    return text;
+}
+
+
+// Splits off the next whitespace-separated field.
+std::string_view nextField(std::string_view& text) {
+    text = trim(text);
+    size_t end = 0;
+    while (end < text.size() && !isSpace(text[end])) end++;
+    std::string_view field = text.substr(0, end);
+    text.remove_prefix(end);
+    return field;
+}
+
+
+Reg parseRegister(std::string_view field) {
+    if (field == "A") return Reg::A;
+    if (field == "B") return Reg::B;
+    throw std::runtime_error("Assembler Error: Expected a register, got '" + std::string(field) + "'");
+}
+
+
+// Immediates and addresses wrap the way the CPU's 8-bit datapath would.
+uint16_t parseNumber(std::string_view field) {
+    int value = 0;
+    auto [end, error] = std::from_chars(field.data(), field.data() + field.size(), value);
+    if (error != std::errc() || end != field.data() + field.size()) {
+        throw std::runtime_error("Assembler Error: Expected a number, got '" + std::string(field) + "'");
+    }
+    return static_cast<uint16_t>(value);
+}
+
+
+const std::unordered_map<std::string_view, Opcode>& opcodeTable() {
+    static const std::unordered_map<std::string_view, Opcode> table = {
+        {"ldi", Opcode::LDI}, {"lda", Opcode::LDA}, {"sta", Opcode::STA}, {"mov", Opcode::MOV},
+        {"add", Opcode::ADD}, {"sub", Opcode::SUB}, {"cmp", Opcode::CMP}, {"jmp", Opcode::JMP},
+        {"jne", Opcode::JNE}, {"push", Opcode::PUSH}, {"pop", Opcode::POP}, {"hlt", Opcode::HLT},
+    };
+    return table;
+}
+
+}
+
+
+AsmBuffer parseAssembly(std::string_view text) {
+    AsmBuffer code(true);
+    std::unordered_map<std::string, LabelId> labels;
+    auto label = [&](std::string_view name) {
+        auto [it, inserted] = labels.try_emplace(std::string(name), 0);
+        if (inserted) it->second = code.newLabel(std::string(name));
+        return it->second;
+    };
+
+    while (!text.empty()) {
+        size_t newline = text.find('\n');
+        std::string_view line = text.substr(0, newline);
+        text.remove_prefix(newline == std::string_view::npos ? text.size() : newline + 1);
+
+        std::string_view comment;
+        size_t comment_pos = line.find(';');
+        if (comment_pos != std::string_view::npos) {
+            comment = trim(line.substr(comment_pos + 1));
+            line = line.substr(0, comment_pos);
+        }
+        line = trim(line);
+
+        if (line.empty()) {
+            if (!comment.empty()) code.comment(std::string(comment));
+            continue;
+        }
+        if (line.back() == ':') {
+            code.bind(label(line.substr(0, line.size() - 1)));
+            continue;
+        }
+
+        std::string_view mnemonic = nextField(line);
+        auto found = opcodeTable().find(mnemonic);
+        if (found == opcodeTable().end()) {
+            throw std::runtime_error("Assembler Error: Unknown instruction '" + std::string(mnemonic) + "'");
+        }
+        Opcode op = found->second;
+        switch (op) {
+            case Opcode::LDI: {
+                Reg reg = parseRegister(nextField(line));
+                code.emit(op, reg, parseNumber(nextField(line)));
+                break;
+            }
+            case Opcode::LDA:
+            case Opcode::STA:
+                code.emit(op, Reg::A, parseNumber(nextField(line)));
+                break;
+            case Opcode::MOV: {
+                Reg destination = parseRegister(nextField(line));
+                code.emit(op, destination, static_cast<uint16_t>(parseRegister(nextField(line))));
+                break;
+            }
+            case Opcode::JMP:
+            case Opcode::JNE:
+                code.emitJump(op, label(nextField(line)));
+                break;
+            case Opcode::PUSH:
+            case Opcode::POP:
+                code.emit(op, parseRegister(nextField(line)));
+                break;
+            case Opcode::ADD:
+            case Opcode::SUB:
+            case Opcode::CMP:
+            case Opcode::HLT:
+                code.emit(op);
+                break;
+        }
+        if (!comment.empty()) code.annotate(std::string(comment));
+    }
+    return code;
+}
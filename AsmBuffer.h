@@ -0,0 +1,79 @@
+#ifndef ASM_BUFFER_H
+#define ASM_BUFFER_H
+
+
+#include "Isa.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+using LabelId = uint32_t;
+
+
+struct AsmItem {
+    enum class Kind : uint8_t { INSTRUCTION, LABEL, COMMENT };
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    Kind kind = Kind::INSTRUCTION;
+    MachineInstr instr{Opcode::HLT, Reg::A, 0};
+    LabelId label = NONE;       // defined by a LABEL item, or targeted by jmp/jne
+    uint32_t comment = NONE;    // index into AsmBuffer's comment text
+    uint32_t source = NONE;     // source offset of the statement an instruction came from
+
+    bool is(Opcode op) const { return kind == Kind::INSTRUCTION && instr.op == op; }
+    bool is(Opcode op, Reg reg) const { return is(op) && instr.reg == reg; }
+};
+
+
+// In-memory output of the code generators: decoded instructions, label definitions and
+// jumps that refer to labels by id. Comments are only recorded when the buffer was
+// created with `keep_comments`, i.e. when someone asked to see the text. Instructions
+// are tagged with the source offset last passed to setSource(), which makes the
+// buffer's line table; see lineTable() in Profiler.h.
+class AsmBuffer {
+public:
+    explicit AsmBuffer(bool keep_comments = false) : keep_comments(keep_comments) {}
+
+    LabelId newLabel(std::string name = "");
+    void bind(LabelId label);
+    void emit(Opcode op, Reg reg = Reg::A, uint16_t operand = 0);
+    void emitJump(Opcode op, LabelId target);
+    void setSource(uint32_t offset) { source = offset; }
+    // A comment on a line of its own, and one attached to the last instruction.
+    void comment(std::string text);
+    void annotate(std::string text);
+    // Appends another buffer's items, renumbering its labels into this buffer.
+    void append(const AsmBuffer& other);
+    void removeUnusedLabels();
+
+    bool keepsComments() const { return keep_comments; }
+    std::vector<AsmItem>& items() { return code; }
+    const std::vector<AsmItem>& items() const { return code; }
+    size_t instructionCount() const;
+    std::string labelName(LabelId label) const;
+    const std::string& commentText(uint32_t comment) const { return comments[comment]; }
+    std::string toText() const;
+
+
+private:
+    bool keep_comments;
+    uint32_t source = AsmItem::NONE;
+    std::vector<AsmItem> code;
+    std::vector<std::string> label_names;   // empty names print as L<id>
+    std::vector<std::string> comments;
+};
+
+
+// Resolves labels and returns the program the CPU executes.
+std::vector<MachineInstr> assemble(const AsmBuffer& code);
+// The source offset of each instruction assemble() returns, AsmItem::NONE where unknown.
+std::vector<uint32_t> sourceOffsets(const AsmBuffer& code);
+
+// Reads assembly text in the format produced by AsmBuffer::toText().
+AsmBuffer parseAssembly(std::string_view text);
+
+
+#endif
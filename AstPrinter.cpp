@@ -0,0 +1,81 @@
+#include "AstPrinter.h"
+#include <string>
+
+
+void AstPrinter::print(const Node* node, int depth) {
+    if (!node) return;
+    int saved = indent;
+    indent = depth;
+    dispatch(node);
+    indent = saved;
+}
+
+
+std::ostream& AstPrinter::line(int extra) {
+    return out << std::string((indent + extra) * 2, ' ');
+}
+
+
+void AstPrinter::visit(const Program* node) {
+    line() << "Program" << std::endl;
+    for (const Statement* stmt : node->statements) {
+        print(stmt, indent + 1);
+    }
+    for (const VarDecl* temporary : node->temporaries) {
+        print(temporary, indent + 1);
+    }
+}
+
+
+void AstPrinter::visit(const VarDecl* node) {
+    line() << "VarDecl: " << symbols.name(node->symbol) << std::endl;
+}
+
+
+void AstPrinter::visit(const Assignment* node) {
+    line() << "Assignment: " << symbols.name(node->symbol) << std::endl;
+    print(node->value, indent + 1);
+}
+
+
+void AstPrinter::visit(const IfStatement* node) {
+    line() << "IfStatement" << std::endl;
+    line(1) << "Condition:" << std::endl;
+    print(node->condition, indent + 2);
+    line(1) << "Body:" << std::endl;
+    print(node->body, indent + 2);
+}
+
+
+void AstPrinter::visit(const WhileStatement* node) {
+    line() << "WhileStatement" << std::endl;
+    line(1) << "Condition:" << std::endl;
+    print(node->condition, indent + 2);
+    line(1) << "Body:" << std::endl;
+    print(node->body, indent + 2);
+}
+
+
+void AstPrinter::visit(const BlockStatement* node) {
+    line() << "Block" << std::endl;
+    for (const Statement* stmt : node->statements) {
+        print(stmt, indent + 1);
+    }
+}
+
+
+void AstPrinter::visit(const BinaryOp* node) {
+    line() << "BinaryOp: " << operatorSymbol(node->op) << std::endl;
+    print(node->left, indent + 1);
+    print(node->right, indent + 1);
+}
+
+
+void AstPrinter::visit(const NumberLiteral* node) {
+    line() << "Number: " << node->value << std::endl;
+}
+
+
+void AstPrinter::visit(const Identifier* node) {
+    line() << "Identifier: " << symbols.name(node->symbol) << std::endl;
+}
@@ -0,0 +1,44 @@
+#ifndef AST_PRINTER_H
+#define AST_PRINTER_H
+
+
+#include "ast.h"
+#include "AstVisitor.h"
+#include "SymbolTable.h"
+#include <iostream>
+
+
+class AstPrinter : private AstVisitor<AstPrinter> {
+public:
+    AstPrinter(const SymbolTable& symbols, std::ostream& out = std::cout) : symbols(symbols), out(out) {}
+    void print(const Node* node, int indent = 0);
+
+
+private:
+    const SymbolTable& symbols;
+    std::ostream& out;
+    int indent = 0;
+
+    friend class AstVisitor<AstPrinter>;
+
+
+    std::ostream& line(int extra = 0);
+
+    void visit(const Program* node);
+    void visit(const VarDecl* node);
+    void visit(const Assignment* node);
+    void visit(const IfStatement* node);
+    void visit(const WhileStatement* node);
+    void visit(const BlockStatement* node);
+    void visit(const BinaryOp* node);
+    void visit(const NumberLiteral* node);
+    void visit(const Identifier* node);
+};
+
+
+inline void printAST(const Node* node, const SymbolTable& symbols, int indent = 0) {
+    AstPrinter(symbols).print(node, indent);
+}
+
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef AST_VISITOR_H
+#define AST_VISITOR_H
+
+
+#include "ast.h"
+#include <stdexcept>
+#include <type_traits>
+
+
+// Switch-based dispatch on Node::kind. Derived classes provide a `visit` overload for
+// each concrete node type they handle and call dispatch() on a base pointer; there is
+// no RTTI involved. Set IsConst to false for passes that rewrite the tree in place.
+template <typename Derived, typename Result = void, bool IsConst = true>
+class AstVisitor {
+protected:
+    template <typename T>
+    using Ptr = std::conditional_t<IsConst, const T*, T*>;
+
+
+    Result dispatch(Ptr<Node> node) {
+        Derived& self = static_cast<Derived&>(*this);
+        switch (node->kind) {
+            case NodeKind::NUMBER_LITERAL: return self.visit(static_cast<Ptr<NumberLiteral>>(node));
+            case NodeKind::IDENTIFIER: return self.visit(static_cast<Ptr<Identifier>>(node));
+            case NodeKind::BINARY_OP: return self.visit(static_cast<Ptr<BinaryOp>>(node));
+            case NodeKind::VAR_DECL: return self.visit(static_cast<Ptr<VarDecl>>(node));
+            case NodeKind::ASSIGNMENT: return self.visit(static_cast<Ptr<Assignment>>(node));
+            case NodeKind::BLOCK_STATEMENT: return self.visit(static_cast<Ptr<BlockStatement>>(node));
+            case NodeKind::IF_STATEMENT: return self.visit(static_cast<Ptr<IfStatement>>(node));
+            case NodeKind::WHILE_STATEMENT: return self.visit(static_cast<Ptr<WhileStatement>>(node));
+            case NodeKind::PROGRAM: return self.visit(static_cast<Ptr<Program>>(node));
+        }
+        throw std::runtime_error("AstVisitor Error: Unknown node kind");
+    }
+};
+
+
+#endif
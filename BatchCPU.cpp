@@ -0,0 +1,362 @@
+#include "BatchCPU.h"
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+
+// 2 selects the AVX2 kernels, 1 the SSE2 ones and 0 the scalar loops. The default
+// follows what the compiler targets, e.g. AVX2 with -mavx2 and SSE2 on any x86-64.
+#ifndef BATCH_SIMD
+#if defined(__AVX2__)
+#define BATCH_SIMD 2
+#elif defined(__SSE2__)
+#define BATCH_SIMD 1
+#else
+#define BATCH_SIMD 0
+#endif
+#endif
+
+#if BATCH_SIMD == 2
+#include <immintrin.h>
+#elif BATCH_SIMD == 1
+#include <emmintrin.h>
+#endif
+
+
+namespace {
+
+#if BATCH_SIMD == 2
+using Vector = __m256i;
+constexpr size_t WIDTH = 32;
+inline Vector load(const uint8_t* p) { return _mm256_loadu_si256(reinterpret_cast<const Vector*>(p)); }
+inline void store(uint8_t* p, Vector v) { _mm256_storeu_si256(reinterpret_cast<Vector*>(p), v); }
+inline Vector splat(uint8_t value) { return _mm256_set1_epi8(static_cast<char>(value)); }
+inline Vector add(Vector a, Vector b) { return _mm256_add_epi8(a, b); }
+inline Vector subtract(Vector a, Vector b) { return _mm256_sub_epi8(a, b); }
+inline Vector equal(Vector a, Vector b) { return _mm256_cmpeq_epi8(a, b); }
+inline Vector maxUnsigned(Vector a, Vector b) { return _mm256_max_epu8(a, b); }
+inline Vector bitAnd(Vector a, Vector b) { return _mm256_and_si256(a, b); }
+inline Vector andNot(Vector a, Vector b) { return _mm256_andnot_si256(a, b); }
+#elif BATCH_SIMD == 1
+using Vector = __m128i;
+constexpr size_t WIDTH = 16;
+inline Vector load(const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const Vector*>(p)); }
+inline void store(uint8_t* p, Vector v) { _mm_storeu_si128(reinterpret_cast<Vector*>(p), v); }
+inline Vector splat(uint8_t value) { return _mm_set1_epi8(static_cast<char>(value)); }
+inline Vector add(Vector a, Vector b) { return _mm_add_epi8(a, b); }
+inline Vector subtract(Vector a, Vector b) { return _mm_sub_epi8(a, b); }
+inline Vector equal(Vector a, Vector b) { return _mm_cmpeq_epi8(a, b); }
+inline Vector maxUnsigned(Vector a, Vector b) { return _mm_max_epu8(a, b); }
+inline Vector bitAnd(Vector a, Vector b) { return _mm_and_si128(a, b); }
+inline Vector andNot(Vector a, Vector b) { return _mm_andnot_si128(a, b); }
+#endif
+
+#if BATCH_SIMD
+// All ones in each byte where a >= b, unsigned.
+inline Vector atLeast(Vector a, Vector b) { return equal(maxUnsigned(a, b), a); }
+#endif
+
+
+// Flags are stored as 0 or 1 per lane. Each kernel handles whole vectors first and the
+// remaining lanes one at a time, with the same expressions as CPU::execute.
+void addLanes(uint8_t* a, const uint8_t* b, uint8_t* zero, uint8_t* carry, size_t n) {
+    size_t i = 0;
+#if BATCH_SIMD
+    const Vector one = splat(1), none = splat(0);
+    for (; i + WIDTH <= n; i += WIDTH) {
+        Vector before = load(a + i);
+        Vector sum = add(before, load(b + i));
+        store(a + i, sum);
+        store(carry + i, andNot(atLeast(sum, before), one));
+        store(zero + i, bitAnd(equal(sum, none), one));
+    }
+#endif
+    for (; i < n; ++i) {
+        uint16_t result = a[i] + b[i];
+        a[i] = static_cast<uint8_t>(result);
+        carry[i] = result > 255;
+        zero[i] = a[i] == 0;
+    }
+}
+
+
+void subLanes(uint8_t* a, const uint8_t* b, uint8_t* zero, uint8_t* carry, size_t n) {
+    size_t i = 0;
+#if BATCH_SIMD
+    const Vector one = splat(1), none = splat(0);
+    for (; i + WIDTH <= n; i += WIDTH) {
+        Vector subtrahend = load(b + i);
+        Vector difference = subtract(load(a + i), subtrahend);
+        store(a + i, difference);
+        store(carry + i, andNot(atLeast(difference, subtrahend), one));
+        store(zero + i, bitAnd(equal(difference, none), one));
+    }
+#endif
+    for (; i < n; ++i) {
+        a[i] = static_cast<uint8_t>(a[i] - b[i]);
+        carry[i] = b[i] > a[i];
+        zero[i] = a[i] == 0;
+    }
+}
+
+
+void cmpLanes(const uint8_t* a, const uint8_t* b, uint8_t* zero, uint8_t* carry, size_t n) {
+    size_t i = 0;
+#if BATCH_SIMD
+    const Vector one = splat(1);
+    for (; i + WIDTH <= n; i += WIDTH) {
+        Vector left = load(a + i);
+        Vector right = load(b + i);
+        store(carry + i, andNot(atLeast(left, right), one));
+        store(zero + i, bitAnd(equal(left, right), one));
+    }
+#endif
+    for (; i < n; ++i) {
+        zero[i] = a[i] == b[i];
+        carry[i] = b[i] > a[i];
+    }
+}
+
+
+size_t countSet(const uint8_t* flags, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) count += flags[i];
+    return count;
+}
+
+}
+
+
+BatchCPU::BatchCPU(size_t lanes, const MachineModel& machine)
+    : lane_count(lanes), memory_size(static_cast<int>(machine.memory_size)),
+      stack_base(static_cast<int>(machine.dataLimit())), address_mask(machine.addressMask()),
+      reg_A(lanes, 0), reg_B(lanes, 0), zero_flag(lanes, 0), carry_flag(lanes, 0), pc(lanes, 0),
+      sp(lanes, static_cast<uint16_t>(machine.memory_size - 1)), executed(lanes, 0), status(lanes, HALTED),
+      slot_of(lanes), lane_of(lanes) {
+    if (!machine.valid()) {
+        throw std::runtime_error("BatchCPU Error: Memory must be a power of two from 256 to 65536 bytes, with room for the stack");
+    }
+    memory.assign(static_cast<size_t>(memory_size) * lanes, 0);
+    row_by_slot.assign(memory_size, false);
+    for (size_t lane = 0; lane < lanes; ++lane) {
+        slot_of[lane] = lane;
+        lane_of[lane] = lane;
+    }
+}
+
+
+void BatchCPU::loadProgram(std::vector<MachineInstr> program) {
+    owned_instructions = std::move(program);
+    instructions = owned_instructions.data();
+    instruction_count = owned_instructions.size();
+}
+
+
+void BatchCPU::loadProgram(const MachineInstr* program, size_t count) {
+    owned_instructions.clear();
+    instructions = program;
+    instruction_count = count;
+}
+
+
+size_t BatchCPU::memoryIndex(size_t lane, int address) const {
+    if (lane >= lane_count || address < 0 || address >= memory_size) {
+        throw std::runtime_error("BatchCPU Error: Lane or address out of range");
+    }
+    return static_cast<size_t>(address) * lane_count + (row_by_slot[address] ? slot_of[lane] : lane);
+}
+
+
+void BatchCPU::setMemory(size_t lane, int address, uint8_t value) {
+    memory[memoryIndex(lane, address)] = value;
+}
+
+
+uint8_t BatchCPU::memoryAt(size_t lane, int address) const {
+    return memory[memoryIndex(lane, address)];
+}
+
+
+uint8_t* BatchCPU::row(uint16_t address) {
+    uint8_t* data = &memory[static_cast<size_t>(address) * lane_count];
+    if (!row_by_slot[address]) {
+        std::vector<uint8_t> by_lane(data, data + lane_count);
+        for (size_t slot = 0; slot < lane_count; ++slot) data[slot] = by_lane[lane_of[slot]];
+        row_by_slot[address] = true;
+        slot_rows.push_back(address);
+    }
+    return data;
+}
+
+
+// Every lane starts at pc 0 as in CPU::run(). Lanes only form a group with neighbours
+// at the same sp, which after a previous run is not guaranteed.
+void BatchCPU::run() {
+    std::vector<Group> pending;
+    size_t begin = 0;
+    for (size_t slot = 1; slot <= lane_count; ++slot) {
+        if (slot == lane_count || sp[slot] != sp[begin]) {
+            pending.push_back({begin, slot, 0, sp[begin], 0});
+            begin = slot;
+        }
+    }
+    while (!pending.empty()) {
+        Group group = pending.back();
+        pending.pop_back();
+        runGroup(group, pending);
+    }
+}
+
+
+void BatchCPU::runGroup(Group group, std::vector<Group>& pending) {
+    while (group.pc < instruction_count) {
+        const MachineInstr& instr = instructions[group.pc];
+        const size_t first = group.begin;
+        const size_t n = group.end - group.begin;
+        uint16_t next_pc = group.pc + 1;
+
+        switch (instr.op) {
+            case Opcode::LDI:
+                std::memset(&reg(instr.reg)[first], static_cast<uint8_t>(instr.operand), n);
+                break;
+            case Opcode::LDA:
+                std::memcpy(&reg_A[first], row(instr.operand & address_mask) + first, n);
+                break;
+            case Opcode::STA:
+                std::memcpy(row(instr.operand & address_mask) + first, &reg_A[first], n);
+                break;
+            case Opcode::MOV: {
+                std::vector<uint8_t>& dst = reg(instr.reg);
+                std::vector<uint8_t>& src = reg(static_cast<Reg>(instr.operand));
+                if (&dst != &src) std::memcpy(&dst[first], &src[first], n);
+                break;
+            }
+
+            case Opcode::ADD:
+                addLanes(&reg_A[first], &reg_B[first], &zero_flag[first], &carry_flag[first], n);
+                break;
+            case Opcode::SUB:
+                subLanes(&reg_A[first], &reg_B[first], &zero_flag[first], &carry_flag[first], n);
+                break;
+            case Opcode::CMP:
+                cmpLanes(&reg_A[first], &reg_B[first], &zero_flag[first], &carry_flag[first], n);
+                break;
+
+            case Opcode::JMP:
+                next_pc = instr.operand;
+                break;
+            case Opcode::JNE: {
+                // Lanes with the zero flag set fall through and move to the front of the
+                // group; the rest become a new group at the target.
+                size_t falling = countSet(&zero_flag[first], n);
+                if (falling == 0) {
+                    next_pc = instr.operand;
+                } else if (falling < n) {
+                    size_t low = first, high = group.end - 1;
+                    while (true) {
+                        while (zero_flag[low]) low++;
+                        while (!zero_flag[high]) high--;
+                        if (low > high) break;
+                        swapSlots(low, high);
+                    }
+                    size_t boundary = first + falling;
+                    pending.push_back({boundary, group.end, instr.operand, group.sp, group.executed + 1});
+                    group.end = boundary;
+                }
+                break;
+            }
+
+            case Opcode::PUSH:
+                std::memcpy(row(group.sp) + first, &reg(instr.reg)[first], n);
+                group.sp--;
+                if (group.sp < stack_base) {
+                    finish(group, STACK_OVERFLOW);
+                    return;
+                }
+                break;
+            case Opcode::POP:
+                if (group.sp + 1 >= memory_size) {
+                    finish(group, STACK_UNDERFLOW);
+                    return;
+                }
+                group.sp++;
+                std::memcpy(&reg(instr.reg)[first], row(group.sp) + first, n);
+                break;
+            case Opcode::HLT:
+                finish(group, HALTED);
+                return;
+            default:
+                break;
+        }
+
+        group.pc = next_pc;
+        group.executed++;
+    }
+    finish(group, HALTED);
+}
+
+
+void BatchCPU::finish(const Group& group, Status result) {
+    for (size_t slot = group.begin; slot < group.end; ++slot) {
+        pc[slot] = group.pc;
+        sp[slot] = group.sp;
+        executed[slot] = group.executed;
+        status[slot] = result;
+    }
+}
+
+
+void BatchCPU::swapSlots(size_t first, size_t second) {
+    std::swap(reg_A[first], reg_A[second]);
+    std::swap(reg_B[first], reg_B[second]);
+    std::swap(zero_flag[first], zero_flag[second]);
+    std::swap(carry_flag[first], carry_flag[second]);
+    std::swap(pc[first], pc[second]);
+    std::swap(sp[first], sp[second]);
+    std::swap(executed[first], executed[second]);
+    std::swap(status[first], status[second]);
+    for (uint16_t address : slot_rows) {
+        size_t offset = static_cast<size_t>(address) * lane_count;
+        std::swap(memory[offset + first], memory[offset + second]);
+    }
+    std::swap(lane_of[first], lane_of[second]);
+    slot_of[lane_of[first]] = first;
+    slot_of[lane_of[second]] = second;
+}
+
+
+std::string BatchCPU::error(size_t lane) const {
+    switch (status[slot_of[lane]]) {
+        case STACK_OVERFLOW: return "Stack overflow";
+        case STACK_UNDERFLOW: return "Stack underflow";
+        default: return "";
+    }
+}
+
+
+void BatchCPU::printState(size_t lane, std::ostream& out) const {
+    size_t slot = slot_of[lane];
+    out << "--- CPU State ---" << std::endl;
+    out << "A: " << static_cast<int>(reg_A[slot]) << " B: " << static_cast<int>(reg_B[slot]) << std::endl;
+    out << "PC: " << static_cast<int>(pc[slot]) << " SP: " << static_cast<int>(sp[slot]) << std::endl;
+    out << "Zero: " << static_cast<int>(zero_flag[slot]) << " Carry: " << static_cast<int>(carry_flag[slot]) << std::endl;
+}
+
+
+void BatchCPU::printMemory(size_t lane, int start, int count, std::ostream& out) const {
+    out << "--- CPU Memory State ---" << std::endl;
+    for (int i = start; i < start + count; ++i) {
+        out << "Address [" << i << "]: " << static_cast<int>(memoryAt(lane, i)) << std::endl;
+    }
+}
+
+
+const char* BatchCPU::simdName() {
+#if BATCH_SIMD == 2
+    return "AVX2";
+#elif BATCH_SIMD == 1
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
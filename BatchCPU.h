@@ -0,0 +1,96 @@
+#ifndef BATCH_CPU_H
+#define BATCH_CPU_H
+
+
+#include "Isa.h"
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+// Runs one program on many CPU instances ("lanes") at once. State is kept as structure
+// of arrays: one array per register and flag, and memory stored address-major so that
+// an address across all lanes is one contiguous row. Lanes that share a program counter
+// execute as a group, one instruction at a time, with add/sub/cmp vectorized across the
+// group (AVX2 or SSE2 where the compiler targets them, scalar otherwise). When a jne
+// splits a group, its lanes are regrouped by target so that both halves stay
+// contiguous. Every lane ends in exactly the state CPU::run() would leave it in.
+class BatchCPU {
+public:
+    explicit BatchCPU(size_t lanes, const MachineModel& machine = MachineModel());
+    void loadProgram(std::vector<MachineInstr> program);
+    // As CPU::loadProgram: the instructions must stay valid while the batch uses them.
+    void loadProgram(const MachineInstr* program, size_t count);
+
+    void setMemory(size_t lane, int address, uint8_t value);
+    uint8_t memoryAt(size_t lane, int address) const;
+    void run();
+
+    size_t laneCount() const { return lane_count; }
+    // Instructions the lane executed in the last run(), not counting the final hlt.
+    uint64_t instructionCount(size_t lane) const { return executed[slot_of[lane]]; }
+    // The error that stopped the lane, or an empty string if it halted normally.
+    std::string error(size_t lane) const;
+    // Same output as CPU::printState and CPU::printMemory for that lane.
+    void printState(size_t lane, std::ostream& out = std::cout) const;
+    void printMemory(size_t lane, int start, int count, std::ostream& out = std::cout) const;
+    // Which vector code the add/sub/cmp kernels were built with.
+    static const char* simdName();
+
+
+private:
+    enum Status : uint8_t {
+        HALTED,
+        STACK_OVERFLOW,
+        STACK_UNDERFLOW
+    };
+
+    // Lanes [begin, end) in slot order, all at the same pc and sp.
+    struct Group {
+        size_t begin;
+        size_t end;
+        uint16_t pc;
+        uint16_t sp;
+        uint64_t executed;
+    };
+
+    size_t lane_count;
+    int memory_size;
+    int stack_base;
+    uint16_t address_mask;
+
+    // Indexed by slot. Lanes move between slots when groups split; slot_of and lane_of
+    // map between the two.
+    std::vector<uint8_t> reg_A;
+    std::vector<uint8_t> reg_B;
+    std::vector<uint8_t> zero_flag;
+    std::vector<uint8_t> carry_flag;
+    std::vector<uint16_t> pc;
+    std::vector<uint16_t> sp;
+    std::vector<uint64_t> executed;
+    std::vector<uint8_t> status;
+    // memory[address * lane_count + i], where i is the slot for rows the program has
+    // touched and the lane for all others. Rows switch to slot order on first use, so
+    // regrouping only has to move the rows a program actually uses.
+    std::vector<uint8_t> memory;
+    std::vector<bool> row_by_slot;
+    std::vector<uint16_t> slot_rows;
+    std::vector<size_t> slot_of;
+    std::vector<size_t> lane_of;
+
+    std::vector<MachineInstr> owned_instructions;
+    const MachineInstr* instructions = nullptr;
+    size_t instruction_count = 0;
+
+    uint8_t* row(uint16_t address);
+    size_t memoryIndex(size_t lane, int address) const;
+    std::vector<uint8_t>& reg(Reg r) { return r == Reg::A ? reg_A : reg_B; }
+    void runGroup(Group group, std::vector<Group>& pending);
+    void finish(const Group& group, Status result);
+    void swapSlots(size_t first, size_t second);
+};
+
+
+#endif
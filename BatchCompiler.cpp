@@ -0,0 +1,94 @@
+#include "BatchCompiler.h"
+#include "lexer.h"
+#include "parser.h"
+#include "MappedFile.h"
+#include "ObjectFile.h"
+#include <algorithm>
+#include <cctype>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+
+
+namespace {
+
+// Per-worker state, kept across files so that the symbol storage and the AST arena only
+// grow to the largest file a worker has seen instead of being reallocated every time.
+struct CompileWorkspace {
+    SymbolTable symbols;
+    std::unique_ptr<Program> program;
+};
+
+
+BatchFileResult compileOne(const std::string& path, const BatchOptions& options, CompileWorkspace& workspace,
+                           const BatchCodeGenerator& generate) {
+    BatchFileResult result;
+    try {
+        MappedFile file(path);
+        std::string output = std::filesystem::path(path).replace_extension(".slo").string();
+        std::string key;
+        if (options.cache) {
+            key = options.cache->key(file.view(), options.cache_flags);
+            if (std::unique_ptr<MappedFile> entry = options.cache->lookup(key)) {
+                result.instructions = ObjectView(entry->view()).instructionCount();
+                if (options.write_objects) writeObject(output, entry->view());
+                result.ok = true;
+                return result;
+            }
+        }
+
+        workspace.symbols.clear();
+        // A parse that throws takes the recycled program with it.
+        if (!workspace.program) workspace.program = std::make_unique<Program>();
+        Lexer lexer(file.view(), workspace.symbols);
+        Parser parser(lexer);
+        workspace.program = parser.parse(std::move(workspace.program));
+
+        ObjectFile compiled = generate(*workspace.program, workspace.symbols);
+        result.instructions = compiled.instructions.size();
+        if (options.write_objects || options.cache) {
+            std::string object = encodeObject(compiled);
+            if (options.cache) options.cache->store(key, object);
+            if (options.write_objects) writeObject(output, object);
+        }
+        result.ok = true;
+    } catch (const std::exception& e) {
+        result.diagnostic = e.what();
+    }
+    return result;
+}
+}
+
+
+std::vector<std::string> collectSourceFiles(const std::string& path) {
+    std::vector<std::string> files;
+    if (std::filesystem::is_directory(path)) {
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".sl") files.push_back(entry.path().string());
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    std::ifstream list(path);
+    if (!list) throw std::runtime_error("Batch Error: Cannot open file list '" + path + "'");
+    std::string line;
+    while (std::getline(list, line)) {
+        while (!line.empty() && isspace(static_cast<unsigned char>(line.back()))) line.pop_back();
+        if (!line.empty()) files.push_back(line);
+    }
+    return files;
+}
+
+
+std::vector<BatchFileResult> compileBatch(const std::vector<std::string>& paths, const BatchOptions& options,
+                                          WorkStealingPool& pool, const BatchCodeGenerator& generate) {
+    std::vector<BatchFileResult> results(paths.size());
+    std::vector<CompileWorkspace> workspaces(pool.threadCount());
+    pool.run(paths.size(), [&](size_t index, unsigned worker) {
+        results[index] = compileOne(paths[index], options, workspaces[worker], generate);
+    });
+    return results;
+}
@@ -0,0 +1,50 @@
+#ifndef BATCH_COMPILER_H
+#define BATCH_COMPILER_H
+
+
+#include "ast.h"
+#include "ObjectFile.h"
+#include "CompileCache.h"
+#include "SymbolTable.h"
+#include "ThreadPool.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+struct BatchOptions {
+    // Writes <input>.slo next to every file that compiles.
+    bool write_objects = false;
+    // When set, files whose source and flags are already cached skip compilation and
+    // new results are stored. `cache_flags` is passed to CompileCache::key.
+    CompileCache* cache = nullptr;
+    std::string cache_flags;
+};
+
+
+struct BatchFileResult {
+    bool ok = false;
+    size_t instructions = 0;
+    // The error that stopped the file, empty if it compiled.
+    std::string diagnostic;
+};
+
+
+// Turns a parsed program into the object to write or cache. Called concurrently from
+// several workers, each with its own program and symbol table.
+using BatchCodeGenerator = std::function<ObjectFile(Program& program, SymbolTable& symbols)>;
+
+
+// The source files to compile for `path`: every .sl file below it, sorted, if it is a
+// directory, and otherwise the files named in it, one per line.
+std::vector<std::string> collectSourceFiles(const std::string& path);
+
+// Lexes, parses and generates code for every file on the pool. Each worker keeps one
+// symbol table and one AST arena and reuses them from file to file. Results are in the
+// order of `paths`, whichever thread compiled each file.
+std::vector<BatchFileResult> compileBatch(const std::vector<std::string>& paths, const BatchOptions& options,
+                                          WorkStealingPool& pool, const BatchCodeGenerator& generate);
+
+
+#endif
@@ -0,0 +1,1721 @@
+#include "Benchmarks.h"
+#include "lexer.h"
+#include "parser.h"
+#include "AstVisitor.h"
+#include "Incremental.h"
+#include "CodeGenerator.h"
+#include "CPU.h"
+#include "CycleModel.h"
+#include "BatchCPU.h"
+#include "BatchCompiler.h"
+#include "CompileCache.h"
+#include "Linker.h"
+#include "ThreadPool.h"
+#include "AsmBuffer.h"
+#include "MappedFile.h"
+#include "ObjectFile.h"
+#include "Optimizer.h"
+#include "Peephole.h"
+#include "IrBuilder.h"
+#include "IrBackend.h"
+#include "ValueNumbering.h"
+#include "Profiler.h"
+#include "SymbolTable.h"
+#include "Verifier.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+void benchmarkLexer() {
+    std::string source = generateBenchmarkProgram(200000);
+    const int iterations = 10;
+
+    size_t token_count = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        SymbolTable symbols;
+        Lexer lexer(source, symbols);
+        token_count = 0;
+        while (lexer.getNextToken().type != TokenType::END_OF_FILE) {
+            token_count++;
+        }
+    }
+    double seconds = secondsSince(start);
+
+    double megabytes = static_cast<double>(source.size()) * iterations / (1024.0 * 1024.0);
+    std::cout << "--- Lexer Benchmark ---" << std::endl;
+    std::cout << "Source: " << source.size() << " bytes, " << token_count << " tokens" << std::endl;
+    std::cout << "Throughput: " << std::fixed << std::setprecision(1) << megabytes / seconds << " MB/s" << std::endl;
+}
+
+
+
+// The pre-arena AST: every node is a separate heap allocation owning its own strings.
+// Kept here only as the baseline for the AST benchmark.
+namespace legacy {
+
+struct Node {
+    virtual ~Node() = default;
+};
+
+struct Expression : Node {};
+struct Statement : Node {};
+
+struct NumberLiteral : Expression {
+    int value;
+    explicit NumberLiteral(int val) : value(val) {}
+};
+
+struct Identifier : Expression {
+    std::string name;
+    explicit Identifier(std::string n) : name(std::move(n)) {}
+};
+
+struct BinaryOp : Expression {
+    std::string op;
+    std::unique_ptr<Expression> left;
+    std::unique_ptr<Expression> right;
+    BinaryOp(std::string o, std::unique_ptr<Expression> l, std::unique_ptr<Expression> r)
+        : op(std::move(o)), left(std::move(l)), right(std::move(r)) {}
+};
+
+struct VarDecl : Statement {
+    std::string varName;
+    explicit VarDecl(std::string name) : varName(std::move(name)) {}
+};
+
+struct Assignment : Statement {
+    std::string varName;
+    std::unique_ptr<Expression> value;
+    Assignment(std::string name, std::unique_ptr<Expression> val) : varName(std::move(name)), value(std::move(val)) {}
+};
+
+struct BlockStatement : Statement {
+    std::vector<std::unique_ptr<Statement>> statements;
+};
+
+struct IfStatement : Statement {
+    std::unique_ptr<Expression> condition;
+    std::unique_ptr<BlockStatement> body;
+    IfStatement(std::unique_ptr<Expression> cond, std::unique_ptr<BlockStatement> b)
+        : condition(std::move(cond)), body(std::move(b)) {}
+};
+
+struct Program : Node {
+    std::vector<std::unique_ptr<Statement>> statements;
+};
+
+
+// Same grammar as Parser, building the legacy tree from an already-lexed token vector.
+class TreeBuilder {
+public:
+    TreeBuilder(const std::vector<Token>& tokens, const Lexer& lexer) : tokens(tokens), lexer(lexer) {}
+
+    std::unique_ptr<Program> parse() {
+        auto program = std::make_unique<Program>();
+        while (peek().type != TokenType::END_OF_FILE) {
+            program->statements.push_back(parseStatement());
+        }
+        return program;
+    }
+
+
+private:
+    const std::vector<Token>& tokens;
+    const Lexer& lexer;
+    size_t position = 0;
+
+    const Token& peek(size_t ahead = 0) { return tokens[std::min(position + ahead, tokens.size() - 1)]; }
+    const Token& advance() { return tokens[position++]; }
+    std::string text(const Token& token) { return std::string(lexer.text(token)); }
+
+    std::unique_ptr<Statement> parseStatement() {
+        if (peek().type == TokenType::INT) {
+            advance();
+            auto decl = std::make_unique<VarDecl>(text(advance()));
+            advance();
+            return decl;
+        }
+        if (peek().type == TokenType::IF) {
+            advance();
+            advance();
+            auto condition = parseExpression();
+            advance();
+            return std::make_unique<IfStatement>(std::move(condition), parseBlock());
+        }
+        std::string name = text(advance());
+        advance();
+        auto value = parseExpression();
+        advance();
+        return std::make_unique<Assignment>(std::move(name), std::move(value));
+    }
+
+    std::unique_ptr<BlockStatement> parseBlock() {
+        auto block = std::make_unique<BlockStatement>();
+        advance();
+        while (peek().type != TokenType::RBRACE) {
+            block->statements.push_back(parseStatement());
+        }
+        advance();
+        return block;
+    }
+
+    std::unique_ptr<Expression> parseExpression() {
+        auto left = parsePrimary();
+        while (peek().type == TokenType::PLUS || peek().type == TokenType::MINUS || peek().type == TokenType::EQUAL) {
+            std::string op = text(advance());
+            left = std::make_unique<BinaryOp>(std::move(op), std::move(left), parsePrimary());
+        }
+        return left;
+    }
+
+    std::unique_ptr<Expression> parsePrimary() {
+        const Token& token = advance();
+        if (token.type == TokenType::INTEGER_LITERAL) return std::make_unique<NumberLiteral>(static_cast<int>(token.value));
+        return std::make_unique<Identifier>(text(token));
+    }
+};
+
+
+// dynamic_cast-chain traversal in the shape CodeGenerator used before tag dispatch.
+uint64_t walk(const Expression* expr) {
+    if (auto e = dynamic_cast<const NumberLiteral*>(expr)) return static_cast<uint64_t>(e->value);
+    if (auto e = dynamic_cast<const Identifier*>(expr)) return e->name.size();
+    if (auto e = dynamic_cast<const BinaryOp*>(expr)) {
+        uint64_t sum = walk(e->left.get()) + walk(e->right.get());
+        if (e->op == "+") return sum + 1;
+        if (e->op == "-") return sum + 2;
+        return sum + 3;
+    }
+    return 0;
+}
+
+
+uint64_t walk(const Statement* stmt) {
+    if (auto s = dynamic_cast<const VarDecl*>(stmt)) return s->varName.size();
+    if (auto s = dynamic_cast<const Assignment*>(stmt)) return walk(s->value.get());
+    if (auto s = dynamic_cast<const IfStatement*>(stmt)) return walk(s->condition.get()) + walk(s->body.get());
+    if (auto s = dynamic_cast<const BlockStatement*>(stmt)) {
+        uint64_t sum = 0;
+        for (const auto& child : s->statements) sum += walk(child.get());
+        return sum;
+    }
+    return 0;
+}
+
+}
+
+
+// The same traversal as legacy::walk, dispatched on node kind tags.
+class TagWalker : private AstVisitor<TagWalker, uint64_t> {
+public:
+    explicit TagWalker(const SymbolTable& symbols) : symbols(symbols) {}
+    uint64_t walk(const Node* node) { return dispatch(node); }
+
+
+private:
+    const SymbolTable& symbols;
+
+    friend class AstVisitor<TagWalker, uint64_t>;
+
+    uint64_t visit(const NumberLiteral* e) { return static_cast<uint64_t>(e->value); }
+    uint64_t visit(const Identifier* e) { return symbols.name(e->symbol).size(); }
+    uint64_t visit(const BinaryOp* e) {
+        uint64_t sum = walk(e->left) + walk(e->right);
+        switch (e->op) {
+            case BinaryOperator::ADD: return sum + 1;
+            case BinaryOperator::SUBTRACT: return sum + 2;
+            case BinaryOperator::EQUAL:
+            case BinaryOperator::NOT_EQUAL: return sum + 3;
+        }
+        return sum;
+    }
+    uint64_t visit(const VarDecl* s) { return symbols.name(s->symbol).size(); }
+    uint64_t visit(const Assignment* s) { return walk(s->value); }
+    uint64_t visit(const IfStatement* s) { return walk(s->condition) + walk(s->body); }
+    uint64_t visit(const WhileStatement* s) { return walk(s->condition) + walk(s->body); }
+    uint64_t visit(const BlockStatement* s) {
+        uint64_t sum = 0;
+        for (const Statement* child : s->statements) sum += walk(child);
+        return sum;
+    }
+    uint64_t visit(const Program* p) {
+        uint64_t sum = 0;
+        for (const Statement* child : p->statements) sum += walk(child);
+        return sum;
+    }
+};
+
+
+std::vector<Token> lexAll(const std::string& source, Lexer& lexer) {
+    std::vector<Token> tokens;
+    tokens.reserve(source.size() / 4);
+    Token token;
+    do {
+        token = lexer.getNextToken();
+        tokens.push_back(token);
+    } while (token.type != TokenType::END_OF_FILE);
+    return tokens;
+}
+
+
+void benchmarkAst() {
+    std::string source = generateBenchmarkProgram(500000);
+    SymbolTable symbols;
+    Lexer lexer(source, symbols);
+    std::vector<Token> tokens = lexAll(source, lexer);
+
+    const int iterations = 5;
+    double legacy_parse = 0, legacy_free = 0, arena_parse = 0, arena_free = 0;
+    for (int i = 0; i < iterations; ++i) {
+        auto start = Clock::now();
+        auto legacy_tree = legacy::TreeBuilder(tokens, lexer).parse();
+        legacy_parse += secondsSince(start);
+        start = Clock::now();
+        legacy_tree.reset();
+        legacy_free += secondsSince(start);
+
+        start = Clock::now();
+        auto arena_tree = Parser(tokens, source).parse();
+        arena_parse += secondsSince(start);
+        start = Clock::now();
+        arena_tree.reset();
+        arena_free += secondsSince(start);
+    }
+
+    auto report = [&](const char* label, double parse, double release) {
+        std::cout << std::left << std::setw(12) << label << std::right << std::fixed << std::setprecision(2)
+                  << "parse " << std::setw(9) << parse * 1000 / iterations << " ms   "
+                  << "free " << std::setw(9) << release * 1000 / iterations << " ms   "
+                  << "total " << std::setw(9) << (parse + release) * 1000 / iterations << " ms" << std::endl;
+    };
+    std::cout << "--- AST Benchmark (" << tokens.size() << " tokens) ---" << std::endl;
+    report("unique_ptr", legacy_parse, legacy_free);
+    report("arena", arena_parse, arena_free);
+}
+
+
+void benchmarkDispatch() {
+    std::string source = generateBenchmarkProgram(500000);
+    SymbolTable symbols;
+    Lexer lexer(source, symbols);
+    std::vector<Token> tokens = lexAll(source, lexer);
+    auto legacy_tree = legacy::TreeBuilder(tokens, lexer).parse();
+    auto tagged_tree = Parser(tokens, source).parse();
+
+    const int iterations = 20;
+    uint64_t legacy_sum = 0, tagged_sum = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        for (const auto& stmt : legacy_tree->statements) legacy_sum += legacy::walk(stmt.get());
+    }
+    double legacy_seconds = secondsSince(start);
+
+    TagWalker walker(symbols);
+    start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        tagged_sum += walker.walk(tagged_tree.get());
+    }
+    double tagged_seconds = secondsSince(start);
+
+    std::cout << "--- AST Dispatch Benchmark (" << tokens.size() << " tokens) ---" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "dynamic_cast + string ops: " << legacy_seconds * 1000 / iterations << " ms per walk" << std::endl;
+    std::cout << "kind tags + enum ops:      " << tagged_seconds * 1000 / iterations << " ms per walk" << std::endl;
+    std::cout << "Speedup: " << legacy_seconds / tagged_seconds << "x" << (legacy_sum == tagged_sum ? "" : " (checksum mismatch!)") << std::endl;
+}
+
+
+
+// Small programs used to compare code quality.
+struct BenchmarkProgram {
+    const char* name;
+    const char* source;
+};
+
+
+const BenchmarkProgram benchmark_programs[] = {
+    {"example", R"(
+        int a;
+        int b;
+        int c;
+        a = 10;
+        b = 20;
+        c = a + b;
+        if (c == 30) {
+            c = c + 1;
+        }
+    )"},
+    {"chains", R"(
+        int x;
+        int y;
+        int z;
+        int t;
+        x = 3;
+        y = 4;
+        z = x + y + 5 - x + y;
+        t = z - y - 1 + x + 7;
+        x = t + z + y + x - 2;
+        y = x - t + z + 9 - y;
+        z = x + y + z + t;
+    )"},
+    {"branches", R"(
+        int a;
+        int b;
+        int r;
+        a = 7;
+        b = 7;
+        r = 0;
+        if (a == b) {
+            r = r + 1;
+            if (a + b == 14) {
+                r = r + a - b + 2;
+            }
+        }
+        if (r == 3) {
+            a = a + b + r;
+        }
+        if (a - 17 == b) {
+            b = 0;
+        }
+    )"},
+    {"common", R"(
+        int x;
+        int y;
+        int s;
+        int d;
+        int r;
+        x = 9;
+        y = 4;
+        s = x + y;
+        d = x - y;
+        r = x + y + d;
+        if (x + y == 13) {
+            s = x + y + s;
+            r = x - y + r;
+        }
+        if (y + x - d == 8) {
+            d = x - y + x + y;
+        }
+    )"},
+    {"values", R"(
+        int a;
+        int b;
+        int c;
+        int x;
+        int y;
+        a = 3;
+        b = 4;
+        c = 9;
+        x = a + b == c;
+        y = a + b != c - 1;
+    )"},
+};
+
+
+struct CompiledRun {
+    size_t static_instructions = 0;
+    uint64_t dynamic_instructions = 0;
+    std::string memory;
+};
+
+
+CompiledRun runCode(const AsmBuffer& code, int variable_count) {
+    CPU cpu;
+    cpu.loadProgram(assemble(code));
+    cpu.run();
+
+    CompiledRun run;
+    run.static_instructions = code.instructionCount();
+    run.dynamic_instructions = cpu.instructionCount();
+    std::ostringstream memory;
+    cpu.printMemory(0, variable_count, memory);
+    run.memory = memory.str();
+    return run;
+}
+
+
+// Runs the SSA pipeline without the AST optimizer in front, so the IR passes see every
+// expression of the source.
+CompiledRun compileAndRunIr(const std::string& source, bool value_numbering) {
+    SymbolTable symbols;
+    Lexer lexer(source, symbols);
+    Parser parser(lexer);
+    std::unique_ptr<Program> program = parser.parse();
+    std::unique_ptr<IrFunction> ir = buildIr(*program, symbols);
+    if (value_numbering) numberValues(*ir);
+    eliminateDeadStores(*ir);
+    return runCode(emitAssembly(*ir), static_cast<int>(ir->slot_names.size()));
+}
+
+
+AsmBuffer compileCode(const std::string& source, CodeGenOptions options, int optimization_level, const LoopOptions& loops,
+                      int& variable_count) {
+    SymbolTable symbols;
+    Lexer lexer(source, symbols);
+    Parser parser(lexer);
+    std::unique_ptr<Program> program = parser.parse();
+    optimizeProgram(*program, symbols, optimization_level, true, loops);
+    AsmBuffer code;
+    if (optimization_level >= 2) {
+        std::unique_ptr<IrFunction> ir = buildIr(*program, symbols);
+        numberValues(*ir);
+        eliminateDeadStores(*ir);
+        code = emitAssembly(*ir);
+        variable_count = static_cast<int>(ir->slot_names.size());
+    } else {
+        CodeGenerator generator(symbols, options);
+        code = generator.generate(*program);
+        variable_count = generator.variableCount();
+    }
+    if (optimization_level > 0) {
+        PeepholeOptimizer peephole;
+        peephole.optimize(code);
+    }
+    return code;
+}
+
+
+CompiledRun compileAndRun(const std::string& source, CodeGenOptions options, int optimization_level = 0,
+                          const LoopOptions& loops = LoopOptions()) {
+    int variable_count = 0;
+    AsmBuffer code = compileCode(source, options, optimization_level, loops, variable_count);
+    return runCode(code, variable_count);
+}
+
+
+void benchmarkCodegen() {
+    CodeGenOptions stack_options;
+    stack_options.register_operands = false;
+    CodeGenOptions register_options;
+
+    std::cout << "--- Codegen Benchmark (static / dynamic instructions) ---" << std::endl;
+    std::cout << std::left << std::setw(10) << "program" << std::right << std::setw(16) << "stack operands"
+              << std::setw(20) << "register operands" << std::setw(12) << "change" << std::setw(14) << "-O1" << std::setw(14) << "-O2" << std::endl;
+    for (const BenchmarkProgram& program : benchmark_programs) {
+        CompiledRun before = compileAndRun(program.source, stack_options);
+        CompiledRun after = compileAndRun(program.source, register_options);
+        CompiledRun optimized = compileAndRun(program.source, register_options, 1);
+        CompiledRun ssa = compileAndRun(program.source, register_options, 2);
+        double saved = 100.0 * (1.0 - static_cast<double>(after.dynamic_instructions) / before.dynamic_instructions);
+        bool same = before.memory == after.memory && before.memory == optimized.memory && before.memory == ssa.memory;
+        std::cout << std::left << std::setw(10) << program.name << std::right
+                  << std::setw(8) << before.static_instructions << " / " << std::setw(4) << before.dynamic_instructions
+                  << std::setw(12) << after.static_instructions << " / " << std::setw(4) << after.dynamic_instructions
+                  << std::setw(10) << std::fixed << std::setprecision(1) << -saved << "%"
+                  << std::setw(7) << optimized.static_instructions << " / " << std::setw(4) << optimized.dynamic_instructions
+                  << std::setw(7) << ssa.static_instructions << " / " << std::setw(4) << ssa.dynamic_instructions
+                  << (same ? "" : "  (memory differs!)") << std::endl;
+    }
+}
+
+
+AsmBuffer compileToBuffer(const std::string& source, CodeGenOptions options, int optimization_level) {
+    SymbolTable symbols;
+    Lexer lexer(source, symbols);
+    Parser parser(lexer);
+    std::unique_ptr<Program> program = parser.parse();
+    optimizeProgram(*program, symbols, optimization_level);
+    CodeGenerator generator(symbols, options);
+    return generator.generate(*program);
+}
+
+
+// Rule fire counts over the small programs plus a large generated workload, for each
+// code generation setup that can sit in front of the peephole pass.
+void benchmarkPeephole() {
+    struct Setup {
+        const char* name;
+        bool register_operands;
+        int optimization_level;
+    };
+    const Setup setups[] = {
+        {"stack operands", false, 0},
+        {"register operands", true, 0},
+        {"register operands, AST -O1", true, 1},
+    };
+
+    std::string workload = generateBenchmarkProgram(20000);
+    for (const Setup& setup : setups) {
+        CodeGenOptions options;
+        options.register_operands = setup.register_operands;
+        PeepholeOptimizer peephole;
+        for (const BenchmarkProgram& program : benchmark_programs) {
+            AsmBuffer code = compileToBuffer(program.source, options, setup.optimization_level);
+            peephole.optimize(code);
+        }
+        AsmBuffer code = compileToBuffer(workload, options, setup.optimization_level);
+        size_t instructions = code.instructionCount();
+        auto start = Clock::now();
+        peephole.optimize(code);
+        double seconds = secondsSince(start);
+
+        std::cout << "--- Peephole Benchmark: " << setup.name << " (" << instructions
+                  << " instruction workload in " << std::fixed << std::setprecision(2) << seconds * 1000
+                  << " ms) ---" << std::endl;
+        peephole.printStats(std::cout);
+        std::cout << std::endl;
+    }
+}
+
+
+void benchmarkCse() {
+    std::cout << "--- CSE Benchmark (SSA pipeline, static / dynamic instructions) ---" << std::endl;
+    std::cout << std::left << std::setw(10) << "program" << std::right << std::setw(16) << "without GVN"
+              << std::setw(16) << "with GVN" << std::setw(12) << "change" << std::endl;
+    for (const BenchmarkProgram& program : benchmark_programs) {
+        CompiledRun before = compileAndRunIr(program.source, false);
+        CompiledRun after = compileAndRunIr(program.source, true);
+        double saved = 100.0 * (1.0 - static_cast<double>(after.dynamic_instructions) / before.dynamic_instructions);
+        std::cout << std::left << std::setw(10) << program.name << std::right
+                  << std::setw(8) << before.static_instructions << " / " << std::setw(4) << before.dynamic_instructions
+                  << std::setw(9) << after.static_instructions << " / " << std::setw(4) << after.dynamic_instructions
+                  << std::setw(10) << std::fixed << std::setprecision(1) << -saved << "%"
+                  << (before.memory == after.memory ? "" : "  (memory differs!)") << std::endl;
+    }
+}
+
+
+// Loops whose bounds are known, so -O1 can unroll them. The first loop of the last two
+// leaves x and k unknown (too long to unroll fully), which gives the second loop
+// invariant expressions to hoist and an induction variable to reduce.
+const BenchmarkProgram loop_programs[] = {
+    {"short", R"(
+        int i;
+        int s;
+        while (i != 8) {
+            s = s + i;
+            i = i + 1;
+        }
+    )"},
+    {"sum", R"(
+        int i;
+        int s;
+        while (i != 200) {
+            s = s + i + 3;
+            i = i + 1;
+        }
+    )"},
+    {"invariant", R"(
+        int i;
+        int x;
+        int y;
+        int s;
+        y = 5;
+        while (i != 50) {
+            x = x + i + i;
+            i = i + 1;
+        }
+        i = 0;
+        while (i != 100) {
+            s = x + y + 3 + s;
+            i = i + 1;
+        }
+    )"},
+    {"stride", R"(
+        int i;
+        int k;
+        int t;
+        int s;
+        while (i != 50) {
+            k = k + i + 7;
+            i = i + 1;
+        }
+        i = 0;
+        while (i != 120) {
+            t = i + i + i + k;
+            s = s + t;
+            i = i + 1;
+        }
+    )"},
+};
+
+
+// -O1 code for the loop programs with unrolling, with hoisting and strength reduction,
+// and with all three. Unrolling removes tests and jumps; the other two shorten the body.
+void benchmarkLoops() {
+    CodeGenOptions options;
+    LoopOptions none;
+    none.unroll_limit = 0;
+    none.hoist_invariants = false;
+    none.reduce_strength = false;
+    LoopOptions unrolled = none;
+    unrolled.unroll_limit = LoopOptions().unroll_limit;
+    LoopOptions reduced;
+    reduced.unroll_limit = 0;
+    LoopOptions all;
+
+    std::cout << "--- Loop Benchmark (-O1, static / dynamic instructions) ---" << std::endl;
+    std::cout << std::left << std::setw(10) << "program" << std::right << std::setw(14) << "no loop opts"
+              << std::setw(14) << "unrolling" << std::setw(14) << "LICM + SR" << std::setw(14) << "all"
+              << std::setw(10) << "change" << std::endl;
+    for (const BenchmarkProgram& program : loop_programs) {
+        CompiledRun baseline = compileAndRun(program.source, options);
+        CompiledRun runs[] = {
+            compileAndRun(program.source, options, 1, none),
+            compileAndRun(program.source, options, 1, unrolled),
+            compileAndRun(program.source, options, 1, reduced),
+            compileAndRun(program.source, options, 1, all),
+        };
+        std::cout << std::left << std::setw(10) << program.name << std::right;
+        // Temporaries come after the variables, so only the prefix is compared with -O0.
+        bool same = true;
+        for (const CompiledRun& run : runs) {
+            std::cout << std::setw(6) << run.static_instructions << " / " << std::setw(5) << run.dynamic_instructions;
+            same = same && run.memory.compare(0, baseline.memory.size(), baseline.memory) == 0;
+        }
+        double saved = 100.0 * (1.0 - static_cast<double>(runs[3].dynamic_instructions) / runs[0].dynamic_instructions);
+        std::cout << std::setw(9) << std::fixed << std::setprecision(1) << -saved << "%"
+                  << (same ? "" : "  (memory differs!)") << std::endl;
+    }
+}
+
+
+// Modeled cycles of the benchmark and loop programs for each code generation setup,
+// under the default costs and under costs where memory is ten times slower than a
+// register, each as the cycles of a run and the static estimate in brackets.
+void benchmarkCycles() {
+    struct Setup {
+        const char* name;
+        bool register_operands;
+        int optimization_level;
+    };
+    const Setup setups[] = {{"stack", false, 0}, {"register", true, 0}, {"-O1", true, 1}, {"-O2", true, 2}};
+    CycleCosts slow_memory;
+    for (Opcode op : {Opcode::LDA, Opcode::STA, Opcode::PUSH, Opcode::POP}) slow_memory.cycles[static_cast<unsigned>(op)] = 10;
+    const std::pair<const char*, CycleCosts> models[] = {{"default costs", CycleCosts()}, {"slow memory", slow_memory}};
+
+    std::vector<BenchmarkProgram> programs(std::begin(benchmark_programs), std::end(benchmark_programs));
+    programs.insert(programs.end(), std::begin(loop_programs), std::end(loop_programs));
+    double estimate_seconds = 0;
+    size_t estimated = 0;
+    for (const auto& [model, costs] : models) {
+        std::cout << "--- Cycle Benchmark (" << model << ", run cycles (estimate)) ---" << std::endl;
+        std::cout << std::left << std::setw(10) << "program" << std::right;
+        for (const Setup& setup : setups) std::cout << std::setw(20) << setup.name;
+        std::cout << std::endl;
+        for (const BenchmarkProgram& program : programs) {
+            std::cout << std::left << std::setw(10) << program.name << std::right;
+            bool inside = true;
+            for (const Setup& setup : setups) {
+                CodeGenOptions options;
+                options.register_operands = setup.register_operands;
+                int variable_count = 0;
+                std::vector<MachineInstr> instructions =
+                    assemble(compileCode(program.source, options, setup.optimization_level, LoopOptions(), variable_count));
+                CPU cpu;
+                cpu.setCycleCosts(costs);
+                cpu.loadProgram(instructions.data(), instructions.size());
+                cpu.run();
+                auto begin = Clock::now();
+                CycleRange range = estimateCycles(instructions.data(), instructions.size(), costs).program;
+                estimate_seconds += secondsSince(begin);
+                estimated += instructions.size();
+                std::string cell = std::to_string(cpu.cycleCount()) + " (" + range.text() + ")";
+                std::cout << std::setw(20) << cell;
+                inside = inside && cpu.cycleCount() >= range.best && (!range.bounded || cpu.cycleCount() <= range.worst);
+            }
+            std::cout << (inside ? "" : "  (run outside estimate!)") << std::endl;
+        }
+    }
+    std::cout << std::fixed << std::setprecision(1) << "Estimating: " << estimated / estimate_seconds / 1e6
+              << " million instructions per second" << std::endl;
+}
+
+
+// The text assembler CPU::loadProgram used before AsmBuffer: two getline passes, the
+// first collecting label positions and the second splitting each line with a
+// stringstream. Kept here only as the baseline for the emit benchmark.
+namespace legacy {
+
+struct Instruction {
+    std::string opcode;
+    std::string arg1;
+    std::string arg2;
+};
+
+
+size_t parseAssembly(const std::string& assembly_code, std::vector<Instruction>& instructions,
+                     std::map<std::string, uint8_t>& labels) {
+    std::stringstream ss(assembly_code);
+    std::string line;
+    uint8_t line_number = 0;
+    while (std::getline(ss, line)) {
+        size_t comment_pos = line.find(';');
+        if (comment_pos != std::string::npos) line = line.substr(0, comment_pos);
+        line.erase(0, line.find_first_not_of(" \t\r\n"));
+        line.erase(line.find_last_not_of(" \t\r\n") + 1);
+        if (line.empty()) continue;
+        if (line.back() == ':') {
+            labels[line.substr(0, line.length() - 1)] = line_number;
+        } else {
+            line_number++;
+        }
+    }
+
+    ss.clear();
+    ss.seekg(0);
+    while (std::getline(ss, line)) {
+        size_t comment_pos = line.find(';');
+        if (comment_pos != std::string::npos) line = line.substr(0, comment_pos);
+        line.erase(0, line.find_first_not_of(" \t\r\n"));
+        line.erase(line.find_last_not_of(" \t\r\n") + 1);
+        if (line.empty() || line.back() == ':') continue;
+
+        Instruction instr;
+        std::stringstream line_ss(line);
+        line_ss >> instr.opcode;
+        line_ss >> instr.arg1;
+        line_ss >> instr.arg2;
+        instructions.push_back(instr);
+    }
+    return instructions.size();
+}
+
+
+// The string-comparing execute loop CPU::run used before MachineInstr, for the
+// interpreter benchmark.
+struct Machine {
+    uint8_t reg_A = 0;
+    uint8_t reg_B = 0;
+    uint8_t pc = 0;
+    uint8_t sp = 255;
+    bool zero_flag = false;
+    bool carry_flag = false;
+    std::vector<uint8_t> memory = std::vector<uint8_t>(256, 0);
+    int stack_base = 256 - 32;
+
+    uint8_t getValue(const std::string& arg) {
+        if (arg == "A") return reg_A;
+        if (arg == "B") return reg_B;
+        return static_cast<uint8_t>(std::stoi(arg));
+    }
+
+    void execute(const Instruction& instr, const std::map<std::string, uint8_t>& labels) {
+        uint8_t next_pc = pc + 1;
+        if (instr.opcode == "ldi") {
+            uint8_t val = getValue(instr.arg2);
+            if (instr.arg1 == "A") reg_A = val;
+            else if (instr.arg1 == "B") reg_B = val;
+        } else if (instr.opcode == "lda") {
+            reg_A = memory[getValue(instr.arg1)];
+        } else if (instr.opcode == "sta") {
+            memory[getValue(instr.arg1)] = reg_A;
+        } else if (instr.opcode == "mov") {
+            if (instr.arg1 == "B" && instr.arg2 == "A") reg_B = reg_A;
+            else if (instr.arg1 == "A" && instr.arg2 == "B") reg_A = reg_B;
+        } else if (instr.opcode == "add") {
+            uint16_t result = reg_A + reg_B;
+            reg_A = static_cast<uint8_t>(result);
+            carry_flag = (result > 255);
+            zero_flag = (reg_A == 0);
+        } else if (instr.opcode == "sub") {
+            uint16_t result = reg_A - reg_B;
+            reg_A = static_cast<uint8_t>(result);
+            carry_flag = (reg_B > reg_A);
+            zero_flag = (reg_A == 0);
+        } else if (instr.opcode == "cmp") {
+            zero_flag = (reg_A == reg_B);
+            carry_flag = (reg_B > reg_A);
+        } else if (instr.opcode == "jmp") {
+            next_pc = labels.at(instr.arg1);
+        } else if (instr.opcode == "jne") {
+            if (!zero_flag) next_pc = labels.at(instr.arg1);
+        } else if (instr.opcode == "push") {
+            memory[sp] = getValue(instr.arg1);
+            sp--;
+            if (sp < stack_base) throw std::runtime_error("Stack overflow");
+        } else if (instr.opcode == "pop") {
+            sp++;
+            if (sp >= stack_base + 32) throw std::runtime_error("Stack underflow");
+            if (instr.arg1 == "A") reg_A = memory[sp];
+            else if (instr.arg1 == "B") reg_B = memory[sp];
+        }
+        pc = next_pc;
+    }
+
+    uint64_t run(const std::vector<Instruction>& instructions, const std::map<std::string, uint8_t>& labels) {
+        uint64_t executed = 0;
+        while (pc < instructions.size()) {
+            const Instruction& instr = instructions[pc];
+            if (instr.opcode == "hlt") break;
+            execute(instr, labels);
+            executed++;
+        }
+        return executed;
+    }
+};
+
+}
+
+
+// Three nested 8-bit counters, so a program of a few dozen instructions runs for tens
+// of millions of instructions. It uses every opcode except jmp.
+std::string interpreterWorkload(int outer_iterations) {
+    return R"(ldi A 0
+sta 0
+sta 1
+sta 2
+outer:
+inner:
+lda 0
+ldi B 1
+add
+sta 0
+push A
+mov B A
+pop A
+sub
+lda 0
+ldi B 0
+cmp
+jne inner
+lda 1
+ldi B 1
+add
+sta 1
+ldi B 0
+cmp
+jne outer
+lda 2
+ldi B 1
+add
+sta 2
+ldi B )" + std::to_string(outer_iterations) + R"(
+cmp
+jne outer
+hlt
+)";
+}
+
+
+void benchmarkInterpreter() {
+    std::string text = interpreterWorkload(32);
+
+    std::vector<legacy::Instruction> instructions;
+    std::map<std::string, uint8_t> labels;
+    legacy::parseAssembly(text, instructions, labels);
+    legacy::Machine machine;
+    auto start = Clock::now();
+    uint64_t legacy_count = machine.run(instructions, labels);
+    double legacy_seconds = secondsSince(start);
+
+    std::vector<MachineInstr> program = assemble(parseAssembly(text));
+    auto measure = [&](void (CPU::*loop)(), uint64_t& count) {
+        CPU cpu;
+        cpu.loadProgram(program.data(), program.size());
+        auto begin = Clock::now();
+        (cpu.*loop)();
+        count = cpu.instructionCount();
+        return secondsSince(begin);
+    };
+    uint64_t switch_count = 0, threaded_count = 0;
+    double switch_seconds = measure(&CPU::runSwitch, switch_count);
+    double threaded_seconds = measure(&CPU::runThreaded, threaded_count);
+
+    auto report = [](const char* label, uint64_t count, double seconds) {
+        std::cout << std::left << std::setw(30) << label << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(9) << count / seconds / 1e6 << " MIPS" << std::endl;
+    };
+    std::cout << "--- Interpreter Benchmark (" << switch_count << " instructions) ---" << std::endl;
+    report("strings, if/else chain", legacy_count, legacy_seconds);
+    report("MachineInstr, switch", switch_count, switch_seconds);
+    report(CPU::hasThreadedDispatch() ? "MachineInstr, computed goto" : "MachineInstr, switch (no goto)", threaded_count, threaded_seconds);
+    if (legacy_count != switch_count || switch_count != threaded_count) {
+        std::cout << "(instruction counts differ!)" << std::endl;
+    }
+}
+
+
+// The interpreter workload on the threaded loop with and without superinstructions,
+// followed by the sequences a profiled run of it suggests fusing.
+void benchmarkFusion() {
+    std::vector<MachineInstr> program = assemble(parseAssembly(interpreterWorkload(32)));
+    auto measure = [&](bool superinstructions, std::string& state) {
+        CPU cpu;
+        cpu.setSuperinstructions(superinstructions);
+        cpu.loadProgram(program.data(), program.size());
+        auto begin = Clock::now();
+        cpu.runThreaded();
+        double seconds = secondsSince(begin);
+        std::ostringstream out;
+        cpu.printState(out);
+        cpu.printMemory(0, 256, out);
+        state = out.str() + std::to_string(cpu.instructionCount());
+        return std::make_pair(cpu.instructionCount(), seconds);
+    };
+    std::string plain_state, fused_state;
+    auto [count, plain_seconds] = measure(false, plain_state);
+    double fused_seconds = measure(true, fused_state).second;
+
+    std::vector<FusedInstr> decoded = fuseProgram(program.data(), program.size());
+    size_t fused_count = std::count_if(decoded.begin(), decoded.end(), [](const FusedInstr& instr) {
+        return instr.op > OPCODE_COUNT;
+    });
+
+    std::cout << "--- Superinstruction Benchmark (" << count << " instructions, " << fused_count
+              << " fused entries) ---" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "computed goto:                     " << std::setw(9) << count / plain_seconds / 1e6 << " MIPS" << std::endl;
+    std::cout << "computed goto + superinstructions: " << std::setw(9) << count / fused_seconds / 1e6 << " MIPS" << std::endl;
+    if (plain_state != fused_state) std::cout << "(final states differ!)" << std::endl;
+
+    FusionProfile profile;
+    CPU cpu;
+    cpu.loadProgram(program.data(), program.size());
+    cpu.runProfiled(profile);
+    profile.print(std::cout, 8);
+}
+
+
+// Multiplies memory[1] by memory[0] through repeated addition into memory[2], so the
+// running time of an instance depends on its data.
+const char* const batch_workload = R"(
+top:
+lda 0
+ldi B 0
+cmp
+jne body
+hlt
+body:
+ldi B 1
+sub
+sta 0
+lda 1
+mov B A
+lda 2
+add
+sta 2
+jmp top
+)";
+
+
+// Runs the workload once per memory image on separate CPU instances and once on a
+// BatchCPU, with every image running the same number of iterations and with a random
+// count per image, and checks that each lane matches its scalar run.
+void benchmarkBatch() {
+    const size_t lanes = 4096;
+    std::vector<MachineInstr> program = assemble(parseAssembly(batch_workload));
+
+    auto scenario = [&](const char* label, auto iterations) {
+        std::vector<uint8_t> counts(lanes), steps(lanes);
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            counts[lane] = iterations(lane);
+            steps[lane] = static_cast<uint8_t>(lane * 7 + 3);
+        }
+        auto scalarRun = [&](size_t lane, CPU& cpu) {
+            cpu.loadProgram(program.data(), program.size());
+            cpu.setMemory(0, counts[lane]);
+            cpu.setMemory(1, steps[lane]);
+            cpu.run();
+        };
+
+        uint64_t checksum = 0;
+        auto start = Clock::now();
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            CPU cpu;
+            scalarRun(lane, cpu);
+            checksum += cpu.memoryAt(2);
+        }
+        double scalar_seconds = secondsSince(start);
+
+        start = Clock::now();
+        BatchCPU batch(lanes);
+        batch.loadProgram(program.data(), program.size());
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            batch.setMemory(lane, 0, counts[lane]);
+            batch.setMemory(lane, 1, steps[lane]);
+        }
+        batch.run();
+        double batch_seconds = secondsSince(start);
+
+        size_t mismatches = 0;
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            CPU cpu;
+            scalarRun(lane, cpu);
+            std::ostringstream expected, actual;
+            cpu.printState(expected);
+            cpu.printMemory(0, 3, expected);
+            expected << cpu.instructionCount();
+            batch.printState(lane, actual);
+            batch.printMemory(lane, 0, 3, actual);
+            actual << batch.instructionCount(lane);
+            if (expected.str() != actual.str() || !batch.error(lane).empty()) mismatches++;
+            checksum -= batch.memoryAt(lane, 2);
+        }
+
+        std::cout << label << std::endl;
+        std::cout << "  CPU per instance: " << std::setw(12) << static_cast<uint64_t>(lanes / scalar_seconds) << " instances/s" << std::endl;
+        std::cout << "  BatchCPU:         " << std::setw(12) << static_cast<uint64_t>(lanes / batch_seconds) << " instances/s ("
+                  << std::fixed << std::setprecision(1) << scalar_seconds / batch_seconds << "x)" << std::endl;
+        if (mismatches || checksum) std::cout << "  (" << mismatches << " lanes differ from CPU!)" << std::endl;
+    };
+
+    std::cout << "--- Batch Benchmark (" << lanes << " instances, " << BatchCPU::simdName() << ") ---" << std::endl;
+    scenario("uniform (64 iterations each)", [](size_t) { return static_cast<uint8_t>(64); });
+    std::mt19937 random(42);
+    scenario("divergent (0-127 iterations)", [&](size_t) { return static_cast<uint8_t>(random() % 128); });
+}
+
+
+// The interpreter workload on the threaded loop and on the JIT. The first JIT run
+// includes translating the program; the second reuses the translation.
+void benchmarkJit() {
+    std::vector<MachineInstr> program = assemble(parseAssembly(interpreterWorkload(32)));
+    auto measure = [](CPU& cpu, void (CPU::*loop)()) {
+        auto begin = Clock::now();
+        (cpu.*loop)();
+        return secondsSince(begin);
+    };
+
+    CPU interpreter;
+    interpreter.loadProgram(program.data(), program.size());
+    double threaded_seconds = measure(interpreter, &CPU::runThreaded);
+    CPU jit;
+    jit.loadProgram(program.data(), program.size());
+    double first_seconds = measure(jit, &CPU::runJit);
+    double jit_seconds = measure(jit, &CPU::runJit);
+
+    std::ostringstream interpreter_state, jit_state;
+    interpreter.printState(interpreter_state);
+    jit.printState(jit_state);
+    uint64_t count = interpreter.instructionCount();
+
+    auto report = [](const char* label, uint64_t count, double seconds) {
+        std::cout << std::left << std::setw(30) << label << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(9) << count / seconds / 1e6 << " MIPS" << std::endl;
+    };
+    std::cout << "--- JIT Benchmark (" << count << " instructions) ---" << std::endl;
+    if (!CPU::hasJit()) std::cout << "(no JIT on this platform; runJit falls back to the interpreter)" << std::endl;
+    report("interpreter, computed goto", count, threaded_seconds);
+    report("JIT, including translation", count, first_seconds);
+    report("JIT", count, jit_seconds);
+    if (interpreter_state.str() != jit_state.str() || jit.instructionCount() != count) {
+        std::cout << "(final states differ!)" << std::endl;
+    }
+}
+
+
+constexpr int MACHINE_VARIABLES = 1000;
+
+
+// A program with more instructions and variables than the original 256-byte machine
+// could hold: a loop over thousands of statements touching MACHINE_VARIABLES variables,
+// compiled at -O0 for `machine`.
+std::vector<MachineInstr> machineWorkload(const MachineModel& machine) {
+    const int variables = MACHINE_VARIABLES;
+    const int statements = 2000;
+    std::ostringstream out;
+    for (int v = 0; v < variables; ++v) out << "int v" << v << ";\n";
+    out << "int i;\nint j;\nj = 100;\nwhile (j != 0) {\ni = 200;\nwhile (i != 0) {\n";
+    for (int s = 0; s < statements; ++s) {
+        out << "v" << s * 7 % variables << " = v" << (s * 13 + 1) % variables << " + v" << (s * 31 + 2) % variables
+               << " - " << s % 97 << ";\n";
+    }
+    out << "i = i - 1;\n}\nj = j - 1;\n}\n";
+    std::string source = out.str();
+
+    SymbolTable symbols;
+    Lexer lexer(source, symbols);
+    Parser parser(lexer);
+    std::unique_ptr<Program> program = parser.parse();
+    CodeGenOptions options;
+    options.data_limit = static_cast<int>(machine.dataLimit());
+    return assemble(CodeGenerator(symbols, options).generate(*program));
+}
+
+
+// The machine workload on a 4K machine, on the switch loop, the threaded loop and the JIT.
+void benchmarkMachine() {
+    MachineModel machine;
+    machine.memory_size = 4096;
+    std::vector<MachineInstr> code = machineWorkload(machine);
+
+    auto measure = [&](void (CPU::*loop)(), std::string& state) {
+        CPU cpu(machine);
+        cpu.loadProgram(code.data(), code.size());
+        auto begin = Clock::now();
+        (cpu.*loop)();
+        double seconds = secondsSince(begin);
+        std::ostringstream out;
+        cpu.printState(out);
+        cpu.printMemory(0, static_cast<int>(machine.memory_size), out);
+        state = out.str() + std::to_string(cpu.instructionCount());
+        return std::make_pair(cpu.instructionCount(), seconds);
+    };
+    std::string switch_state, threaded_state, jit_state;
+    auto [count, switch_seconds] = measure(&CPU::run, switch_state);
+    double threaded_seconds = measure(&CPU::runThreaded, threaded_state).second;
+    double jit_seconds = measure(&CPU::runJit, jit_state).second;
+
+    auto report = [&](const char* label, double seconds) {
+        std::cout << std::left << std::setw(30) << label << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(9) << count / seconds / 1e6 << " MIPS" << std::endl;
+    };
+    std::cout << "--- Machine Model Benchmark (" << code.size() << " instructions, " << MACHINE_VARIABLES + 2 << " of "
+              << machine.memory_size << " bytes, " << count << " executed) ---" << std::endl;
+    report("interpreter, switch", switch_seconds);
+    report("interpreter, computed goto", threaded_seconds);
+    report(CPU::hasJit() ? "JIT" : "JIT (interpreter fallback)", jit_seconds);
+    if (switch_state != threaded_state || threaded_state != jit_state) {
+        std::cout << "(final states differ!)" << std::endl;
+    }
+}
+
+
+// The interpreter and machine workloads on the threaded loop with runtime checks and,
+// once the verifier has accepted them, without. Also times the verifier itself.
+void benchmarkVerify() {
+    MachineModel machine;
+    machine.memory_size = 4096;
+    struct Workload {
+        const char* name;
+        std::vector<MachineInstr> code;
+    };
+    const Workload workloads[] = {
+        {"interpreter", assemble(parseAssembly(interpreterWorkload(32)))},
+        {"machine", machineWorkload(machine)},
+    };
+
+    std::cout << "--- Verifier Benchmark ---" << std::endl;
+    std::cout << std::left << std::setw(14) << "workload" << std::right << std::setw(8) << "instrs" << std::setw(12)
+              << "verify us" << std::setw(14) << "checked MIPS" << std::setw(16) << "unchecked MIPS" << std::endl;
+    for (const Workload& workload : workloads) {
+        const int iterations = 20;
+        auto begin = Clock::now();
+        ProgramVerification verification;
+        for (int i = 0; i < iterations; ++i) {
+            verification = verifyProgram(workload.code.data(), workload.code.size(), machine);
+        }
+        double verify_seconds = secondsSince(begin) / iterations;
+
+        auto measure = [&](bool verified, std::string& state) {
+            CPU cpu(machine);
+            cpu.setVerifiedExecution(verified);
+            cpu.loadProgram(workload.code.data(), workload.code.size());
+            auto start = Clock::now();
+            cpu.runThreaded();
+            double seconds = secondsSince(start);
+            std::ostringstream out;
+            cpu.printState(out);
+            cpu.printMemory(0, static_cast<int>(machine.memory_size), out);
+            state = out.str() + std::to_string(cpu.instructionCount());
+            return cpu.instructionCount() / seconds / 1e6;
+        };
+        std::string checked_state, unchecked_state;
+        double checked = measure(false, checked_state);
+        double unchecked = measure(true, unchecked_state);
+
+        std::cout << std::left << std::setw(14) << workload.name << std::right << std::setw(8) << workload.code.size()
+                  << std::fixed << std::setprecision(1) << std::setw(12) << verify_seconds * 1e6 << std::setw(14)
+                  << checked << std::setw(16) << unchecked;
+        if (!verification.verified) std::cout << "  (not verified: " << verification.reason << ")";
+        if (checked_state != unchecked_state) std::cout << "  (final states differ!)";
+        std::cout << std::endl;
+    }
+}
+
+
+// Cost of profiling: building the line table for a compiled loop, and running it on the
+// switch loop with and without counting.
+void benchmarkProfile() {
+    const int variables = 100;
+    std::ostringstream out;
+    for (int v = 0; v < variables; ++v) out << "int v" << v << ";\n";
+    out << "int i;\nint j;\nj = 50;\nwhile (j != 0) {\n    i = 200;\n    while (i != 0) {\n";
+    for (int s = 0; s < 200; ++s) {
+        out << "        v" << s * 7 % variables << " = v" << (s * 13 + 1) % variables << " + " << s % 97 << ";\n";
+    }
+    out << "        i = i - 1;\n    }\n    j = j - 1;\n}\n";
+    std::string source = out.str();
+
+    SymbolTable symbols;
+    Lexer lexer(source, symbols);
+    Parser parser(lexer);
+    std::unique_ptr<Program> program = parser.parse();
+    AsmBuffer code = CodeGenerator(symbols).generate(*program);
+    std::vector<MachineInstr> instructions = assemble(code);
+
+    const int iterations = 100;
+    auto begin = Clock::now();
+    std::vector<SourceLocation> line_table;
+    for (int i = 0; i < iterations; ++i) {
+        LineIndex lines(source);
+        line_table = lineTable(code, lines);
+    }
+    double table_seconds = secondsSince(begin) / iterations;
+
+    auto measure = [&](bool counted, std::string& state) {
+        CPU cpu;
+        ExecutionProfile profile;
+        cpu.loadProgram(instructions.data(), instructions.size());
+        auto start = Clock::now();
+        counted ? cpu.runCounted(profile) : cpu.runSwitch();
+        double seconds = secondsSince(start);
+        std::ostringstream result;
+        cpu.printState(result);
+        cpu.printMemory(0, variables, result);
+        state = result.str() + std::to_string(cpu.instructionCount());
+        if (counted && profile.total() != cpu.instructionCount()) state += " (profile total differs)";
+        return cpu.instructionCount() / seconds / 1e6;
+    };
+    std::string plain_state, counted_state;
+    double plain = measure(false, plain_state);
+    double counted = measure(true, counted_state);
+
+    std::cout << "--- Profiler Benchmark ---" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Line table for " << instructions.size() << " instructions: " << table_seconds * 1e6 << " us" << std::endl;
+    std::cout << "Switch loop: " << plain << " MIPS, counting: " << counted << " MIPS ("
+              << (plain / counted - 1) * 100 << "% slower)" << std::endl;
+    if (plain_state != counted_state) std::cout << "Final states differ!" << std::endl;
+}
+
+
+// Compile-to-load latency for a large program: code generation plus whatever it takes
+// to get instructions into the CPU. The CPU is not run, since the program is far
+// larger than its 16-bit program counter can address.
+void benchmarkEmit() {
+    std::string source = generateBenchmarkProgram(20000);
+    SymbolTable symbols;
+    Lexer lexer(source, symbols);
+    Parser parser(lexer);
+    std::unique_ptr<Program> program = parser.parse();
+
+    CodeGenOptions annotated;
+    annotated.annotate = true;
+    const int iterations = 10;
+    size_t checksum = 0;
+
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        std::string text = CodeGenerator(symbols, annotated).generate(*program).toText();
+        std::vector<legacy::Instruction> instructions;
+        std::map<std::string, uint8_t> labels;
+        checksum += legacy::parseAssembly(text, instructions, labels);
+    }
+    double legacy_seconds = secondsSince(start);
+
+    start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        std::string text = CodeGenerator(symbols, annotated).generate(*program).toText();
+        std::vector<MachineInstr> loaded = assemble(parseAssembly(text));
+        checksum -= loaded.size();
+        CPU cpu;
+        cpu.loadProgram(std::move(loaded));
+    }
+    double text_seconds = secondsSince(start);
+
+    size_t instructions = 0;
+    start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        AsmBuffer code = CodeGenerator(symbols).generate(*program);
+        instructions = code.instructionCount();
+        CPU cpu;
+        cpu.loadProgram(assemble(code));
+    }
+    double direct_seconds = secondsSince(start);
+
+    std::cout << "--- Emit Benchmark (" << instructions << " instructions) ---" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "text, two-pass getline parser: " << std::setw(8) << legacy_seconds * 1000 / iterations << " ms" << std::endl;
+    std::cout << "text, parseAssembly:           " << std::setw(8) << text_seconds * 1000 / iterations << " ms" << std::endl;
+    std::cout << "AsmBuffer, assemble:           " << std::setw(8) << direct_seconds * 1000 / iterations << " ms" << std::endl;
+    std::cout << "Speedup: " << legacy_seconds / direct_seconds << "x" << (checksum == 0 ? "" : " (instruction count mismatch!)") << std::endl;
+}
+
+
+// Time to get a compiled 100k-instruction program into the CPU, from assembly text and
+// from a mapped object file.
+void benchmarkObject() {
+    std::string source = generateBenchmarkProgram(17400);
+    SymbolTable symbols;
+    Lexer lexer(source, symbols);
+    Parser parser(lexer);
+    std::unique_ptr<Program> program = parser.parse();
+    CodeGenOptions annotated;
+    annotated.annotate = true;
+    CodeGenerator generator(symbols, annotated);
+    AsmBuffer code = generator.generate(*program);
+    std::string text = code.toText();
+
+    std::string path = (std::filesystem::temp_directory_path() / "simplelang_bench.slo").string();
+    writeObject(path, makeObject(code, generator.variableNames(), false));
+    size_t object_bytes = std::filesystem::file_size(path);
+
+    const int text_iterations = 10;
+    auto start = Clock::now();
+    for (int i = 0; i < text_iterations; ++i) {
+        CPU cpu;
+        cpu.loadProgram(text);
+    }
+    double text_seconds = secondsSince(start) / text_iterations;
+
+    const int object_iterations = 1000;
+    size_t loaded = 0;
+    start = Clock::now();
+    for (int i = 0; i < object_iterations; ++i) {
+        MappedFile file(path);
+        ObjectView object(file.view());
+        CPU cpu;
+        cpu.loadObject(object);
+        loaded = object.instructionCount();
+    }
+    double object_seconds = secondsSince(start) / object_iterations;
+    std::filesystem::remove(path);
+
+    std::cout << "--- Object Benchmark (" << loaded << " instructions) ---" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "assembly text, " << std::setw(8) << text.size() << " bytes: " << std::setw(10) << text_seconds * 1e6 << " us" << std::endl;
+    std::cout << "object file,   " << std::setw(8) << object_bytes << " bytes: " << std::setw(10) << object_seconds * 1e6 << " us" << std::endl;
+}
+
+
+// Batch compilation of a directory of generated files at 1, 2, 4, ... threads up to the
+// hardware thread count, reporting throughput and speedup over one thread.
+void benchmarkParallel() {
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "simplelang_bench_batch";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    const int files = 256;
+    for (int i = 0; i < files; ++i) {
+        std::ofstream out(directory / ("unit_" + std::to_string(i) + ".sl"));
+        out << generateBenchmarkProgram(1000 + (i % 8) * 500);
+    }
+    std::vector<std::string> paths = collectSourceFiles(directory.string());
+
+    auto generate = [](Program& program, SymbolTable& symbols) {
+        optimizeProgram(program, symbols, 1);
+        CodeGenerator generator(symbols);
+        AsmBuffer code = generator.generate(program);
+        PeepholeOptimizer().optimize(code);
+        return makeObject(code, generator.variableNames(), false);
+    };
+
+    unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> counts;
+    for (unsigned threads = 1; threads < hardware; threads *= 2) counts.push_back(threads);
+    counts.push_back(hardware);
+
+    std::cout << "--- Parallel Compile Benchmark (" << paths.size() << " files, " << hardware
+              << " hardware threads) ---" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    double single = 0;
+    for (unsigned threads : counts) {
+        WorkStealingPool pool(threads);
+        size_t instructions = 0;
+        auto start = Clock::now();
+        for (const BatchFileResult& result : compileBatch(paths, BatchOptions(), pool, generate)) {
+            instructions += result.instructions;
+        }
+        double seconds = secondsSince(start);
+        if (threads == 1) single = seconds;
+        std::cout << std::setw(3) << threads << " thread(s): " << std::setw(8) << paths.size() / seconds
+                  << " files/s  " << std::setprecision(2) << single / seconds << "x  (" << instructions
+                  << " instructions)" << std::setprecision(1) << std::endl;
+    }
+    std::filesystem::remove_all(directory);
+}
+
+
+// A cold compile that stores its object against a warm one answered from the cache,
+// where the only work left is hashing the source and mapping the entry.
+void benchmarkCache() {
+    std::string source = generateBenchmarkProgram(20000);
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "simplelang_bench_cache";
+    std::filesystem::remove_all(directory);
+    CompileCache cache(directory.string());
+    const std::string flags = "-O1";
+
+    const int iterations = 10;
+    size_t cold_instructions = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        SymbolTable symbols;
+        Lexer lexer(source, symbols);
+        Parser parser(lexer);
+        std::unique_ptr<Program> program = parser.parse();
+        optimizeProgram(*program, symbols, 1);
+        CodeGenerator generator(symbols);
+        AsmBuffer code = generator.generate(*program);
+        PeepholeOptimizer().optimize(code);
+        std::string object = encodeObject(makeObject(code, generator.variableNames(), false));
+        cache.store(cache.key(source, flags), object);
+        cold_instructions = ObjectView(object).instructionCount();
+    }
+    double cold_seconds = secondsSince(start) / iterations;
+
+    size_t warm_instructions = 0;
+    start = Clock::now();
+    for (int i = 0; i < iterations * 10; ++i) {
+        std::unique_ptr<MappedFile> entry = cache.lookup(cache.key(source, flags));
+        warm_instructions = entry ? ObjectView(entry->view()).instructionCount() : 0;
+    }
+    double warm_seconds = secondsSince(start) / (iterations * 10);
+    std::filesystem::remove_all(directory);
+
+    std::cout << "--- Cache Benchmark (" << source.size() << " bytes, " << cold_instructions << " instructions) ---"
+              << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Miss (compile and store): " << std::setw(9) << cold_seconds * 1000 << " ms" << std::endl;
+    std::cout << "Hit (hash and map):       " << std::setw(9) << warm_seconds * 1000 << " ms"
+              << (warm_instructions == cold_instructions ? "" : " (cached object mismatch!)") << std::endl;
+    std::cout << std::setprecision(1) << "Speedup: " << cold_seconds / warm_seconds << "x" << std::endl;
+}
+
+
+// Rebuilding a program split into modules after editing one of them: recompile that
+// module and relink, against compiling the whole program again.
+void benchmarkLink() {
+    std::string source = generateBenchmarkProgram(8000);
+    const size_t module_count = 32;
+    // The declarations go in the first module; the statements are split at the comment
+    // that starts every fourth one, so no if statement is cut in half.
+    std::vector<std::string> modules;
+    size_t statements = source.find("// statement");
+    modules.push_back(source.substr(0, statements));
+    size_t chunk = (source.size() - statements) / module_count;
+    for (size_t begin = statements; begin < source.size();) {
+        size_t end = source.find("// statement", std::min(source.size(), begin + chunk));
+        if (end == std::string::npos) end = source.size();
+        modules.push_back(source.substr(begin, end - begin));
+        begin = end;
+    }
+
+    auto compileModule = [](const std::string& text) {
+        SymbolTable symbols;
+        Lexer lexer(text, symbols);
+        Parser parser(lexer);
+        std::unique_ptr<Program> program = parser.parse();
+        optimizeProgram(*program, symbols, 1, false);
+        CodeGenOptions options;
+        options.externs = true;
+        CodeGenerator generator(symbols, options);
+        AsmBuffer code = generator.generateModule(*program);
+        PeepholeOptimizer().optimize(code);
+        return encodeObject(makeRelocatableObject(code, generator.variableNames(), generator.externAddresses(), false));
+    };
+
+    std::vector<std::string> objects;
+    for (const std::string& module : modules) objects.push_back(compileModule(module));
+
+    const int iterations = 10;
+    size_t instructions = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        SymbolTable symbols;
+        Lexer lexer(source, symbols);
+        Parser parser(lexer);
+        std::unique_ptr<Program> program = parser.parse();
+        optimizeProgram(*program, symbols, 1);
+        CodeGenerator generator(symbols);
+        AsmBuffer code = generator.generate(*program);
+        PeepholeOptimizer().optimize(code);
+        instructions = makeObject(code, generator.variableNames(), false).instructions.size();
+    }
+    double full_seconds = secondsSince(start) / iterations;
+
+    size_t edited = modules.size() / 2;
+    size_t linked_instructions = 0;
+    double compile_seconds = 0;
+    double link_seconds = 0;
+    for (int i = 0; i < iterations; ++i) {
+        start = Clock::now();
+        objects[edited] = compileModule(modules[edited]);
+        compile_seconds += secondsSince(start);
+
+        start = Clock::now();
+        std::vector<ObjectView> views;
+        views.reserve(objects.size());
+        std::vector<LinkInput> inputs;
+        for (size_t m = 0; m < objects.size(); ++m) {
+            views.emplace_back(objects[m]);
+            inputs.push_back({"module" + std::to_string(m), &views.back()});
+        }
+        linked_instructions = linkObjects(inputs).instructions.size();
+        link_seconds += secondsSince(start);
+    }
+    compile_seconds /= iterations;
+    link_seconds /= iterations;
+
+    std::cout << "--- Link Benchmark (" << modules.size() << " modules, " << linked_instructions << " instructions) ---"
+              << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Whole program:        " << std::setw(8) << full_seconds * 1000 << " ms (" << instructions
+              << " instructions)" << std::endl;
+    std::cout << "One module + relink:  " << std::setw(8) << (compile_seconds + link_seconds) * 1000 << " ms ("
+              << compile_seconds * 1000 << " compile, " << link_seconds * 1000 << " link)" << std::endl;
+    std::cout << std::setprecision(1) << "Speedup: " << full_seconds / (compile_seconds + link_seconds) << "x" << std::endl;
+}
+
+
+void benchmarkIncremental() {
+    std::string source = generateBenchmarkProgram(200000);
+
+    auto start = Clock::now();
+    IncrementalCompiler compiler(source);
+    double full_seconds = secondsSince(start);
+
+    // Rewrite one literal in the middle of the file, alternating between two values.
+    size_t offset = compiler.source().find("= 7", compiler.source().size() / 2) + 2;
+    const int iterations = 200;
+    start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        compiler.update({{offset, 1, (i % 2) ? "7" : "8"}});
+    }
+    double edit_seconds = secondsSince(start) / iterations;
+    const IncrementalStats& stats = compiler.lastStats();
+
+    std::cout << "--- Incremental Benchmark (" << source.size() << " bytes) ---" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Full build:      " << full_seconds * 1000 << " ms" << std::endl;
+    std::cout << "One-line edit:   " << edit_seconds * 1000 << " ms (" << stats.bytes_relexed << " bytes relexed, "
+              << stats.statements_reparsed << " statement(s) reparsed, " << stats.statements_regenerated
+              << " regenerated" << (stats.full_rebuild ? ", full rebuild" : "") << ")" << std::endl;
+}
+
+}
+
+
+std::string generateBenchmarkProgram(size_t statements) {
+    std::ostringstream out;
+    const size_t variables = 16;
+    for (size_t v = 0; v < variables; ++v) {
+        out << "int var_" << v << ";\n";
+    }
+
+    for (size_t i = 0; i < statements; ++i) {
+        size_t target = i % variables;
+        size_t lhs = (i * 7 + 3) % variables;
+        size_t rhs = (i * 13 + 5) % variables;
+        switch (i % 4) {
+            case 0:
+                out << "// statement " << i << " seeds a value\n";
+                out << "var_" << target << " = " << (i % 200) << ";\n";
+                break;
+            case 1:
+                out << "var_" << target << " = var_" << lhs << " + var_" << rhs << ";\n";
+                break;
+            case 2:
+                out << "var_" << target << " = var_" << lhs << " - " << (i % 50) << " + var_" << rhs << ";\n";
+                break;
+            case 3:
+                out << "if (var_" << lhs << " == var_" << rhs << ") {\n";
+                out << "    var_" << target << " = var_" << target << " + 1;\n";
+                out << "}\n";
+                break;
+        }
+    }
+    return out.str();
+}
+
+
+bool runBenchmark(const std::string& name) {
+    if (name == "lexer") {
+        benchmarkLexer();
+        return true;
+    }
+    if (name == "ast") {
+        benchmarkAst();
+        return true;
+    }
+    if (name == "dispatch") {
+        benchmarkDispatch();
+        return true;
+    }
+    if (name == "link") {
+        benchmarkLink();
+        return true;
+    }
+    if (name == "cache") {
+        benchmarkCache();
+        return true;
+    }
+    if (name == "parallel") {
+        benchmarkParallel();
+        return true;
+    }
+    if (name == "incremental") {
+        benchmarkIncremental();
+        return true;
+    }
+    if (name == "codegen") {
+        benchmarkCodegen();
+        return true;
+    }
+    if (name == "cse") {
+        benchmarkCse();
+        return true;
+    }
+    if (name == "loops") {
+        benchmarkLoops();
+        return true;
+    }
+    if (name == "cycles") {
+        benchmarkCycles();
+        return true;
+    }
+    if (name == "peephole") {
+        benchmarkPeephole();
+        return true;
+    }
+    if (name == "interpreter") {
+        benchmarkInterpreter();
+        return true;
+    }
+    if (name == "batch") {
+        benchmarkBatch();
+        return true;
+    }
+    if (name == "fusion") {
+        benchmarkFusion();
+        return true;
+    }
+    if (name == "jit") {
+        benchmarkJit();
+        return true;
+    }
+    if (name == "machine") {
+        benchmarkMachine();
+        return true;
+    }
+    if (name == "verify") {
+        benchmarkVerify();
+        return true;
+    }
+    if (name == "profile") {
+        benchmarkProfile();
+        return true;
+    }
+    if (name == "emit") {
+        benchmarkEmit();
+        return true;
+    }
+    if (name == "object") {
+        benchmarkObject();
+        return true;
+    }
+    return false;
+}
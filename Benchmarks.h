@@ -0,0 +1,16 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+
+#include <cstddef>
+#include <string>
+
+
+// Builds a synthetic SimpleLang program with roughly `statements` top-level statements.
+std::string generateBenchmarkProgram(size_t statements);
+
+// Runs the named benchmark and prints its report. Returns false if the name is unknown.
+bool runBenchmark(const std::string& name);
+
+
+#endif
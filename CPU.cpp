@@ -1,158 +1,531 @@
 #include "CPU.h"
+#include "AsmBuffer.h"
+#include "Jit.h"
 #include <iostream>
-#include <sstream>
 #include <stdexcept>
 
 
-CPU::CPU(int memory_size, int stack_size) : memory(memory_size, 0), stack_base(memory_size - stack_size) {
+// Computed goto is a GNU extension; define CPU_THREADED_DISPATCH=0 to build the
+// switch loop only.
+#ifndef CPU_THREADED_DISPATCH
+#if defined(__GNUC__) || defined(__clang__)
+#define CPU_THREADED_DISPATCH 1
+#else
+#define CPU_THREADED_DISPATCH 0
+#endif
+#endif
+
+
+CPU::CPU(const MachineModel& machine)
+    : model(machine), address_mask(machine.addressMask()), stack_base(machine.dataLimit()) {
+    if (!machine.valid()) {
+        throw std::runtime_error("CPU Error: Memory must be a power of two from 256 to 65536 bytes, with room for the stack");
+    }
+    memory.assign(machine.memory_size, 0);
     reg_A = 0;
     reg_B = 0;
     pc = 0;
-    sp = memory_size - 1; 
+    sp = static_cast<uint16_t>(machine.memory_size - 1);
     zero_flag = false;
     carry_flag = false;
+    instructions_executed = 0;
+    cycles_executed = 0;
+}
+
+
+CPU::~CPU() = default;
+CPU::CPU(CPU&&) noexcept = default;
+CPU& CPU::operator=(CPU&&) noexcept = default;
+
+
+void CPU::loadProgram(std::vector<MachineInstr> program) {
+    owned_instructions = std::move(program);
+    instructions = owned_instructions.data();
+    instruction_count = owned_instructions.size();
+    fused.clear();
+    verification_current = false;
+    jit.reset();
+}
+
+
+void CPU::loadProgram(const MachineInstr* program, size_t count) {
+    owned_instructions.clear();
+    instructions = program;
+    instruction_count = count;
+    fused.clear();
+    verification_current = false;
+    jit.reset();
+}
+
+
+void CPU::loadObject(const ObjectView& object) {
+    loadProgram(object.instructions(), object.instructionCount());
 }
 
 
 void CPU::loadProgram(const std::string& assembly_code) {
-    parse(assembly_code);
+    loadProgram(assemble(parseAssembly(assembly_code)));
 }
 
 
 void CPU::run() {
+#if CPU_THREADED_DISPATCH
+    runThreaded();
+#else
+    runSwitch();
+#endif
+}
+
+
+bool CPU::hasThreadedDispatch() {
+    return CPU_THREADED_DISPATCH;
+}
+
+
+const ProgramVerification& CPU::verification() {
+    if (!verification_current) {
+        program_verification = verifyProgram(instructions, instruction_count, model);
+        verification_current = true;
+    }
+    return program_verification;
+}
+
+
+void CPU::setSuperinstructions(bool enabled) {
+    superinstructions = enabled;
+    fused.clear();
+}
+
+
+void CPU::setCycleCosts(const CycleCosts& costs) {
+    if (!costs.valid()) {
+        throw std::runtime_error("CPU Error: Cycle costs must be at most " + std::to_string(CycleCosts::MAX_CYCLES));
+    }
+    cycle_costs = costs;
+    fused.clear();
+    jit.reset();
+}
+
+
+void CPU::runSwitch() {
     pc = 0;
-    while (pc < instructions.size()) {
+    instructions_executed = 0;
+    cycles_executed = 0;
+    while (pc < instruction_count) {
         const auto& instr = instructions[pc];
-        if (instr.opcode == "hlt") {
+        if (instr.op == Opcode::HLT) {
             break;
         }
         execute(instr);
+        instructions_executed++;
+        cycles_executed += cycle_costs.of(instr.op);
     }
 }
 
 
-void CPU::printMemory(int start, int count) {
-    std::cout << "--- CPU Memory State ---" << std::endl;
-    for (int i = start; i < start + count; ++i) {
-        std::cout << "Address [" << i << "]: " << static_cast<int>(memory[i]) << std::endl;
+void CPU::runProfiled(FusionProfile& profile) {
+    pc = 0;
+    instructions_executed = 0;
+    cycles_executed = 0;
+    while (pc < instruction_count) {
+        const auto& instr = instructions[pc];
+        if (instr.op == Opcode::HLT) {
+            break;
+        }
+        profile.record(pc, instr);
+        execute(instr);
+        instructions_executed++;
+        cycles_executed += cycle_costs.of(instr.op);
     }
 }
 
 
-void CPU::printState() {
-    std::cout << "--- CPU State ---" << std::endl;
-    std::cout << "A: " << static_cast<int>(reg_A) << " B: " << static_cast<int>(reg_B) << std::endl;
-    std::cout << "PC: " << static_cast<int>(pc) << " SP: " << static_cast<int>(sp) << std::endl;
-    std::cout << "Zero: " << zero_flag << " Carry: " << carry_flag << std::endl;
+void CPU::runCounted(ExecutionProfile& profile) {
+    profile.attach(instructions, instruction_count);
+    pc = 0;
+    instructions_executed = 0;
+    cycles_executed = 0;
+    while (pc < instruction_count) {
+        const auto& instr = instructions[pc];
+        if (instr.op == Opcode::HLT) {
+            break;
+        }
+        profile.record(pc);
+        execute(instr);
+        instructions_executed++;
+        cycles_executed += cycle_costs.of(instr.op);
+    }
 }
 
 
+void CPU::runJit() {
+    if (!JitProgram::isSupported()) {
+        run();
+        return;
+    }
+    if (!jit) jit = std::make_unique<JitProgram>(instructions, instruction_count, model, cycle_costs);
 
-
-uint8_t CPU::getValue(const std::string& arg) {
-    if (arg == "A") return reg_A;
-    if (arg == "B") return reg_B;
-    
-    return static_cast<uint8_t>(std::stoi(arg));
+    JitState state{memory.data(), 0, 0, 0, sp, reg_A, reg_B, zero_flag, carry_flag};
+    JitExit exit = jit->run(state);
+    reg_A = state.reg_A;
+    reg_B = state.reg_B;
+    pc = static_cast<uint16_t>(state.pc);
+    sp = static_cast<uint16_t>(state.sp);
+    zero_flag = state.zero_flag;
+    carry_flag = state.carry_flag;
+    instructions_executed = state.executed;
+    cycles_executed = state.cycles;
+    if (exit == JitExit::STACK_OVERFLOW) throw std::runtime_error("Stack overflow");
+    if (exit == JitExit::STACK_UNDERFLOW) throw std::runtime_error("Stack underflow");
 }
 
 
-void CPU::execute(const Instruction& instr) {
-    uint8_t next_pc = pc + 1;
+bool CPU::hasJit() {
+    return JitProgram::isSupported();
+}
 
 
-   
-    if (instr.opcode == "ldi") { 
-        uint8_t val = getValue(instr.arg2);
-        if (instr.arg1 == "A") reg_A = val;
-        else if (instr.arg1 == "B") reg_B = val;
-    } else if (instr.opcode == "lda") { 
-        reg_A = memory[getValue(instr.arg1)];
-    } else if (instr.opcode == "sta") { 
-        memory[getValue(instr.arg1)] = reg_A;
-    } else if (instr.opcode == "mov") {
-        if(instr.arg1 == "B" && instr.arg2 == "A") reg_B = reg_A;
-        else if(instr.arg1 == "A" && instr.arg2 == "B") reg_A = reg_B;
+void CPU::printMemory(int start, int count, std::ostream& out) {
+    out << "--- CPU Memory State ---" << std::endl;
+    for (int i = start; i < start + count; ++i) {
+        out << "Address [" << i << "]: " << static_cast<int>(memory[i]) << std::endl;
     }
-    
-    else if (instr.opcode == "add") {
-        uint16_t result = reg_A + reg_B;
-        reg_A = static_cast<uint8_t>(result);
-        carry_flag = (result > 255);
-        zero_flag = (reg_A == 0);
-    } else if (instr.opcode == "sub") {
-        uint16_t result = reg_A - reg_B;
-        reg_A = static_cast<uint8_t>(result);
-        carry_flag = (reg_B > reg_A);
-        zero_flag = (reg_A == 0);
-    } else if (instr.opcode == "cmp") {
-        uint8_t val_a = reg_A;
-        uint8_t val_b = reg_B;
-        zero_flag = (val_a == val_b);
-        carry_flag = (val_b > val_a);
+}
+
+
+void CPU::printState(std::ostream& out) {
+    out << "--- CPU State ---" << std::endl;
+    out << "A: " << static_cast<int>(reg_A) << " B: " << static_cast<int>(reg_B) << std::endl;
+    out << "PC: " << static_cast<int>(pc) << " SP: " << static_cast<int>(sp) << std::endl;
+    out << "Zero: " << zero_flag << " Carry: " << carry_flag << std::endl;
+}
+
+
+
+
+void CPU::execute(const MachineInstr& instr) {
+    uint16_t next_pc = pc + 1;
+
+
+    switch (instr.op) {
+        case Opcode::LDI:
+            reg(instr.reg) = static_cast<uint8_t>(instr.operand);
+            break;
+        case Opcode::LDA:
+            reg_A = memory[instr.operand & address_mask];
+            break;
+        case Opcode::STA:
+            memory[instr.operand & address_mask] = reg_A;
+            break;
+        case Opcode::MOV:
+            reg(instr.reg) = reg(static_cast<Reg>(instr.operand));
+            break;
+
+        case Opcode::ADD: {
+            uint16_t result = reg_A + reg_B;
+            reg_A = static_cast<uint8_t>(result);
+            carry_flag = (result > 255);
+            zero_flag = (reg_A == 0);
+            break;
+        }
+        case Opcode::SUB: {
+            uint16_t result = reg_A - reg_B;
+            reg_A = static_cast<uint8_t>(result);
+            carry_flag = (reg_B > reg_A);
+            zero_flag = (reg_A == 0);
+            break;
+        }
+        case Opcode::CMP:
+            zero_flag = (reg_A == reg_B);
+            carry_flag = (reg_B > reg_A);
+            break;
+
+        case Opcode::JMP:
+            next_pc = instr.operand;
+            break;
+        case Opcode::JNE:
+            if (!zero_flag) {
+                next_pc = instr.operand;
+            }
+            break;
+
+        case Opcode::PUSH:
+            memory[sp] = reg(instr.reg);
+            sp--;
+            if (sp < stack_base) throw std::runtime_error("Stack overflow");
+            break;
+        // Popping with nothing on the stack faults before sp moves past the top of memory.
+        case Opcode::POP:
+            if (sp + 1u >= model.memory_size) throw std::runtime_error("Stack underflow");
+            sp++;
+            reg(instr.reg) = memory[sp];
+            break;
+        case Opcode::HLT:
+            break;
     }
-    
-    else if (instr.opcode == "jmp") {
-        next_pc = labels.at(instr.arg1);
-    } else if (instr.opcode == "jne") { 
-        if (!zero_flag) {
-            next_pc = labels.at(instr.arg1);
+
+    pc = next_pc;
+}
+
+
+// Each handler ends in its own indirect jump to the next handler, so the branch
+// predictor sees one dispatch site per opcode instead of a single shared switch. CPU
+// state lives in locals for the duration of the run and is written back on exit.
+// Dispatch goes through the decoded stream from fuseProgram(), whose superinstructions
+// run a whole sequence in one handler and leave exactly the state the individual
+// instructions would, including on a stack fault part-way through.
+void CPU::runThreaded() {
+#if CPU_THREADED_DISPATCH
+    // Cycles are counted where control lands, and running off the last addressable
+    // instruction back to 0 is not a landing the loop sees.
+    if (instruction_count >= MAX_PROGRAM_SIZE) {
+        Opcode last = instructions[MAX_PROGRAM_SIZE - 1].op;
+        if (last != Opcode::JMP && last != Opcode::HLT) {
+            runSwitch();
+            return;
         }
     }
-    
-    else if (instr.opcode == "push") {
-        memory[sp] = getValue(instr.arg1);
-        sp--;
-        if (sp < stack_base) throw std::runtime_error("Stack overflow");
-    } else if (instr.opcode == "pop") {
-        sp++;
-        if (sp >= stack_base + 32) throw std::runtime_error("Stack underflow");
-        if (instr.arg1 == "A") reg_A = memory[sp];
-        else if (instr.arg1 == "B") reg_B = memory[sp];
+    if (fused.empty()) fused = fuseProgram(instructions, instruction_count, superinstructions, cycle_costs);
+    // The verifier's depths are relative to the stack on entry, which a previous run
+    // may have left partly used.
+    if (verified_execution && verification().verified && sp >= stack_base + program_verification.max_stack_depth) {
+        threadedLoop<false>();
+    } else {
+        threadedLoop<true>();
     }
-   
-    pc = next_pc;
+#else
+    runSwitch();
+#endif
 }
 
 
+// The threaded loop itself. With `checked` false it trusts the verifier: dispatch does
+// not test for leaving the program, memory operands are not masked and push and pop do
+// not test the stack bounds.
+#if CPU_THREADED_DISPATCH
+template <bool checked>
+void CPU::threadedLoop() {
+    static const void* const handlers[FUSED_OP_END] = {
+        &&op_ldi, &&op_lda, &&op_sta, &&op_mov, &&op_add, &&op_sub,
+        &&op_cmp, &&op_jmp, &&op_jne, &&op_push, &&op_pop, &&op_hlt,
+        &&op_invalid,
+        &&op_add_immediate, &&op_sub_immediate, &&op_load_add, &&op_load_sub,
+        &&op_stack_add, &&op_stack_sub, &&op_increment, &&op_cmp_jne,
+        &&op_cmp_immediate_jne
+    };
 
-void CPU::parse(const std::string& assembly_code) {
-    std::stringstream ss(assembly_code);
-    std::string line;
-    uint8_t line_number = 0;
-   
-   
-    while (std::getline(ss, line)) {
-        size_t comment_pos = line.find(';');
-        if (comment_pos != std::string::npos) line = line.substr(0, comment_pos);
-        line.erase(0, line.find_first_not_of(" \t\r\n"));
-        line.erase(line.find_last_not_of(" \t\r\n") + 1);
-        if (line.empty()) continue;
+    const MachineInstr* code = instructions;
+    const FusedInstr* decoded = fused.data();
+    const size_t count = instruction_count;
+    uint8_t* data = memory.data();
+    const uint16_t mask = address_mask;
+    const uint32_t stack_top = model.memory_size - 1;
+    const CycleCosts& costs = cycle_costs;
+    uint8_t a = reg_A;
+    uint8_t b = reg_B;
+    uint16_t local_pc = 0;
+    uint16_t local_sp = sp;
+    bool zero = zero_flag;
+    bool carry = carry_flag;
+    uint64_t executed = 0;
+    uint64_t cycles = 0;
+    const MachineInstr* instr = nullptr;
+    const FusedInstr* super = nullptr;
 
+    auto writeBack = [&] {
+        reg_A = a;
+        reg_B = b;
+        pc = local_pc;
+        sp = local_sp;
+        zero_flag = zero;
+        carry_flag = carry;
+        instructions_executed = executed;
+        cycles_executed = cycles;
+    };
 
-        if (line.back() == ':') {
-            std::string label = line.substr(0, line.length() - 1);
-            labels[label] = line_number;
-        } else {
-            line_number++;
-        }
+#define DISPATCH()                                                              \
+    do {                                                                        \
+        if (checked && local_pc >= count) goto done;                            \
+        instr = &code[local_pc];                                                \
+        super = &decoded[local_pc];                                             \
+        goto *handlers[super->op];                                              \
+    } while (0)
+#define NEXT()                                                                  \
+    do {                                                                        \
+        local_pc++;                                                             \
+        executed++;                                                             \
+        DISPATCH();                                                             \
+    } while (0)
+#define NEXT_FUSED(length)                                                      \
+    do {                                                                        \
+        local_pc += (length);                                                   \
+        executed += (length);                                                   \
+        DISPATCH();                                                             \
+    } while (0)
+// Where control lands after a jump or at the start, the whole straight run from there
+// is counted at once.
+#define LAND()                                                                  \
+    do {                                                                        \
+        if (checked && local_pc >= count) goto done;                            \
+        instr = &code[local_pc];                                                \
+        super = &decoded[local_pc];                                             \
+        cycles += super->cycles;                                                \
+        goto *handlers[super->op];                                              \
+    } while (0)
+#define LAND_AFTER(length)                                                      \
+    do {                                                                        \
+        local_pc += (length);                                                   \
+        executed += (length);                                                   \
+        LAND();                                                                 \
+    } while (0)
+#define FAULT(offset, message)                                                  \
+    do {                                                                        \
+        cycles -= super->cycles;                                                \
+        for (size_t k = 0; k != (offset); ++k) {                                \
+            cycles += costs.of(instr[k].op);                                    \
+        }                                                                       \
+        local_pc += (offset);                                                   \
+        executed += (offset);                                                   \
+        writeBack();                                                            \
+        throw std::runtime_error(message);                                      \
+    } while (0)
+#define REGISTER(r) ((r) == Reg::A ? a : b)
+#define ADDRESS(operand) (checked ? (operand) & mask : (operand))
+#define ADD_FLAGS()                                                             \
+    do {                                                                        \
+        uint16_t result = a + b;                                                \
+        a = static_cast<uint8_t>(result);                                       \
+        carry = result > 255;                                                   \
+        zero = a == 0;                                                          \
+    } while (0)
+#define SUB_FLAGS()                                                             \
+    do {                                                                        \
+        a = static_cast<uint8_t>(a - b);                                        \
+        carry = b > a;                                                          \
+        zero = a == 0;                                                          \
+    } while (0)
+
+    LAND();
+
+op_ldi:
+    REGISTER(instr->reg) = static_cast<uint8_t>(instr->operand);
+    NEXT();
+op_lda:
+    a = data[ADDRESS(instr->operand)];
+    NEXT();
+op_sta:
+    data[ADDRESS(instr->operand)] = a;
+    NEXT();
+op_mov:
+    REGISTER(instr->reg) = REGISTER(static_cast<Reg>(instr->operand));
+    NEXT();
+op_add:
+    ADD_FLAGS();
+    NEXT();
+op_sub:
+    SUB_FLAGS();
+    NEXT();
+op_cmp:
+    zero = a == b;
+    carry = b > a;
+    NEXT();
+op_jmp:
+    local_pc = instr->operand;
+    executed++;
+    LAND();
+op_jne:
+    if (!zero) {
+        local_pc = instr->operand;
+        executed++;
+        LAND();
     }
-   
-    ss.clear();
-    ss.seekg(0);
-    while (std::getline(ss, line)) {
-        size_t comment_pos = line.find(';');
-        if (comment_pos != std::string::npos) line = line.substr(0, comment_pos);
-        line.erase(0, line.find_first_not_of(" \t\r\n"));
-        line.erase(line.find_last_not_of(" \t\r\n") + 1);
-        if (line.empty() || line.back() == ':') continue;
-
-
-        Instruction instr;
-        std::stringstream line_ss(line);
-        line_ss >> instr.opcode;
-        line_ss >> instr.arg1;
-        line_ss >> instr.arg2;
-        instructions.push_back(instr);
+    LAND_AFTER(1);
+op_push:
+    data[local_sp] = REGISTER(instr->reg);
+    local_sp--;
+    if (checked && local_sp < stack_base) FAULT(0, "Stack overflow");
+    NEXT();
+op_pop:
+    if (checked && local_sp >= stack_top) FAULT(0, "Stack underflow");
+    local_sp++;
+    REGISTER(instr->reg) = data[local_sp];
+    NEXT();
+op_invalid:
+    NEXT();
+
+op_add_immediate:
+    b = static_cast<uint8_t>(super->x);
+    ADD_FLAGS();
+    NEXT_FUSED(2);
+op_sub_immediate:
+    b = static_cast<uint8_t>(super->x);
+    SUB_FLAGS();
+    NEXT_FUSED(2);
+op_load_add:
+    b = data[ADDRESS(super->x)];
+    a = data[ADDRESS(super->y)];
+    ADD_FLAGS();
+    NEXT_FUSED(4);
+op_load_sub:
+    b = data[ADDRESS(super->x)];
+    a = data[ADDRESS(super->y)];
+    SUB_FLAGS();
+    NEXT_FUSED(4);
+op_stack_add:
+op_stack_sub:
+    data[local_sp] = a;
+    local_sp--;
+    if (checked && local_sp < stack_base) FAULT(0, "Stack overflow");
+    a = data[ADDRESS(super->x)];
+    b = a;
+    if (checked && local_sp >= stack_top) FAULT(3, "Stack underflow");
+    local_sp++;
+    a = data[local_sp];
+    if (super->op == static_cast<uint8_t>(FusedOp::STACK_ADD)) {
+        ADD_FLAGS();
+    } else {
+        SUB_FLAGS();
+    }
+    NEXT_FUSED(5);
+op_increment:
+    a = data[ADDRESS(super->x)];
+    b = static_cast<uint8_t>(super->y);
+    ADD_FLAGS();
+    data[ADDRESS(super->z)] = a;
+    NEXT_FUSED(4);
+op_cmp_jne:
+    zero = a == b;
+    carry = b > a;
+    if (!zero) {
+        local_pc = super->x;
+        executed += 2;
+        LAND();
+    }
+    LAND_AFTER(2);
+op_cmp_immediate_jne:
+    b = static_cast<uint8_t>(super->x);
+    zero = a == b;
+    carry = b > a;
+    if (!zero) {
+        local_pc = super->y;
+        executed += 3;
+        LAND();
     }
+    LAND_AFTER(3);
+
+op_hlt:
+done:
+    writeBack();
+
+#undef SUB_FLAGS
+#undef ADD_FLAGS
+#undef ADDRESS
+#undef REGISTER
+#undef FAULT
+#undef LAND_AFTER
+#undef LAND
+#undef NEXT_FUSED
+#undef NEXT
+#undef DISPATCH
 }
+#endif
@@ -2,56 +2,116 @@
 #define CPU_H
 
 
+#include "Fusion.h"
+#include "Isa.h"
+#include "ObjectFile.h"
+#include "Profiler.h"
+#include "Verifier.h"
+#include <cstddef>
+#include <iostream>
+#include <memory>
 #include <vector>
 #include <string>
-#include <map>
-#include <cstdint> 
+#include <cstdint>
 
 
-
-struct Instruction {
-    std::string opcode;
-    std::string arg1;
-    std::string arg2;
-};
+class JitProgram;
 
 
+// Interpreter for the CPU in Isa.h. The program counter and stack pointer are 16 bits;
+// memory and the stack are sized by the MachineModel.
 class CPU {
 public:
-    CPU(int memory_size = 256, int stack_size = 32);
+    explicit CPU(const MachineModel& machine = MachineModel());
+    ~CPU();
+    CPU(CPU&&) noexcept;
+    CPU& operator=(CPU&&) noexcept;
+    // Takes an assembled program; see assemble() in AsmBuffer.h.
+    void loadProgram(std::vector<MachineInstr> program);
+    // Runs the instructions where they are, e.g. in a mapped object file. They must
+    // stay valid for as long as the CPU uses them.
+    void loadProgram(const MachineInstr* program, size_t count);
+    void loadObject(const ObjectView& object);
+    // Assembles text in the --emit=asm format and loads it.
     void loadProgram(const std::string& assembly_code);
+    // Uses the threaded loop where the compiler supports computed goto, otherwise the
+    // switch loop. Both give identical results.
     void run();
-    void printMemory(int start, int count);
-    void printState();
+    // The plain loop over execute(), one dispatch per instruction.
+    void runSwitch();
+    // Also executes the superinstructions from Fusion.h, unless turned off. A program
+    // verifyProgram() accepted runs without pc, address or stack checks when enough of
+    // the stack is free, again unless turned off.
+    void runThreaded();
+    static bool hasThreadedDispatch();
+    void setSuperinstructions(bool enabled);
+    void setVerifiedExecution(bool enabled) { verified_execution = enabled; }
+    // The result of verifying the loaded program against this CPU's machine model. The
+    // verifier runs on the first call or threaded run after a load.
+    const ProgramVerification& verification();
+    // runSwitch() that also feeds every executed instruction to `profile`.
+    void runProfiled(FusionProfile& profile);
+    // runSwitch() that counts every executed instruction in `profile`.
+    void runCounted(ExecutionProfile& profile);
+    // Translates the program to native code on first use (see Jit.h) and runs that.
+    // Falls back to run() where there is no JIT; results are identical either way.
+    void runJit();
+    static bool hasJit();
+    void setMemory(int address, uint8_t value) { memory.at(address) = value; }
+    uint8_t memoryAt(int address) const { return memory.at(address); }
+    void printMemory(int start, int count, std::ostream& out = std::cout);
+    void printState(std::ostream& out = std::cout);
+    const MachineModel& machine() const { return model; }
+    // Instructions executed by the last run(), not counting the final hlt.
+    uint64_t instructionCount() const { return instructions_executed; }
+    // Cycles those instructions take under the cycle costs, which every run method
+    // including runJit() keeps.
+    uint64_t cycleCount() const { return cycles_executed; }
+    void setCycleCosts(const CycleCosts& costs);
+    const CycleCosts& cycleCosts() const { return cycle_costs; }
 
 
 private:
-    
+
     uint8_t reg_A;
     uint8_t reg_B;
-    uint8_t pc;         
-    uint8_t sp;         
+    uint16_t pc;
+    uint16_t sp;
+
 
 
-    
     bool zero_flag;
     bool carry_flag;
+    uint64_t instructions_executed;
+    uint64_t cycles_executed;
 
 
-    
+
+    MachineModel model;
     std::vector<uint8_t> memory;
-    int stack_base;
+    uint16_t address_mask;
+    uint32_t stack_base;
+
+
 
+    std::vector<MachineInstr> owned_instructions;
+    const MachineInstr* instructions = nullptr;
+    size_t instruction_count = 0;
+    // Decoded on the first runThreaded() after a load, so loading a mapped object copies
+    // nothing.
+    std::vector<FusedInstr> fused;
+    bool superinstructions = true;
+    CycleCosts cycle_costs;
+    ProgramVerification program_verification;
+    bool verification_current = false;
+    bool verified_execution = true;
+    std::unique_ptr<JitProgram> jit;
 
-    
-    std::vector<Instruction> instructions;
-    std::map<std::string, uint8_t> labels;
 
 
-    
-    void parse(const std::string& assembly_code);
-    uint8_t getValue(const std::string& arg);
-    void execute(const Instruction& instr);
+    uint8_t& reg(Reg r) { return r == Reg::A ? reg_A : reg_B; }
+    void execute(const MachineInstr& instr);
+    template <bool checked> void threadedLoop();
 };
 
 
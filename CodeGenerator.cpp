@@ -2,124 +2,280 @@
 #include <stdexcept>
 
 
-std::string CodeGenerator::generate(const Program& program) {
-    for (const auto& stmt : program.statements) {
-        visit(stmt.get());
+static bool isLeaf(const Expression* expr) {
+    return expr->kind != NodeKind::BINARY_OP;
+}
+
+
+CodeGenerator::CodeGenerator(const SymbolTable& symbols, CodeGenOptions options) : symbols(symbols), options(options) {}
+
+
+AsmBuffer CodeGenerator::generate(const Program& program) {
+    AsmBuffer module = generateModule(program);
+    module.setSource(AsmItem::NONE);
+    module.emit(Opcode::HLT);
+    return module;
+}
+
+
+AsmBuffer CodeGenerator::generateModule(const Program& program) {
+    variable_addresses.resize(symbols.size(), -1);
+    code = AsmBuffer(options.annotate);
+    temporary_index.assign(symbols.size(), -1);
+    temporary_uses.clear();
+    for (uint32_t i = 0; i < program.temporaries.count; ++i) {
+        temporary_index[program.temporaries[i]->symbol] = static_cast<int>(i);
     }
-    assembly_code << "hlt\n"; 
-    return assembly_code.str();
+    visit(&program);
+    placeTemporaries(program);
+    return std::move(code);
 }
 
 
 
-void CodeGenerator::visit(const Statement* stmt) {
-    if (auto s = dynamic_cast<const VarDecl*>(stmt)) return visit(s);
-    if (auto s = dynamic_cast<const Assignment*>(stmt)) return visit(s);
-    if (auto s = dynamic_cast<const IfStatement*>(stmt)) return visit(s);
-    if (auto s = dynamic_cast<const BlockStatement*>(stmt)) return visit(s);
-    throw std::runtime_error("CodeGenerator Error: Unknown statement type");
+AsmBuffer CodeGenerator::generateFragment(const Statement* stmt, bool reuse) {
+    variable_addresses.resize(symbols.size(), -1);
+    reuse_addresses = reuse;
+    code = AsmBuffer(options.annotate);
+    visit(stmt);
+    return std::move(code);
+}
+
+
+std::vector<std::string> CodeGenerator::variableNames() const {
+    std::vector<std::string> names;
+    names.reserve(address_owners.size());
+    for (SymbolId symbol : address_owners) names.emplace_back(symbols.name(symbol));
+    return names;
+}
+
+
+void CodeGenerator::visit(const Program* program) {
+    for (const Statement* stmt : program->statements) {
+        visit(stmt);
+    }
 }
 
 
 void CodeGenerator::visit(const VarDecl* stmt) {
-    variable_addresses[stmt->varName] = next_address++;
-    assembly_code << "; Variable '" << stmt->varName << "' allocated at address " << variable_addresses[stmt->varName] << "\n";
+    if (!reuse_addresses || variable_addresses[stmt->symbol] < 0) allocate(stmt->symbol, false);
+    if (code.keepsComments()) {
+        code.comment("Variable '" + std::string(symbols.name(stmt->symbol)) + "' allocated at address " + std::to_string(variable_addresses[stmt->symbol]));
+    }
 }
 
 
 void CodeGenerator::visit(const Assignment* stmt) {
-    visit(stmt->value.get());
+    visit(stmt->value);
    
-    int address = variable_addresses.at(stmt->varName);
-    assembly_code << "sta " << address << " ; " << stmt->varName << " = A\n";
+    emitMemory(Opcode::STA, stmt->symbol);
+    if (code.keepsComments()) code.annotate(std::string(symbols.name(stmt->symbol)) + " = A");
 }
 
 
 void CodeGenerator::visit(const IfStatement* stmt) {
-    std::string end_if_label = newLabel();
+    LabelId end_if_label = code.newLabel();
+    const BinaryOp* condition = comparison(stmt->condition, "If");
+
+    emitCompare(condition);
+    if (condition->op == BinaryOperator::EQUAL) {
+        code.emitJump(Opcode::JNE, end_if_label);
+        code.annotate("Jump if not equal");
+        visit(stmt->body);
+    } else {
+        LabelId body_label = code.newLabel();
+        code.emitJump(Opcode::JNE, body_label);
+        code.annotate("Enter if not equal");
+        code.emitJump(Opcode::JMP, end_if_label);
+        code.bind(body_label);
+        visit(stmt->body);
+    }
 
+    code.bind(end_if_label);
+}
 
-    auto condition = dynamic_cast<const BinaryOp*>(stmt->condition.get());
-    if (!condition || condition->op != "==") {
-        throw std::runtime_error("CodeGenerator Error: If condition must be an equality '==' check");
+
+// A `!=` loop is entered at its test, which sits below the body, so each iteration
+// takes just the one backward jne. A `==` loop tests at the top and jumps back with jmp.
+void CodeGenerator::visit(const WhileStatement* stmt) {
+    const BinaryOp* condition = comparison(stmt->condition, "While");
+    LabelId test_label = code.newLabel();
+    LabelId body_label = code.newLabel();
+
+    if (condition->op == BinaryOperator::NOT_EQUAL) {
+        code.emitJump(Opcode::JMP, test_label);
+        code.bind(body_label);
+        visit(stmt->body);
+        code.bind(test_label);
+        code.setSource(stmt->offset);
+        emitCompare(condition);
+        code.emitJump(Opcode::JNE, body_label);
+        code.annotate("Loop while not equal");
+        return;
     }
 
+    LabelId end_label = code.newLabel();
+    code.bind(test_label);
+    emitCompare(condition);
+    code.emitJump(Opcode::JNE, end_label);
+    code.annotate("Leave loop if not equal");
+    visit(stmt->body);
+    code.setSource(stmt->offset);
+    code.emitJump(Opcode::JMP, test_label);
+    code.bind(end_label);
+}
 
-    
-    visit(condition->left.get());   
-    assembly_code << "push A\n";          
-    visit(condition->right.get());  
-    assembly_code << "pop B\n";           
-   
-   
-    assembly_code.str(""); 
-    visit(condition->left.get()); 
-    assembly_code << "push A\n";
-    visit(condition->right.get()); 
-    assembly_code << "mov B A\n"; 
-    assembly_code << "pop A\n"; 
-   
-    assembly_code << "cmp\n"; 
+
+void CodeGenerator::visit(const BlockStatement* stmt) {
+    for (const Statement* statement : stmt->statements) {
+        visit(statement);
+    }
+}
 
 
-    assembly_code << "jne " << end_if_label << " ; Jump if not equal\n";
-   
-    visit(stmt->body.get());
 
 
-    assembly_code << end_if_label << ":\n";
+void CodeGenerator::visit(const NumberLiteral* expr) {
+    code.emit(Opcode::LDI, Reg::A, static_cast<uint16_t>(expr->value));
 }
 
 
-void CodeGenerator::visit(const BlockStatement* stmt) {
-    for (const auto& statement : stmt->statements) {
-        visit(statement.get());
+void CodeGenerator::visit(const Identifier* expr) {
+    emitMemory(Opcode::LDA, expr->symbol);
+}
+
+
+void CodeGenerator::visit(const BinaryOp* expr) {
+    emitOperands(expr);
+    switch (expr->op) {
+        case BinaryOperator::ADD:
+            code.emit(Opcode::ADD);
+            break;
+        case BinaryOperator::SUBTRACT:
+            code.emit(Opcode::SUB);
+            break;
+        case BinaryOperator::EQUAL:
+        case BinaryOperator::NOT_EQUAL:
+            break;
     }
 }
 
 
+const BinaryOp* CodeGenerator::comparison(const Expression* condition, const char* statement) const {
+    auto compare = static_cast<const BinaryOp*>(condition);
+    if (condition->kind != NodeKind::BINARY_OP ||
+        (compare->op != BinaryOperator::EQUAL && compare->op != BinaryOperator::NOT_EQUAL)) {
+        throw std::runtime_error(std::string("CodeGenerator Error: ") + statement +
+                                 " condition must be an '==' or '!=' comparison");
+    }
+    return compare;
+}
 
 
-void CodeGenerator::visit(const Expression* expr) {
-    if (auto e = dynamic_cast<const NumberLiteral*>(expr)) return visit(e);
-    if (auto e = dynamic_cast<const Identifier*>(expr)) return visit(e);
-    if (auto e = dynamic_cast<const BinaryOp*>(expr)) return visit(e);
-    throw std::runtime_error("CodeGenerator Error: Unknown expression type");
+void CodeGenerator::emitCompare(const BinaryOp* condition) {
+    emitOperands(condition, true);
+    code.emit(Opcode::CMP);
 }
 
 
-void CodeGenerator::visit(const NumberLiteral* expr) {
-    assembly_code << "ldi A " << expr->value << "\n";
+// Leaves the left operand in A and the right operand in B. Only leaves can be loaded
+// without disturbing B, so a subtree that needs B is evaluated first and the stack is
+// used only when both sides need it. The operands may end up swapped for `+`, and for
+// a comparison whose only use is the zero flag of cmp (`flags_only`). As a value, `==`
+// and `!=` leave the left operand in A, so they are not swapped then.
+void CodeGenerator::emitOperands(const BinaryOp* expr, bool flags_only) {
+    if (!options.register_operands) {
+        emitStackOperands(expr);
+        return;
+    }
+
+    const Expression* left = expr->left;
+    const Expression* right = expr->right;
+    bool commutative = expr->op == BinaryOperator::ADD || flags_only;
+
+    if (right->kind == NodeKind::NUMBER_LITERAL) {
+        visit(left);
+        code.emit(Opcode::LDI, Reg::B, static_cast<uint16_t>(static_cast<const NumberLiteral*>(right)->value));
+    } else if (isLeaf(right)) {
+        if (isLeaf(left)) {
+            visit(right);
+            code.emit(Opcode::MOV, Reg::B, static_cast<uint16_t>(Reg::A));
+            visit(left);
+        } else if (commutative) {
+            visit(left);
+            code.emit(Opcode::MOV, Reg::B, static_cast<uint16_t>(Reg::A));
+            visit(right);
+        } else {
+            emitStackOperands(expr);
+        }
+    } else if (isLeaf(left)) {
+        visit(right);
+        code.emit(Opcode::MOV, Reg::B, static_cast<uint16_t>(Reg::A));
+        visit(left);
+    } else {
+        visit(right);
+        code.emit(Opcode::PUSH, Reg::A);
+        visit(left);
+        code.emit(Opcode::POP, Reg::B);
+    }
 }
 
 
-void CodeGenerator::visit(const Identifier* expr) {
-    int address = variable_addresses.at(expr->name);
-    assembly_code << "lda " << address << "\n";
+void CodeGenerator::emitStackOperands(const BinaryOp* expr) {
+    visit(expr->left);
+    code.emit(Opcode::PUSH, Reg::A);
+    visit(expr->right);
+    code.emit(Opcode::MOV, Reg::B, static_cast<uint16_t>(Reg::A));
+    code.emit(Opcode::POP, Reg::A);
 }
 
 
-void CodeGenerator::visit(const BinaryOp* expr) {
-    visit(expr->left.get());
-    assembly_code << "push A\n";
+void CodeGenerator::allocate(SymbolId symbol, bool is_extern) {
+    if (next_address >= options.data_limit) {
+        throw std::runtime_error("CodeGenerator Error: Out of memory for variables");
+    }
+    variable_addresses[symbol] = next_address++;
+    address_owners.push_back(symbol);
+    extern_addresses.push_back(is_extern);
+    if (is_extern && code.keepsComments()) {
+        code.comment("Extern '" + std::string(symbols.name(symbol)) + "' at address " + std::to_string(variable_addresses[symbol]));
+    }
+}
 
-    visit(expr->right.get());
-    assembly_code << "mov B A\n"; 
-   
-    
-    assembly_code << "pop A\n";
-   
-    
-    if (expr->op == "+") {
-        assembly_code << "add\n";
-    } else if (expr->op == "-") {
-        assembly_code << "sub\n";
-    } else if (expr->op != "==") { 
-        throw std::runtime_error("CodeGenerator Error: Unsupported binary operator '" + expr->op + "'");
+
+uint16_t CodeGenerator::addressOf(SymbolId symbol) {
+    if (options.externs && symbol < variable_addresses.size() && variable_addresses[symbol] < 0) allocate(symbol, true);
+    if (symbol >= variable_addresses.size() || variable_addresses[symbol] < 0) {
+        throw std::runtime_error("CodeGenerator Error: Undeclared variable '" + std::string(symbols.name(symbol)) + "'");
     }
+    return static_cast<uint16_t>(variable_addresses[symbol]);
 }
 
 
-std::string CodeGenerator::newLabel() {
-    return "L" + std::to_string(label_counter++);
+// Temporaries are addressed after every variable, which is only known once the whole
+// program has been generated. Until then their loads and stores carry the temporary's
+// index, and placeTemporaries() patches them.
+void CodeGenerator::emitMemory(Opcode op, SymbolId symbol) {
+    if (symbol < temporary_index.size() && temporary_index[symbol] >= 0) {
+        temporary_uses.push_back(code.items().size());
+        code.emit(op, Reg::A, static_cast<uint16_t>(temporary_index[symbol]));
+        return;
+    }
+    code.emit(op, Reg::A, addressOf(symbol));
+}
+
+
+void CodeGenerator::placeTemporaries(const Program& program) {
+    int base = next_address;
+    for (const VarDecl* temporary : program.temporaries) {
+        allocate(temporary->symbol, false);
+        if (code.keepsComments()) {
+            code.comment("Temporary '" + std::string(symbols.name(temporary->symbol)) + "' allocated at address " +
+                         std::to_string(variable_addresses[temporary->symbol]));
+        }
+    }
+    for (size_t use : temporary_uses) {
+        MachineInstr& instr = code.items()[use].instr;
+        instr.operand = static_cast<uint16_t>(instr.operand + base);
+    }
 }
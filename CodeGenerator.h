@@ -3,38 +3,93 @@
 
 
 #include "ast.h"
+#include "AstVisitor.h"
+#include "AsmBuffer.h"
+#include "SymbolTable.h"
 #include <string>
 #include <vector>
-#include <map>
-#include <sstream>
 
 
-class CodeGenerator {
+struct CodeGenOptions {
+    // Load leaf operands straight into B and order operand evaluation Sethi-Ullman style,
+    // spilling to the stack only when both operands need a register. When false, every
+    // operator uses the push/evaluate/mov/pop sequence.
+    bool register_operands = true;
+    // Keep the comments that explain variable addresses and stores; only worth it when
+    // the code is going to be printed.
+    bool annotate = false;
+    // Compile one module of a multi-file program: a variable used without a declaration
+    // is taken to be defined by another module. It gets an address (a slot) like a
+    // declared variable and isExtern() reports it; the linker resolves it later.
+    bool externs = false;
+    // Addresses below this hold variables; the stack lives above it.
+    int data_limit = MachineModel().dataLimit();
+};
+
+
+class CodeGenerator : private AstVisitor<CodeGenerator> {
 public:
-    std::string generate(const Program& program);
+    explicit CodeGenerator(const SymbolTable& symbols, CodeGenOptions options = CodeGenOptions());
+    AsmBuffer generate(const Program& program);
+    // A module for the linker: the program without its trailing hlt, since linked modules
+    // run one after another.
+    AsmBuffer generateModule(const Program& program);
+    // Generates one statement without the trailing hlt, for callers that assemble the
+    // program piecewise with AsmBuffer::append. Addresses persist across calls, and with
+    // `reuse_addresses` a variable that already has an address keeps it when its
+    // declaration is generated again.
+    AsmBuffer generateFragment(const Statement* stmt, bool reuse_addresses);
+    int variableCount() const { return next_address; }
+    // The variable declared at each address, in address order.
+    std::vector<std::string> variableNames() const;
+    // Per address, whether it holds an extern rather than a declared variable.
+    const std::vector<bool>& externAddresses() const { return extern_addresses; }
 
 
 private:
-    std::stringstream assembly_code;
-    std::map<std::string, int> variable_addresses;
+    const SymbolTable& symbols;
+    CodeGenOptions options;
+    AsmBuffer code;
+    // Indexed by SymbolId; -1 marks an undeclared symbol.
+    std::vector<int> variable_addresses;
+    std::vector<SymbolId> address_owners;
+    std::vector<bool> extern_addresses;
     int next_address = 0;
-    int label_counter = 0;
+    bool reuse_addresses = false;
+    // Indexed by SymbolId: the position of an optimizer temporary in
+    // Program::temporaries, or -1. Their loads and stores are listed in temporary_uses.
+    std::vector<int> temporary_index;
+    std::vector<size_t> temporary_uses;
+
+    friend class AstVisitor<CodeGenerator>;
 
 
-    void visit(const Statement* stmt);
+    void visit(const Program* program);
+    void visit(const Statement* stmt) {
+        code.setSource(stmt->offset);
+        dispatch(stmt);
+    }
     void visit(const VarDecl* stmt);
     void visit(const Assignment* stmt);
     void visit(const IfStatement* stmt);
+    void visit(const WhileStatement* stmt);
     void visit(const BlockStatement* stmt);
 
 
-    void visit(const Expression* expr);
+    void visit(const Expression* expr) { dispatch(expr); }
     void visit(const NumberLiteral* expr);
     void visit(const Identifier* expr);
     void visit(const BinaryOp* expr);
 
 
-    std::string newLabel();
+    const BinaryOp* comparison(const Expression* condition, const char* statement) const;
+    void emitCompare(const BinaryOp* condition);
+    void emitOperands(const BinaryOp* expr, bool flags_only = false);
+    void emitStackOperands(const BinaryOp* expr);
+    uint16_t addressOf(SymbolId symbol);
+    void emitMemory(Opcode op, SymbolId symbol);
+    void allocate(SymbolId symbol, bool is_extern);
+    void placeTemporaries(const Program& program);
 };
 
 
@@ -0,0 +1,156 @@
+#include "CompileCache.h"
+#include "ObjectFile.h"
+#include "Sha256.h"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+namespace {
+
+const char* const ENTRY_EXTENSION = ".slo";
+const char* const TEMP_MARKER = ".tmp-";
+// Temporary files older than this were left by a process that died while storing.
+constexpr std::chrono::hours STALE_TEMP_AGE{1};
+
+}
+
+
+CompileCache::CompileCache(std::string path, uint64_t max_bytes) : directory(std::move(path)), max_bytes(max_bytes) {
+    std::error_code error;
+    fs::create_directories(directory, error);
+    if (!fs::is_directory(directory)) {
+        throw std::runtime_error("CompileCache Error: Cannot create cache directory '" + directory.string() + "'");
+    }
+    std::random_device random;
+    uint64_t nonce = static_cast<uint64_t>(random()) << 32 | random();
+    temp_prefix = TEMP_MARKER + Sha256::toHex(Sha256::hash(std::to_string(nonce))).substr(0, 16) + "-";
+}
+
+
+std::string CompileCache::key(std::string_view source, std::string_view flags) const {
+    Sha256 sha;
+    sha.update(COMPILER_VERSION);
+    sha.update(std::string_view("\0", 1));
+    sha.update(flags);
+    sha.update(std::string_view("\0", 1));
+    sha.update(source);
+    return Sha256::toHex(sha.finish());
+}
+
+
+std::unique_ptr<MappedFile> CompileCache::lookup(const std::string& key) {
+    fs::path path = entryPath(key);
+    std::unique_ptr<MappedFile> file;
+    try {
+        file = std::make_unique<MappedFile>(path.string());
+        ObjectView check(file->view());
+    } catch (const std::exception&) {
+        // Missing, or not an object this build can read: either way a miss. A bad
+        // entry is removed so that the next store replaces it.
+        if (file) {
+            std::error_code error;
+            fs::remove(path, error);
+        }
+        misses++;
+        return nullptr;
+    }
+    std::error_code error;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+    hits++;
+    return file;
+}
+
+
+void CompileCache::store(const std::string& key, std::string_view object) {
+    fs::path temp = directory / (key + temp_prefix + std::to_string(temp_counter++));
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out || !out.write(object.data(), static_cast<std::streamsize>(object.size())) || !out.flush()) {
+            std::error_code error;
+            fs::remove(temp, error);
+            throw std::runtime_error("CompileCache Error: Cannot write '" + temp.string() + "'");
+        }
+    }
+    std::error_code error;
+    fs::rename(temp, entryPath(key), error);
+    if (error) {
+        // Another process may hold the entry open; its copy has the same contents.
+        fs::remove(temp, error);
+        return;
+    }
+    stores++;
+    if (max_bytes > 0) evict();
+}
+
+
+CacheStats CompileCache::stats() const {
+    return {hits.load(), misses.load(), stores.load(), evictions.load(), evicted_bytes.load()};
+}
+
+
+void CompileCache::printStats(std::ostream& out) const {
+    CacheStats current = stats();
+    uint64_t lookups = current.hits + current.misses;
+    out << "--- Compile Cache ---" << std::endl;
+    out << "Hits: " << current.hits << " Misses: " << current.misses;
+    if (lookups > 0) out << " (" << current.hits * 100 / lookups << "% hit rate)";
+    out << std::endl;
+    out << "Stored: " << current.stores << " Evicted: " << current.evictions << " (" << current.evicted_bytes
+        << " bytes)" << std::endl;
+}
+
+
+fs::path CompileCache::entryPath(const std::string& key) const {
+    return directory / (key + ENTRY_EXTENSION);
+}
+
+
+// Other processes may add, touch or remove entries while this runs, so every file
+// operation tolerates the file having changed or gone.
+void CompileCache::evict() {
+    struct Entry {
+        fs::path path;
+        uint64_t size;
+        fs::file_time_type used;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    auto now = fs::file_time_type::clock::now();
+    std::error_code error;
+    for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+        const fs::path& path = it->path();
+        std::error_code entry_error;
+        fs::file_time_type used = fs::last_write_time(path, entry_error);
+        if (entry_error) continue;
+        if (path.filename().string().find(TEMP_MARKER) != std::string::npos) {
+            if (now - used > STALE_TEMP_AGE) fs::remove(path, entry_error);
+            continue;
+        }
+        if (path.extension() != ENTRY_EXTENSION) continue;
+        uint64_t size = fs::file_size(path, entry_error);
+        if (entry_error) continue;
+        entries.push_back({path, size, used});
+        total += size;
+    }
+    if (total <= max_bytes) return;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    for (const Entry& entry : entries) {
+        if (total <= max_bytes) break;
+        std::error_code entry_error;
+        if (fs::remove(entry.path, entry_error)) {
+            evictions++;
+            evicted_bytes += entry.size;
+        }
+        total -= entry.size;
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+
+#include "MappedFile.h"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+
+// Part of every cache key. Bump it whenever the compiler can produce different code for
+// the same source and flags, so that entries written by older builds are never used.
+constexpr const char* COMPILER_VERSION = "simplelang-24";
+
+
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t stores = 0;
+    uint64_t evictions = 0;
+    uint64_t evicted_bytes = 0;
+};
+
+
+// On-disk cache of compiled object files, keyed by the SHA-256 of the compiler version,
+// the flags that affect code generation and the source bytes. Each entry is one
+// <key>.slo file in the cache directory.
+//
+// Entries are written to a uniquely named temporary file and renamed into place, so a
+// reader never sees a partial entry and any number of threads and processes can share
+// one directory. A hit refreshes the entry's modification time; once the directory
+// grows past its size limit the least recently used entries are deleted.
+class CompileCache {
+public:
+    // `max_bytes` of 0 means no limit.
+    explicit CompileCache(std::string directory, uint64_t max_bytes = 0);
+
+    // `flags` must describe every option that changes the generated code.
+    std::string key(std::string_view source, std::string_view flags) const;
+    // The cached object for `key`, mapped read-only, or null on a miss.
+    std::unique_ptr<MappedFile> lookup(const std::string& key);
+    void store(const std::string& key, std::string_view object);
+
+    CacheStats stats() const;
+    void printStats(std::ostream& out) const;
+
+
+private:
+    std::filesystem::path directory;
+    uint64_t max_bytes;
+    std::string temp_prefix;
+    std::atomic<uint64_t> temp_counter{0};
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> stores{0};
+    std::atomic<uint64_t> evictions{0};
+    std::atomic<uint64_t> evicted_bytes{0};
+
+    std::filesystem::path entryPath(const std::string& key) const;
+    void evict();
+};
+
+
+#endif
@@ -0,0 +1,392 @@
+#include "CycleModel.h"
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+
+namespace {
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && isspace(static_cast<unsigned char>(text.front()))) text.remove_prefix(1);
+    while (!text.empty() && isspace(static_cast<unsigned char>(text.back()))) text.remove_suffix(1);
+    return text;
+}
+
+
+std::string_view nextField(std::string_view& line) {
+    line = trim(line);
+    size_t end = 0;
+    while (end < line.size() && !isspace(static_cast<unsigned char>(line[end]))) end++;
+    std::string_view field = line.substr(0, end);
+    line.remove_prefix(end);
+    return field;
+}
+
+
+[[noreturn]] void fail(size_t line, const std::string& message) {
+    throw std::runtime_error("CycleModel Error: line " + std::to_string(line) + ": " + message);
+}
+
+
+// Where an if statement's code can come from: the statement's own offset, where its
+// condition starts, and the range of offsets in its body. Everything the code
+// generators and the optimizer tag the statement's code with lies in [offset, end].
+struct IfSpan {
+    uint32_t body;
+    uint32_t end;
+};
+
+
+uint32_t lastOffset(const Expression* expr) {
+    if (expr->kind != NodeKind::BINARY_OP) return expr->offset;
+    auto binary = static_cast<const BinaryOp*>(expr);
+    return std::max({expr->offset, lastOffset(binary->left), lastOffset(binary->right)});
+}
+
+
+uint32_t lastOffset(const Statement* stmt) {
+    uint32_t last = stmt->offset;
+    auto block = [&](const BlockStatement* body) {
+        last = std::max(last, body->offset);
+        for (const Statement* child : body->statements) last = std::max(last, lastOffset(child));
+    };
+    switch (stmt->kind) {
+        case NodeKind::ASSIGNMENT:
+            last = std::max(last, lastOffset(static_cast<const Assignment*>(stmt)->value));
+            break;
+        case NodeKind::BLOCK_STATEMENT:
+            block(static_cast<const BlockStatement*>(stmt));
+            break;
+        case NodeKind::IF_STATEMENT:
+            last = std::max(last, lastOffset(static_cast<const IfStatement*>(stmt)->condition));
+            block(static_cast<const IfStatement*>(stmt)->body);
+            break;
+        case NodeKind::WHILE_STATEMENT:
+            last = std::max(last, lastOffset(static_cast<const WhileStatement*>(stmt)->condition));
+            block(static_cast<const WhileStatement*>(stmt)->body);
+            break;
+        default:
+            break;
+    }
+    return last;
+}
+
+
+// Copies the optimizer made of a statement share its offsets, so they share one span.
+void collectIfs(const Statement* stmt, std::map<uint32_t, IfSpan>& spans) {
+    switch (stmt->kind) {
+        case NodeKind::BLOCK_STATEMENT:
+            for (const Statement* child : static_cast<const BlockStatement*>(stmt)->statements) collectIfs(child, spans);
+            break;
+        case NodeKind::IF_STATEMENT: {
+            auto branch = static_cast<const IfStatement*>(stmt);
+            spans.emplace(stmt->offset, IfSpan{branch->body->offset, lastOffset(stmt)});
+            collectIfs(branch->body, spans);
+            break;
+        }
+        case NodeKind::WHILE_STATEMENT:
+            collectIfs(static_cast<const WhileStatement*>(stmt)->body, spans);
+            break;
+        default:
+            break;
+    }
+}
+
+
+using InstructionSet = std::function<bool(size_t)>;
+
+
+// The paths from `entry` until control leaves `region`, halts or leaves the program.
+// Nodes are (instruction, whether any instruction of `body` has run so far); nodes 0
+// and 1 stand for leaving without and with the body having run. Each edge carries the
+// cycles of the instruction it leaves.
+class PathGraph {
+public:
+    PathGraph(const MachineInstr* program, size_t count, size_t entry, const InstructionSet& region,
+              const InstructionSet& body, const CycleCosts& costs) {
+        edges.resize(2);
+        std::unordered_map<uint32_t, uint32_t> nodes;
+        std::vector<uint32_t> pending;
+        auto node = [&](size_t pc, bool ran_body) -> uint32_t {
+            if (pc >= count || !region(pc) || program[pc].op == Opcode::HLT) return ran_body;
+            uint32_t key = static_cast<uint32_t>(pc) * 2 + ran_body;
+            auto [it, inserted] = nodes.try_emplace(key, static_cast<uint32_t>(edges.size()));
+            if (inserted) {
+                edges.emplace_back();
+                pending.push_back(key);
+            }
+            return it->second;
+        };
+
+        start = node(entry, false);
+        while (!pending.empty()) {
+            uint32_t key = pending.back();
+            pending.pop_back();
+            size_t pc = key / 2;
+            bool ran_body = (key & 1) || body(pc);
+            const MachineInstr& instr = program[pc];
+            uint32_t cycles = costs.of(instr.op);
+            // Looking up a successor can add nodes, so it comes before taking edges[from].
+            // The program counter is 16 bits, so running off instruction 65535 wraps to 0.
+            uint32_t from = nodes[key];
+            if (instr.op != Opcode::JMP) {
+                uint32_t next = node(static_cast<uint16_t>(pc + 1), ran_body);
+                edges[from].push_back({next, cycles});
+            }
+            if (instr.op == Opcode::JMP || instr.op == Opcode::JNE) {
+                uint32_t target = node(instr.operand, ran_body);
+                edges[from].push_back({target, cycles});
+            }
+        }
+    }
+
+    // The range over every path that leaves with `ran_body`. A path that can go round a
+    // cycle on its way out has no upper bound.
+    CycleRange range(bool ran_body) const {
+        CycleRange result;
+        const uint32_t exit = ran_body;
+        if (start == exit) {
+            result.possible = true;
+            return result;
+        }
+        if (start < 2) return result;
+
+        const uint64_t unreached = std::numeric_limits<uint64_t>::max();
+        std::vector<uint64_t> best(edges.size(), unreached);
+        using Entry = std::pair<uint64_t, uint32_t>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+        best[start] = 0;
+        queue.push({0, start});
+        while (!queue.empty()) {
+            auto [distance, from] = queue.top();
+            queue.pop();
+            if (distance != best[from] || from < 2) continue;
+            for (const Edge& edge : edges[from]) {
+                if (distance + edge.cycles < best[edge.to]) {
+                    best[edge.to] = distance + edge.cycles;
+                    queue.push({best[edge.to], edge.to});
+                }
+            }
+        }
+        if (best[exit] == unreached) return result;
+        result.possible = true;
+        result.best = best[exit];
+
+        // The longest path only over nodes that can still reach the exit, in topological
+        // order; if some of them are never ready, they lie on a cycle.
+        std::vector<std::vector<uint32_t>> predecessors(edges.size());
+        for (uint32_t from = 2; from < edges.size(); ++from) {
+            for (const Edge& edge : edges[from]) predecessors[edge.to].push_back(from);
+        }
+        std::vector<bool> useful(edges.size(), false);
+        std::vector<uint32_t> stack{exit};
+        useful[exit] = true;
+        while (!stack.empty()) {
+            uint32_t to = stack.back();
+            stack.pop_back();
+            for (uint32_t from : predecessors[to]) {
+                if (!useful[from]) {
+                    useful[from] = true;
+                    stack.push_back(from);
+                }
+            }
+        }
+        std::vector<uint32_t> waiting(edges.size(), 0);
+        size_t useful_count = 0;
+        for (uint32_t from = 2; from < edges.size(); ++from) {
+            if (!useful[from]) continue;
+            useful_count++;
+            for (const Edge& edge : edges[from]) {
+                if (useful[edge.to]) waiting[edge.to]++;
+            }
+        }
+        if (waiting[start] != 0) {
+            result.bounded = false;
+            result.worst = result.best;
+            return result;
+        }
+        std::vector<uint64_t> worst(edges.size(), 0);
+        std::vector<uint32_t> ready{start};
+        size_t finished = 0;
+        while (!ready.empty()) {
+            uint32_t from = ready.back();
+            ready.pop_back();
+            if (from < 2) continue;
+            finished++;
+            for (const Edge& edge : edges[from]) {
+                if (!useful[edge.to]) continue;
+                worst[edge.to] = std::max(worst[edge.to], worst[from] + edge.cycles);
+                if (--waiting[edge.to] == 0) ready.push_back(edge.to);
+            }
+        }
+        result.bounded = finished == useful_count;
+        result.worst = result.bounded ? worst[exit] : result.best;
+        return result;
+    }
+
+
+private:
+    struct Edge {
+        uint32_t to;
+        uint32_t cycles;
+    };
+
+    std::vector<std::vector<Edge>> edges;
+    uint32_t start = 0;
+};
+
+}
+
+
+CycleCosts parseCycleCosts(std::string_view text) {
+    CycleCosts costs;
+    bool listed[OPCODE_COUNT] = {};
+    size_t number = 0;
+    while (!text.empty()) {
+        size_t newline = text.find('\n');
+        std::string_view line = text.substr(0, newline);
+        text.remove_prefix(newline == std::string_view::npos ? text.size() : newline + 1);
+        number++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+
+        std::string mnemonic(nextField(line));
+        unsigned op = 0;
+        while (op < OPCODE_COUNT && mnemonic != opcodeName(static_cast<Opcode>(op))) op++;
+        if (op == OPCODE_COUNT) fail(number, "Unknown instruction '" + mnemonic + "'");
+        if (listed[op]) fail(number, "'" + mnemonic + "' is listed twice");
+        listed[op] = true;
+
+        std::string_view cycles = nextField(line);
+        if (cycles.empty() || cycles.size() > 9 ||
+            !std::all_of(cycles.begin(), cycles.end(), [](char c) { return isdigit(static_cast<unsigned char>(c)); })) {
+            fail(number, "Expected a cycle count for '" + mnemonic + "'");
+        }
+        unsigned value = static_cast<unsigned>(std::stoul(std::string(cycles)));
+        if (value > CycleCosts::MAX_CYCLES) {
+            fail(number, "'" + mnemonic + "' cannot take more than " + std::to_string(CycleCosts::MAX_CYCLES) + " cycles");
+        }
+        if (!trim(line).empty()) fail(number, "Unexpected '" + std::string(trim(line)) + "'");
+        costs.cycles[op] = static_cast<uint8_t>(value);
+    }
+    return costs;
+}
+
+
+CycleCosts loadCycleCosts(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) throw std::runtime_error("CycleModel Error: Cannot open '" + path + "'");
+    std::ostringstream text;
+    text << file.rdbuf();
+    return parseCycleCosts(text.str());
+}
+
+
+std::string CycleRange::text() const {
+    if (!possible) return "-";
+    if (!bounded) return std::to_string(best) + "+";
+    if (best == worst) return std::to_string(best);
+    return std::to_string(best) + "-" + std::to_string(worst);
+}
+
+
+void CycleRange::include(const CycleRange& other) {
+    if (!other.possible) return;
+    if (!possible) {
+        *this = other;
+        return;
+    }
+    best = std::min(best, other.best);
+    worst = std::max(worst, other.worst);
+    bounded = bounded && other.bounded;
+}
+
+
+CycleEstimate estimateCycles(const MachineInstr* program, size_t count, const CycleCosts& costs) {
+    CycleEstimate estimate;
+    estimate.costs = costs;
+    const size_t n = std::min(count, MAX_PROGRAM_SIZE);
+    PathGraph paths(program, n, 0, [](size_t) { return true; }, [](size_t) { return false; }, costs);
+    estimate.program = paths.range(false);
+    return estimate;
+}
+
+
+// An if statement's code is entered wherever control reaches an instruction tagged with
+// the statement's own offset from outside its span: at the start of each copy.
+CycleEstimate estimateCycles(const MachineInstr* program, size_t count, const CycleCosts& costs, const Program& ast,
+                             const std::vector<uint32_t>& offsets) {
+    CycleEstimate estimate = estimateCycles(program, count, costs);
+    const size_t n = std::min({count, offsets.size(), MAX_PROGRAM_SIZE});
+    std::map<uint32_t, IfSpan> spans;
+    for (const Statement* stmt : ast.statements) collectIfs(stmt, spans);
+
+    std::vector<std::vector<uint32_t>> predecessors(n);
+    for (size_t pc = 0; pc < n; ++pc) {
+        Opcode op = program[pc].op;
+        if (op != Opcode::JMP && op != Opcode::HLT && pc + 1 < n) predecessors[pc + 1].push_back(static_cast<uint32_t>(pc));
+        if ((op == Opcode::JMP || op == Opcode::JNE) && program[pc].operand < n) {
+            predecessors[program[pc].operand].push_back(static_cast<uint32_t>(pc));
+        }
+    }
+
+    for (const auto& [offset, span] : spans) {
+        const uint32_t begin = offset;
+        const IfSpan bounds = span;
+        auto region = [&](size_t pc) { return offsets[pc] >= begin && offsets[pc] <= bounds.end; };
+        auto body = [&](size_t pc) { return offsets[pc] >= bounds.body && offsets[pc] <= bounds.end; };
+        IfCycleEstimate statement;
+        statement.offset = offset;
+        for (size_t pc = 0; pc < n; ++pc) {
+            if (offsets[pc] != offset) continue;
+            bool entered = pc == 0 || std::any_of(predecessors[pc].begin(), predecessors[pc].end(),
+                                                  [&](uint32_t from) { return !region(from); });
+            if (!entered) continue;
+            PathGraph paths(program, n, pc, region, body, costs);
+            statement.copies++;
+            statement.holds.include(paths.range(true));
+            statement.fails.include(paths.range(false));
+        }
+        if (statement.copies) estimate.ifs.push_back(statement);
+    }
+    return estimate;
+}
+
+
+void CycleEstimate::print(std::ostream& out, const LineIndex* lines) const {
+    out << "--- Cycle Estimate ---" << std::endl;
+    out << "Cycle costs:";
+    for (unsigned op = 0; op < OPCODE_COUNT; ++op) {
+        out << (op ? ", " : " ") << opcodeName(static_cast<Opcode>(op)) << " " << static_cast<unsigned>(costs.cycles[op]);
+    }
+    out << std::endl;
+    if (program.possible) {
+        out << "Program: " << program.text() << " cycles" << std::endl;
+    } else {
+        out << "Program: never halts" << std::endl;
+    }
+
+    bool open = !program.bounded;
+    if (!ifs.empty()) {
+        out << "If statements:" << std::endl;
+        out << std::setw(8) << "line" << std::setw(14) << "holds" << std::setw(14) << "fails" << std::endl;
+    }
+    for (const IfCycleEstimate& statement : ifs) {
+        SourceLocation location = lines ? lines->locate(statement.offset) : SourceLocation();
+        std::string where = lines ? std::to_string(location.line) : "@" + std::to_string(statement.offset);
+        out << std::setw(8) << where << std::setw(14) << statement.holds.text() << std::setw(14)
+            << statement.fails.text();
+        if (lines) out << "  " << trim(lines->line(location.line));
+        if (statement.copies > 1) out << "  (" << statement.copies << " copies)";
+        out << std::endl;
+        open = open || !statement.holds.bounded || !statement.fails.bounded;
+    }
+    if (open) out << "N+: the path runs a loop, so it can take any number of cycles from N up" << std::endl;
+}
@@ -0,0 +1,67 @@
+#ifndef CYCLE_MODEL_H
+#define CYCLE_MODEL_H
+
+
+#include "Isa.h"
+#include "ast.h"
+#include "lexer.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Cycle costs in the text format --cycle-costs reads: one `mnemonic cycles` pair per
+// line, with '#' starting a comment. Opcodes that are not listed keep their default.
+CycleCosts parseCycleCosts(std::string_view text);
+CycleCosts loadCycleCosts(const std::string& path);
+
+
+// Fewest and most cycles over a set of paths. A path that goes round a loop can take
+// it any number of times, which leaves the most open.
+struct CycleRange {
+    // False if no path of this kind exists.
+    bool possible = false;
+    uint64_t best = 0;
+    uint64_t worst = 0;
+    bool bounded = true;
+
+    void include(const CycleRange& other);
+    // "best-worst", "best+" when unbounded, or "-" when impossible.
+    std::string text() const;
+};
+
+
+// One if statement of the source. Its code runs from the condition to the first
+// instruction that belongs to no part of the statement; a path either runs some of the
+// body or none of it. The optimizer can leave several copies, e.g. in unrolled loops.
+struct IfCycleEstimate {
+    uint32_t offset = 0;
+    size_t copies = 0;
+    CycleRange holds;
+    CycleRange fails;
+};
+
+
+struct CycleEstimate {
+    // From instruction 0 until the program halts or leaves the program.
+    CycleRange program;
+    std::vector<IfCycleEstimate> ifs;
+    CycleCosts costs;
+
+    void print(std::ostream& out, const LineIndex* lines = nullptr) const;
+};
+
+
+// Static estimates over the program's control flow graph under `costs`, without running
+// it. Like CPU::cycleCount(), a path's cycles do not include the final hlt.
+CycleEstimate estimateCycles(const MachineInstr* program, size_t count, const CycleCosts& costs);
+// Also estimates every if statement left in the optimized `ast`, locating its code by
+// the source offsets sourceOffsets() gives for the code the program was assembled from.
+CycleEstimate estimateCycles(const MachineInstr* program, size_t count, const CycleCosts& costs, const Program& ast,
+                             const std::vector<uint32_t>& offsets);
+
+
+#endif
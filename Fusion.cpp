@@ -0,0 +1,195 @@
+#include "Fusion.h"
+#include <algorithm>
+#include <iomanip>
+#include <string>
+#include <utility>
+
+
+namespace {
+
+// Everything an instruction's effect depends on apart from its operand: the opcode, the
+// register for ldi, mov, push and pop, and the source register for mov. Registers other
+// than A behave as B, and mov's source is the low byte of its operand.
+constexpr uint8_t stepKey(Opcode op, bool reg_b = false, bool source_b = false) {
+    return static_cast<uint8_t>(static_cast<unsigned>(op) << 2 | reg_b << 1 | source_b);
+}
+
+
+uint8_t stepKey(const MachineInstr& instr) {
+    if (static_cast<unsigned>(instr.op) >= OPCODE_COUNT) return OPCODE_COUNT << 2;
+    switch (instr.op) {
+        case Opcode::LDI:
+        case Opcode::PUSH:
+        case Opcode::POP:
+            return stepKey(instr.op, instr.reg != Reg::A);
+        case Opcode::MOV:
+            return stepKey(instr.op, instr.reg != Reg::A, static_cast<uint8_t>(instr.operand) != 0);
+        default:
+            return stepKey(instr.op);
+    }
+}
+
+
+std::string stepText(uint8_t key) {
+    unsigned op = key >> 2;
+    if (op >= OPCODE_COUNT) return "?";
+    std::string text = opcodeName(static_cast<Opcode>(op));
+    Opcode opcode = static_cast<Opcode>(op);
+    if (opcode == Opcode::LDI || opcode == Opcode::MOV || opcode == Opcode::PUSH || opcode == Opcode::POP) {
+        text += (key & 2) ? " B" : " A";
+    }
+    if (opcode == Opcode::MOV) text += (key & 1) ? " B" : " A";
+    return text;
+}
+
+
+constexpr int NO_OPERAND = -1;
+
+
+struct Pattern {
+    FusedOp op;
+    unsigned length;
+    uint8_t steps[FusionProfile::MAX_LENGTH];
+    // Which step's operand becomes x, y and z.
+    int operands[3];
+};
+
+
+// Longest first, so that the longest match at a position wins.
+const Pattern PATTERNS[] = {
+    {FusedOp::STACK_ADD, 5,
+     {stepKey(Opcode::PUSH), stepKey(Opcode::LDA), stepKey(Opcode::MOV, true), stepKey(Opcode::POP), stepKey(Opcode::ADD)},
+     {1, NO_OPERAND, NO_OPERAND}},
+    {FusedOp::STACK_SUB, 5,
+     {stepKey(Opcode::PUSH), stepKey(Opcode::LDA), stepKey(Opcode::MOV, true), stepKey(Opcode::POP), stepKey(Opcode::SUB)},
+     {1, NO_OPERAND, NO_OPERAND}},
+    {FusedOp::LOAD_ADD, 4,
+     {stepKey(Opcode::LDA), stepKey(Opcode::MOV, true), stepKey(Opcode::LDA), stepKey(Opcode::ADD)},
+     {0, 2, NO_OPERAND}},
+    {FusedOp::LOAD_SUB, 4,
+     {stepKey(Opcode::LDA), stepKey(Opcode::MOV, true), stepKey(Opcode::LDA), stepKey(Opcode::SUB)},
+     {0, 2, NO_OPERAND}},
+    {FusedOp::INCREMENT, 4,
+     {stepKey(Opcode::LDA), stepKey(Opcode::LDI, true), stepKey(Opcode::ADD), stepKey(Opcode::STA)},
+     {0, 1, 3}},
+    {FusedOp::CMP_IMMEDIATE_JNE, 3,
+     {stepKey(Opcode::LDI, true), stepKey(Opcode::CMP), stepKey(Opcode::JNE)},
+     {0, 2, NO_OPERAND}},
+    {FusedOp::ADD_IMMEDIATE, 2,
+     {stepKey(Opcode::LDI, true), stepKey(Opcode::ADD)},
+     {0, NO_OPERAND, NO_OPERAND}},
+    {FusedOp::SUB_IMMEDIATE, 2,
+     {stepKey(Opcode::LDI, true), stepKey(Opcode::SUB)},
+     {0, NO_OPERAND, NO_OPERAND}},
+    {FusedOp::CMP_JNE, 2,
+     {stepKey(Opcode::CMP), stepKey(Opcode::JNE)},
+     {1, NO_OPERAND, NO_OPERAND}},
+};
+
+
+bool matches(const Pattern& pattern, const uint8_t* keys) {
+    return std::equal(pattern.steps, pattern.steps + pattern.length, keys);
+}
+
+}
+
+
+unsigned fusedLength(uint8_t op) {
+    for (const Pattern& pattern : PATTERNS) {
+        if (static_cast<uint8_t>(pattern.op) == op) return pattern.length;
+    }
+    return 1;
+}
+
+
+std::vector<FusedInstr> fuseProgram(const MachineInstr* program, size_t count, bool fuse, const CycleCosts& costs) {
+    const size_t n = std::min(count, MAX_PROGRAM_SIZE);
+    std::vector<uint8_t> keys(n);
+    std::vector<FusedInstr> fused(n);
+    uint32_t rest = 0;
+    for (size_t i = n; i-- > 0;) {
+        keys[i] = stepKey(program[i]);
+        Opcode op = program[i].op;
+        if (op == Opcode::HLT) {
+            rest = 0;
+        } else if (op == Opcode::JMP || op == Opcode::JNE) {
+            rest = costs.of(op);
+        } else {
+            rest += costs.of(op);
+        }
+        fused[i] = {static_cast<uint8_t>(std::min(static_cast<unsigned>(op), OPCODE_COUNT)), 0, 0, 0, rest};
+    }
+    if (!fuse) return fused;
+
+    for (size_t i = 0; i < n; ++i) {
+        for (const Pattern& pattern : PATTERNS) {
+            if (i + pattern.length > n || !matches(pattern, &keys[i])) continue;
+            uint16_t operands[3] = {};
+            for (int k = 0; k < 3; ++k) {
+                if (pattern.operands[k] != NO_OPERAND) {
+                    operands[k] = program[i + pattern.operands[k]].operand;
+                }
+            }
+            fused[i] = {static_cast<uint8_t>(pattern.op), operands[0], operands[1], operands[2], fused[i].cycles};
+            break;
+        }
+    }
+    return fused;
+}
+
+
+// The window holds step keys plus one, so a packed sequence of them is never zero and
+// sequences of different lengths never collide.
+void FusionProfile::record(size_t pc, const MachineInstr& instr) {
+    if (window_size > 0 && pc != last_pc + 1) window_size = 0;
+    if (window_size == MAX_LENGTH) {
+        std::copy(window + 1, window + MAX_LENGTH, window);
+        window_size--;
+    }
+    window[window_size++] = stepKey(instr) + 1;
+    last_pc = pc;
+
+    uint64_t sequence = window[window_size - 1];
+    for (size_t start = window_size - 1; start-- > 0;) {
+        sequence |= static_cast<uint64_t>(window[start]) << (8 * (window_size - 1 - start));
+        counts[sequence]++;
+    }
+    if (instr.op == Opcode::JMP || instr.op == Opcode::JNE) window_size = 0;
+}
+
+
+void FusionProfile::print(std::ostream& out, size_t limit) const {
+    struct Candidate {
+        std::vector<uint8_t> steps;
+        uint64_t count;
+        uint64_t saved;
+    };
+    std::vector<Candidate> candidates;
+    candidates.reserve(counts.size());
+    for (const auto& [sequence, count] : counts) {
+        Candidate candidate{{}, count, 0};
+        for (uint64_t rest = sequence; rest; rest >>= 8) {
+            candidate.steps.insert(candidate.steps.begin(), static_cast<uint8_t>((rest & 0xFF) - 1));
+        }
+        candidate.saved = count * (candidate.steps.size() - 1);
+        candidates.push_back(std::move(candidate));
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.saved != b.saved ? a.saved > b.saved : a.steps < b.steps;
+    });
+
+    out << "--- Fusion Candidates ---" << std::endl;
+    for (size_t i = 0; i < candidates.size() && i < limit; ++i) {
+        const Candidate& candidate = candidates[i];
+        std::string text;
+        for (uint8_t step : candidate.steps) {
+            if (!text.empty()) text += "; ";
+            text += stepText(step);
+        }
+        bool fused = std::any_of(std::begin(PATTERNS), std::end(PATTERNS), [&](const Pattern& pattern) {
+            return pattern.length == candidate.steps.size() && matches(pattern, candidate.steps.data());
+        });
+        out << std::setw(12) << candidate.saved << " dispatches saved  x" << std::left << std::setw(10)
+            << candidate.count << std::right << text << (fused ? "  [fused]" : "") << std::endl;
+    }
+}
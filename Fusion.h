@@ -0,0 +1,80 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+
+#include "Isa.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+
+// Superinstructions for idioms the code generators emit, executed by CPU::runThreaded in
+// a single dispatch. The values continue after the ISA opcodes and the slot the
+// threaded loop uses for invalid opcodes.
+enum class FusedOp : uint8_t {
+    ADD_IMMEDIATE = OPCODE_COUNT + 1,   // ldi B x; add
+    SUB_IMMEDIATE,                      // ldi B x; sub
+    LOAD_ADD,                           // lda x; mov B A; lda y; add
+    LOAD_SUB,                           // lda x; mov B A; lda y; sub
+    STACK_ADD,                          // push A; lda x; mov B A; pop A; add
+    STACK_SUB,                          // push A; lda x; mov B A; pop A; sub
+    INCREMENT,                          // lda x; ldi B y; add; sta z
+    CMP_JNE,                            // cmp; jne x
+    CMP_IMMEDIATE_JNE                   // ldi B x; cmp; jne y
+};
+
+constexpr unsigned FUSED_OP_END = static_cast<unsigned>(FusedOp::CMP_IMMEDIATE_JNE) + 1;
+
+
+// One entry per instruction position. `op` is either the instruction's own opcode
+// (OPCODE_COUNT for opcodes outside the ISA) or a FusedOp covering the instructions
+// from this position on, with x, y and z holding its operands. Positions inside a fused
+// sequence keep their own entry, so jumps into the middle of one still work. Memory
+// operands are kept as encoded; the CPU masks them to its memory size.
+//
+// `cycles` is the cost of the straight-line code from this position on: through the
+// next jmp or jne, up to the next hlt, or to the last position. Control that lands here
+// runs all of it unless it faults, so the threaded loop counts cycles where control
+// lands instead of on every dispatch.
+struct FusedInstr {
+    uint8_t op;
+    uint16_t x;
+    uint16_t y;
+    uint16_t z;
+    uint32_t cycles;
+};
+
+
+// Number of instructions an entry stands for.
+unsigned fusedLength(uint8_t op);
+
+// Decodes the positions the 16-bit program counter can reach. Sequences are never fused
+// across the last one, where the program counter wraps. Without `fuse` every entry is a
+// plain opcode. Entry cycles are under `costs`.
+std::vector<FusedInstr> fuseProgram(const MachineInstr* program, size_t count, bool fuse = true,
+                                    const CycleCosts& costs = CycleCosts());
+
+
+// Counts opcode sequences along the executed trace, for finding new superinstructions.
+// A sequence ends at any jump and whenever the program counter does not simply advance.
+class FusionProfile {
+public:
+    static constexpr size_t MAX_LENGTH = 5;
+
+    void record(size_t pc, const MachineInstr& instr);
+    // The most frequent sequences by dispatches a superinstruction would save, marking
+    // the ones that already have one.
+    void print(std::ostream& out, size_t limit = 10) const;
+
+
+private:
+    uint8_t window[MAX_LENGTH] = {};
+    size_t window_size = 0;
+    size_t last_pc = 0;
+    std::unordered_map<uint64_t, uint64_t> counts;
+};
+
+
+#endif
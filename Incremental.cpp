@@ -0,0 +1,239 @@
+#include "Incremental.h"
+#include "AstVisitor.h"
+#include "lexer.h"
+#include "parser.h"
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace {
+
+// Records variable declarations and uses in the order CodeGenerator resolves them.
+class SymbolEventCollector : private AstVisitor<SymbolEventCollector> {
+public:
+    explicit SymbolEventCollector(std::vector<uint32_t>& out) : out(out) {}
+    void collect(const Statement* stmt) { dispatch(stmt); }
+
+
+private:
+    std::vector<uint32_t>& out;
+
+    friend class AstVisitor<SymbolEventCollector>;
+
+    void visit(const VarDecl* node) { out.push_back(node->symbol << 1 | 1); }
+    void visit(const Assignment* node) {
+        dispatch(node->value);
+        out.push_back(node->symbol << 1);
+    }
+    void visit(const IfStatement* node) {
+        dispatch(node->condition);
+        dispatch(node->body);
+    }
+    void visit(const WhileStatement* node) {
+        dispatch(node->condition);
+        dispatch(node->body);
+    }
+    void visit(const BlockStatement* node) {
+        for (const Statement* stmt : node->statements) dispatch(stmt);
+    }
+    void visit(const Identifier* node) { out.push_back(node->symbol << 1); }
+    void visit(const BinaryOp* node) {
+        dispatch(node->left);
+        dispatch(node->right);
+    }
+    void visit(const NumberLiteral*) {}
+    void visit(const Program*) {}
+};
+
+
+// Dead nodes from replaced statements stay in the arena until the next full rebuild.
+constexpr size_t ARENA_SLACK = 1024 * 1024;
+
+}
+
+
+IncrementalCompiler::IncrementalCompiler(std::string source) : text(std::move(source)) {
+    rebuild();
+}
+
+
+void IncrementalCompiler::update(const std::vector<TextEdit>& edits) {
+    stats = IncrementalStats();
+    std::vector<TextEdit> ordered = edits;
+    std::sort(ordered.begin(), ordered.end(), [](const TextEdit& a, const TextEdit& b) { return a.offset > b.offset; });
+
+    if (!valid) {
+        for (const TextEdit& edit : ordered) text.replace(edit.offset, edit.length, edit.replacement);
+        rebuild();
+        return;
+    }
+
+    // Applying from the back keeps the offsets of earlier edits valid.
+    for (const TextEdit& edit : ordered) {
+        if (edit.offset + edit.length > text.size()) {
+            throw std::runtime_error("IncrementalCompiler Error: Edit out of range");
+        }
+        applyEdit(edit);
+        if (!valid) {
+            for (const TextEdit& rest : ordered) {
+                if (rest.offset < edit.offset) text.replace(rest.offset, rest.length, rest.replacement);
+            }
+            rebuild();
+            return;
+        }
+    }
+
+    if (arena.bytesAllocated() > 2 * arena_baseline + ARENA_SLACK) {
+        rebuild();
+    }
+}
+
+
+AsmBuffer IncrementalCompiler::program() const {
+    AsmBuffer out;
+    for (const Unit& unit : units) out.append(unit.code);
+    out.emit(Opcode::HLT);
+    return out;
+}
+
+
+void IncrementalCompiler::rebuild() {
+    valid = false;
+    stats.full_rebuild = true;
+    arena.reset();
+    units.clear();
+    generator = std::make_unique<CodeGenerator>(symbols);
+
+    units = parseRegion(0, text.size());
+    for (Unit& unit : units) {
+        generate(unit, false);
+    }
+    arena_baseline = arena.bytesAllocated();
+    // Redeclared variables get a fresh address at each declaration, which fragment
+    // reuse cannot reproduce, so such programs are always rebuilt in full.
+    valid = declarationsInOrder();
+}
+
+
+void IncrementalCompiler::applyEdit(const TextEdit& edit) {
+    // Grow the damaged range to whole lines (a `//` can hide the rest of its line) and to
+    // whole statements, until both conditions hold at once.
+    size_t lo = lineStart(edit.offset);
+    size_t hi = lineEnd(edit.offset + edit.length);
+    size_t first = 0, last = 0;
+    for (;;) {
+        auto first_it = std::lower_bound(units.begin(), units.end(), lo, [](const Unit& u, size_t pos) { return u.end < pos; });
+        auto last_it = std::upper_bound(first_it, units.end(), hi, [](size_t pos, const Unit& u) { return pos < u.begin; });
+        first = static_cast<size_t>(first_it - units.begin());
+        last = static_cast<size_t>(last_it - units.begin());
+        if (first == last) break;
+
+        size_t new_lo = lineStart(std::min(lo, units[first].begin));
+        size_t new_hi = lineEnd(std::max(hi, units[last - 1].end));
+        if (new_lo == lo && new_hi == hi) break;
+        lo = new_lo;
+        hi = new_hi;
+    }
+
+    text.replace(edit.offset, edit.length, edit.replacement);
+    ptrdiff_t delta = static_cast<ptrdiff_t>(edit.replacement.size()) - static_cast<ptrdiff_t>(edit.length);
+    size_t new_hi = static_cast<size_t>(static_cast<ptrdiff_t>(hi) + delta);
+
+    std::vector<Unit> fresh;
+    try {
+        fresh = parseRegion(lo, new_hi);
+    } catch (const std::exception&) {
+        valid = false;
+        return;
+    }
+
+    // If the replaced statements declare and use the same symbols in the same order,
+    // declaration order cannot have changed and the whole-file check can be skipped.
+    std::vector<uint32_t> old_events, new_events;
+    for (size_t i = first; i < last; ++i) old_events.insert(old_events.end(), units[i].symbol_events.begin(), units[i].symbol_events.end());
+    for (const Unit& unit : fresh) new_events.insert(new_events.end(), unit.symbol_events.begin(), unit.symbol_events.end());
+
+    if (delta != 0) {
+        for (size_t i = last; i < units.size(); ++i) {
+            units[i].begin = static_cast<size_t>(static_cast<ptrdiff_t>(units[i].begin) + delta);
+            units[i].end = static_cast<size_t>(static_cast<ptrdiff_t>(units[i].end) + delta);
+        }
+    }
+    size_t inserted = fresh.size();
+    if (inserted == last - first) {
+        std::move(fresh.begin(), fresh.end(), units.begin() + first);
+    } else {
+        units.erase(units.begin() + first, units.begin() + last);
+        units.insert(units.begin() + first, std::make_move_iterator(fresh.begin()), std::make_move_iterator(fresh.end()));
+    }
+    stats.bytes_relexed += new_hi - lo;
+
+    if (old_events != new_events && !declarationsInOrder()) {
+        valid = false;
+        return;
+    }
+    try {
+        for (size_t i = first; i < first + inserted; ++i) generate(units[i], true);
+    } catch (const std::exception&) {
+        valid = false;
+    }
+}
+
+
+bool IncrementalCompiler::declarationsInOrder() const {
+    std::vector<uint8_t> declared(symbols.size(), 0);
+    for (const Unit& unit : units) {
+        for (uint32_t event : unit.symbol_events) {
+            uint8_t& state = declared[event >> 1];
+            if (event & 1) {
+                if (state) return false;
+                state = 1;
+            } else if (!state) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+std::vector<IncrementalCompiler::Unit> IncrementalCompiler::parseRegion(size_t begin, size_t end) {
+    std::string_view region(text.data() + begin, end - begin);
+    Lexer lexer(region, symbols);
+    Parser parser(lexer);
+    std::vector<ParsedStatement> parsed;
+    parser.parseInto(arena, parsed);
+
+    std::vector<Unit> result;
+    result.reserve(parsed.size());
+    for (const ParsedStatement& p : parsed) {
+        Unit unit;
+        unit.begin = begin + p.begin;
+        unit.end = begin + p.end;
+        unit.statement = p.statement;
+        unit.id = next_unit_id++;
+        SymbolEventCollector(unit.symbol_events).collect(p.statement);
+        result.push_back(std::move(unit));
+    }
+    stats.statements_reparsed += result.size();
+    return result;
+}
+
+
+void IncrementalCompiler::generate(Unit& unit, bool reuse_addresses) {
+    unit.code = generator->generateFragment(unit.statement, reuse_addresses);
+    stats.statements_regenerated++;
+}
+
+
+size_t IncrementalCompiler::lineStart(size_t offset) const {
+    if (offset == 0) return 0;
+    size_t newline = text.rfind('\n', offset - 1);
+    return newline == std::string::npos ? 0 : newline + 1;
+}
+
+
+size_t IncrementalCompiler::lineEnd(size_t offset) const {
+    size_t newline = text.find('\n', offset);
+    return newline == std::string::npos ? text.size() : newline;
+}
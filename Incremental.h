@@ -0,0 +1,88 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+
+#include "ast.h"
+#include "Arena.h"
+#include "AsmBuffer.h"
+#include "CodeGenerator.h"
+#include "SymbolTable.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// Replaces `length` bytes at `offset` with `replacement`. Offsets refer to the text
+// before the batch of edits is applied; edits in a batch must not overlap.
+struct TextEdit {
+    size_t offset;
+    size_t length;
+    std::string replacement;
+};
+
+
+struct IncrementalStats {
+    size_t bytes_relexed = 0;
+    size_t statements_reparsed = 0;
+    size_t statements_regenerated = 0;
+    bool full_rebuild = false;
+};
+
+
+// Keeps the AST and generated assembly of a source file between edits. An edit
+// re-lexes and re-parses only the top-level statements on the lines it touches and
+// regenerates assembly only for those statements; everything else is reused.
+//
+// Variables keep the address they were first given, so unchanged fragments stay valid.
+// Declaration order is re-checked after every edit from per-statement summaries. A
+// region that no longer parses on its own, a use before declaration, a redeclared
+// variable, or too much dead arena memory falls back to a full rebuild, which gives
+// exactly the result (or the error) of a from-scratch compile.
+class IncrementalCompiler {
+public:
+    explicit IncrementalCompiler(std::string source);
+
+    void update(const std::vector<TextEdit>& edits);
+    // All statements' code followed by hlt, ready for assemble().
+    AsmBuffer program() const;
+
+    const std::string& source() const { return text; }
+    const SymbolTable& symbolTable() const { return symbols; }
+    const IncrementalStats& lastStats() const { return stats; }
+
+
+private:
+    struct Unit {
+        size_t begin;
+        size_t end;
+        Statement* statement;
+        uint32_t id;
+        // Declarations and uses in code generation order, encoded as symbol << 1 | is_declaration.
+        std::vector<uint32_t> symbol_events;
+        AsmBuffer code;
+    };
+
+    std::string text;
+    SymbolTable symbols;
+    Arena arena;
+    size_t arena_baseline = 0;
+    std::vector<Unit> units;
+    std::unique_ptr<CodeGenerator> generator;
+    uint32_t next_unit_id = 0;
+    // False when the next update must rebuild from scratch instead of patching.
+    bool valid = false;
+    IncrementalStats stats;
+
+
+    void rebuild();
+    void applyEdit(const TextEdit& edit);
+    std::vector<Unit> parseRegion(size_t begin, size_t end);
+    void generate(Unit& unit, bool reuse_addresses);
+    bool declarationsInOrder() const;
+    size_t lineStart(size_t offset) const;
+    size_t lineEnd(size_t offset) const;
+};
+
+
+#endif
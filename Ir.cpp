@@ -0,0 +1,309 @@
+#include "Ir.h"
+#include <algorithm>
+#include <ostream>
+
+
+IrBlock* IrFunction::newBlock() {
+    blocks.emplace_back();
+    IrBlock* block = &blocks.back();
+    block->id = static_cast<uint32_t>(blocks.size() - 1);
+    return block;
+}
+
+
+IrValue* IrFunction::newValue(IrOp op, IrBlock* block) {
+    values.emplace_back(op);
+    IrValue* value = &values.back();
+    value->id = static_cast<uint32_t>(values.size() - 1);
+    value->block = block;
+    return value;
+}
+
+
+// Constants are shared, so the same literal is always the same value. They are
+// reduced to the CPU's 8-bit range here, which is what `ldi` does with them anyway.
+IrValue* IrFunction::constant(int value) {
+    value &= 0xFF;
+    if (constants.empty()) constants.assign(256, nullptr);
+    if (!constants[value]) {
+        constants[value] = newValue(IrOp::CONST, nullptr);
+        constants[value]->constant = value;
+    }
+    return constants[value];
+}
+
+
+void IrFunction::renumber() {
+    uint32_t next = 0;
+    for (IrBlock& block : blocks) {
+        for (IrValue* value : block.instructions) {
+            value->id = next++;
+            value->use_count = 0;
+        }
+    }
+    for (IrValue* value : constants) {
+        if (!value) continue;
+        value->id = next++;
+        value->use_count = 0;
+    }
+    value_count = next;
+
+    for (IrBlock& block : blocks) {
+        for (IrValue* value : block.instructions) {
+            for (IrValue* operand : value->operands) operand->use_count++;
+        }
+        if (block.terminator == IrTerminator::BRANCH_EQ) {
+            block.condition[0]->use_count++;
+            block.condition[1]->use_count++;
+        }
+    }
+    for (const IrExitValue& exit : exit_values) exit.value->use_count++;
+}
+
+
+namespace {
+
+void addUse(IrValueSet& live, const IrValue* value) {
+    if (value->op != IrOp::CONST) live.insert(value->id);
+}
+
+
+size_t predIndex(const IrBlock* block, const IrBlock* pred) {
+    return std::find(block->preds.begin(), block->preds.end(), pred) - block->preds.begin();
+}
+
+
+// Stores the set into `target` in sorted order; returns true if that changed it.
+bool storeSorted(const IrValueSet& live, std::vector<uint32_t>& target) {
+    std::vector<uint32_t> sorted = live.items();
+    std::sort(sorted.begin(), sorted.end());
+    if (sorted == target) return false;
+    target = std::move(sorted);
+    return true;
+}
+
+}
+
+
+void computeDominators(IrFunction& function) {
+    // Reverse postorder of the reachable blocks.
+    std::vector<IrBlock*> order;
+    std::vector<int> rpo_index(function.blocks.size(), -1);
+    std::vector<bool> visited(function.blocks.size(), false);
+    std::vector<std::pair<IrBlock*, size_t>> stack = {{&function.blocks.front(), 0}};
+    visited[0] = true;
+    while (!stack.empty()) {
+        auto& [block, next] = stack.back();
+        if (next < block->succs.size()) {
+            IrBlock* succ = block->succs[next++];
+            if (!visited[succ->id]) {
+                visited[succ->id] = true;
+                stack.push_back({succ, 0});
+            }
+        } else {
+            order.push_back(block);
+            stack.pop_back();
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    for (size_t i = 0; i < order.size(); ++i) rpo_index[order[i]->id] = static_cast<int>(i);
+
+    for (IrBlock& block : function.blocks) {
+        block.idom = nullptr;
+        block.dominated.clear();
+    }
+    IrBlock* entry = order.front();
+    entry->idom = entry;
+
+    auto intersect = [&](IrBlock* a, IrBlock* b) {
+        while (a != b) {
+            while (rpo_index[a->id] > rpo_index[b->id]) a = a->idom;
+            while (rpo_index[b->id] > rpo_index[a->id]) b = b->idom;
+        }
+        return a;
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < order.size(); ++i) {
+            IrBlock* block = order[i];
+            IrBlock* idom = nullptr;
+            for (IrBlock* pred : block->preds) {
+                if (!pred->idom) continue;
+                idom = idom ? intersect(pred, idom) : pred;
+            }
+            if (idom != block->idom) {
+                block->idom = idom;
+                changed = true;
+            }
+        }
+    }
+
+    entry->idom = nullptr;
+    for (size_t i = 1; i < order.size(); ++i) order[i]->idom->dominated.push_back(order[i]);
+}
+
+
+// Standard backward dataflow, iterated to a fixpoint so that it stays correct once the
+// CFG has back edges. Sets are kept sparse; only a few values are live at any point.
+void computeLiveness(IrFunction& function) {
+    for (IrBlock& block : function.blocks) {
+        block.live_in.clear();
+        block.live_out.clear();
+    }
+
+    IrValueSet live(function.valueCount());
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = function.blocks.rbegin(); it != function.blocks.rend(); ++it) {
+            IrBlock& block = *it;
+            live.clear();
+            for (IrBlock* succ : block.succs) {
+                for (uint32_t id : succ->live_in) live.insert(id);
+                size_t index = predIndex(succ, &block);
+                for (IrValue* value : succ->instructions) {
+                    if (value->op == IrOp::PHI) addUse(live, value->operands[index]);
+                }
+            }
+            if (block.terminator == IrTerminator::EXIT) {
+                for (const IrExitValue& exit : function.exit_values) addUse(live, exit.value);
+            }
+            changed |= storeSorted(live, block.live_out);
+
+            if (block.terminator == IrTerminator::BRANCH_EQ) {
+                addUse(live, block.condition[0]);
+                addUse(live, block.condition[1]);
+            }
+            for (auto value = block.instructions.rbegin(); value != block.instructions.rend(); ++value) {
+                live.erase((*value)->id);
+                if ((*value)->op == IrOp::PHI) continue;
+                for (IrValue* operand : (*value)->operands) addUse(live, operand);
+            }
+            changed |= storeSorted(live, block.live_in);
+        }
+    }
+}
+
+
+size_t eliminateDeadStores(IrFunction& function) {
+    function.renumber();
+
+    std::vector<IrValue*> worklist;
+    for (IrBlock& block : function.blocks) {
+        for (IrValue* value : block.instructions) {
+            if (value->use_count == 0) worklist.push_back(value);
+        }
+    }
+
+    std::vector<bool> dead(function.valueCount(), false);
+    size_t removed = 0;
+    while (!worklist.empty()) {
+        IrValue* value = worklist.back();
+        worklist.pop_back();
+        if (dead[value->id]) continue;
+        dead[value->id] = true;
+        if (value->op != IrOp::INITIAL) removed++;
+        for (IrValue* operand : value->operands) {
+            if (--operand->use_count == 0 && operand->op != IrOp::CONST) worklist.push_back(operand);
+        }
+    }
+
+    for (IrBlock& block : function.blocks) {
+        auto& list = block.instructions;
+        list.erase(std::remove_if(list.begin(), list.end(), [&](IrValue* value) { return dead[value->id]; }),
+                   list.end());
+    }
+    function.renumber();
+    return removed;
+}
+
+
+namespace {
+
+const char* opName(IrOp op) {
+    switch (op) {
+        case IrOp::CONST: return "const";
+        case IrOp::INITIAL: return "initial";
+        case IrOp::ADD: return "add";
+        case IrOp::SUB: return "sub";
+        case IrOp::PHI: return "phi";
+    }
+    return "?";
+}
+
+
+void printOperand(const IrValue* value, std::ostream& out) {
+    if (value->op == IrOp::CONST) {
+        out << value->constant;
+    } else {
+        out << "v" << value->id;
+    }
+}
+
+
+void printValueSet(const char* title, const std::vector<uint32_t>& set, std::ostream& out) {
+    out << "  " << title << ":";
+    for (uint32_t id : set) out << " v" << id;
+}
+
+}
+
+
+void printIr(const IrFunction& function, std::ostream& out) {
+    for (const IrBlock& block : function.blocks) {
+        out << "bb" << block.id << ":";
+        if (!block.preds.empty()) {
+            out << "  ; preds:";
+            for (const IrBlock* pred : block.preds) out << " bb" << pred->id;
+        }
+        if (!block.live_in.empty()) {
+            out << (block.preds.empty() ? "  ;" : "");
+            printValueSet("live-in", block.live_in, out);
+        }
+        out << "\n";
+
+        for (const IrValue* value : block.instructions) {
+            out << "    v" << value->id << " = " << opName(value->op);
+            if (value->op == IrOp::INITIAL) {
+                out << " " << function.slot_names[value->slot];
+            } else if (value->op == IrOp::PHI) {
+                for (size_t i = 0; i < value->operands.size(); ++i) {
+                    out << (i ? ", [" : " [");
+                    printOperand(value->operands[i], out);
+                    out << ", bb" << block.preds[i]->id << "]";
+                }
+            } else {
+                for (size_t i = 0; i < value->operands.size(); ++i) {
+                    out << (i ? ", " : " ");
+                    printOperand(value->operands[i], out);
+                }
+            }
+            if (value->slot >= 0 && value->op != IrOp::INITIAL) out << "  ; " << function.slot_names[value->slot];
+            out << "\n";
+        }
+
+        switch (block.terminator) {
+            case IrTerminator::JUMP:
+                out << "    jump bb" << block.succs[0]->id << "\n";
+                break;
+            case IrTerminator::BRANCH_EQ:
+                out << "    branch ";
+                printOperand(block.condition[0], out);
+                out << " == ";
+                printOperand(block.condition[1], out);
+                out << ", bb" << block.succs[0]->id << ", bb" << block.succs[1]->id << "\n";
+                break;
+            case IrTerminator::EXIT:
+                out << "    exit";
+                for (size_t i = 0; i < function.exit_values.size(); ++i) {
+                    const IrExitValue& exit = function.exit_values[i];
+                    out << (i ? ", " : " ") << function.slot_names[exit.slot] << " = ";
+                    printOperand(exit.value, out);
+                }
+                out << "\n";
+                break;
+        }
+    }
+}
@@ -0,0 +1,160 @@
+#ifndef IR_H
+#define IR_H
+
+
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+
+// Three-address SSA form of a program. Every declared variable is a slot; assignments
+// do not store to memory but just make a new value the slot's current definition, and
+// the exit block lists which value each live-out slot ends up holding. The backend
+// (IrBackend.h) decides where values live and emits the stores.
+
+
+enum class IrOp : uint8_t {
+    CONST,      // `constant`; not placed in any block
+    INITIAL,    // value of slot `slot` on entry, which is 0 since memory starts zeroed
+    ADD,
+    SUB,
+    PHI         // one operand per predecessor, in the order of IrBlock::preds
+};
+
+
+struct IrBlock;
+
+
+struct IrValue {
+    IrOp op;
+    uint32_t id = 0;
+    IrBlock* block = nullptr;
+    int constant = 0;
+    // The variable this value was first assigned to, or -1 for temporaries. The backend
+    // prefers to keep a value in its variable's home address.
+    int slot = -1;
+    // Source offset of the statement that computed the value; UINT32_MAX if none.
+    uint32_t source = UINT32_MAX;
+    std::vector<IrValue*> operands;
+    uint32_t use_count = 0;
+    // Set when a trivial phi is removed during construction; resolved away afterwards.
+    IrValue* replacement = nullptr;
+
+    explicit IrValue(IrOp op) : op(op) {}
+};
+
+
+enum class IrTerminator : uint8_t {
+    JUMP,       // succs[0]
+    BRANCH_EQ,  // succs[0] if condition[0] == condition[1], else succs[1]
+    EXIT
+};
+
+
+struct IrBlock {
+    uint32_t id = 0;
+    std::vector<IrValue*> instructions;    // phis first
+    std::vector<IrBlock*> preds;
+    std::vector<IrBlock*> succs;
+    IrTerminator terminator = IrTerminator::EXIT;
+    IrValue* condition[2] = {nullptr, nullptr};
+    // Source offset of the statement the terminator belongs to; UINT32_MAX if none.
+    uint32_t source = UINT32_MAX;
+
+    // Filled in by computeDominators().
+    IrBlock* idom = nullptr;
+    std::vector<IrBlock*> dominated;
+
+    // Filled in by computeLiveness(): sorted ids of the values live at block entry/exit.
+    std::vector<uint32_t> live_in;
+    std::vector<uint32_t> live_out;
+};
+
+
+// Set of value ids with constant-time insert, erase and lookup, and iteration over
+// just the members.
+class IrValueSet {
+public:
+    explicit IrValueSet(size_t universe = 0) : position(universe, NONE) {}
+
+    void insert(uint32_t id) {
+        if (position[id] != NONE) return;
+        position[id] = static_cast<uint32_t>(members.size());
+        members.push_back(id);
+    }
+
+    void erase(uint32_t id) {
+        if (position[id] == NONE) return;
+        uint32_t last = members.back();
+        members[position[id]] = last;
+        position[last] = position[id];
+        members.pop_back();
+        position[id] = NONE;
+    }
+
+    bool contains(uint32_t id) const { return position[id] != NONE; }
+
+    void clear() {
+        for (uint32_t id : members) position[id] = NONE;
+        members.clear();
+    }
+
+    const std::vector<uint32_t>& items() const { return members; }
+
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+    std::vector<uint32_t> members;
+    std::vector<uint32_t> position;
+};
+
+
+struct IrExitValue {
+    int slot;
+    IrValue* value;
+};
+
+
+struct IrFunction {
+    std::deque<IrBlock> blocks;     // blocks[0] is the entry; deque keeps pointers stable
+    std::deque<IrValue> values;
+    std::vector<std::string> slot_names;
+    std::vector<bool> slot_live_out;
+    std::vector<IrExitValue> exit_values;  // one per live-out slot, used by the EXIT block
+
+    IrBlock* newBlock();
+    IrValue* newValue(IrOp op, IrBlock* block);
+    IrValue* constant(int value);
+    // Number of ids handed out by the last renumber().
+    size_t valueCount() const { return value_count; }
+
+    // Gives the values still reachable from blocks dense ids in layout order and
+    // recomputes use counts. Values dropped by passes stay allocated but unnumbered.
+    void renumber();
+
+
+private:
+    std::vector<IrValue*> constants;    // indexed by value, created on first use
+    size_t value_count = 0;
+};
+
+
+// Computes IrBlock::idom and the dominator tree children in IrBlock::dominated, using
+// the iterative algorithm of Cooper, Harvey and Kennedy over reverse postorder.
+void computeDominators(IrFunction& function);
+
+// Computes IrBlock::live_in/live_out for every SSA value that is not a constant. A phi
+// operand is live out of the matching predecessor only, not into the phi's block.
+void computeLiveness(IrFunction& function);
+
+// Removes values that no instruction, terminator or live-out slot uses. Since
+// assignments are SSA definitions, this drops stores to variables that are overwritten
+// or never read. Returns the number of values removed.
+size_t eliminateDeadStores(IrFunction& function);
+
+void printIr(const IrFunction& function, std::ostream& out);
+
+
+#endif
@@ -0,0 +1,400 @@
+#include "IrBackend.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+namespace {
+
+// A copy source is either a constant or a memory location.
+struct CopySource {
+    bool is_constant;
+    int value;
+};
+
+
+struct Copy {
+    int destination;
+    CopySource source;
+};
+
+
+class IrBackend {
+public:
+    IrBackend(IrFunction& function, IrBackendOptions options)
+        : function(function), options(options), code(options.annotate) {}
+
+
+    AsmBuffer run() {
+        function.renumber();
+        computeLiveness(function);
+        chooseInlined();
+        buildInterference();
+        assignLocations();
+        return emit();
+    }
+
+
+private:
+    IrFunction& function;
+    IrBackendOptions options;
+    std::vector<bool> inlined;                      // by value id
+    std::vector<int> location;                      // by value id, -1 if none
+    std::vector<std::vector<uint32_t>> interferes;  // by value id
+
+
+    bool materialized(const IrValue* value) const {
+        return value->op != IrOp::CONST && !inlined[value->id];
+    }
+
+
+    // A value is evaluated in registers at its only use when that use is an arithmetic
+    // instruction or the branch of the same block.
+    void chooseInlined() {
+        size_t count = function.valueCount();
+        inlined.assign(count, false);
+        auto consider = [&](IrValue* operand, const IrBlock& block) {
+            if (operand->use_count != 1 || operand->block != &block) return;
+            if (operand->op == IrOp::ADD || operand->op == IrOp::SUB) inlined[operand->id] = true;
+        };
+        for (IrBlock& block : function.blocks) {
+            for (IrValue* value : block.instructions) {
+                if (value->op == IrOp::PHI) continue;
+                for (IrValue* operand : value->operands) consider(operand, block);
+            }
+            if (block.terminator == IrTerminator::BRANCH_EQ) {
+                consider(block.condition[0], block);
+                consider(block.condition[1], block);
+            }
+        }
+    }
+
+
+    // Adds the materialized values an expression reads, looking through inlined ones.
+    void addLeaves(IrValue* value, IrValueSet& live) const {
+        if (value->op == IrOp::CONST) return;
+        if (!inlined[value->id]) {
+            live.insert(value->id);
+            return;
+        }
+        for (IrValue* operand : value->operands) addLeaves(operand, live);
+    }
+
+
+    void addInterference(uint32_t a, uint32_t b) {
+        if (a == b) return;
+        interferes[a].push_back(b);
+        interferes[b].push_back(a);
+    }
+
+
+    // Walks each block backwards from its live-out set. The operands of an inlined value
+    // are read where the value is used, so they stay live until then.
+    void buildInterference() {
+        size_t count = function.valueCount();
+        interferes.assign(count, {});
+        IrValueSet live(count);
+        for (IrBlock& block : function.blocks) {
+            live.clear();
+            for (uint32_t id : block.live_out) live.insert(id);
+            if (block.terminator == IrTerminator::BRANCH_EQ) {
+                addLeaves(block.condition[0], live);
+                addLeaves(block.condition[1], live);
+            }
+
+            std::vector<uint32_t> phis;
+            for (auto it = block.instructions.rbegin(); it != block.instructions.rend(); ++it) {
+                IrValue* value = *it;
+                if (value->op == IrOp::PHI) {
+                    phis.push_back(value->id);
+                    continue;
+                }
+                if (inlined[value->id]) continue;
+                live.erase(value->id);
+                for (uint32_t other : live.items()) addInterference(value->id, other);
+                for (IrValue* operand : value->operands) addLeaves(operand, live);
+            }
+
+            // Phis are written together on each incoming edge, while everything live into
+            // the block is still needed.
+            for (uint32_t phi : phis) live.erase(phi);
+            for (size_t i = 0; i < phis.size(); ++i) {
+                for (uint32_t other : live.items()) addInterference(phis[i], other);
+                for (size_t j = i + 1; j < phis.size(); ++j) addInterference(phis[i], phis[j]);
+            }
+        }
+    }
+
+
+    // Greedy assignment in layout order. Entry values already sit in their variable's
+    // home; everything else tries its variable's home, then (for phis) an operand's
+    // location, then the lowest free address above the variables.
+    void assignLocations() {
+        size_t count = function.valueCount();
+        location.assign(count, -1);
+        int first_temp = static_cast<int>(function.slot_names.size());
+        if (first_temp > options.data_limit) {
+            throw std::runtime_error("IrBackend Error: Out of memory for variables");
+        }
+        // No value is ever placed above first_temp + count, so that is all that needs
+        // clearing per value, however large the memory.
+        size_t tracked = static_cast<size_t>(std::min<int64_t>(options.data_limit, int64_t{first_temp} + count + 1));
+        std::vector<bool> taken;
+
+        for (IrBlock& block : function.blocks) {
+            for (IrValue* value : block.instructions) {
+                if (!materialized(value)) continue;
+                if (value->op == IrOp::INITIAL) {
+                    location[value->id] = value->slot;
+                    continue;
+                }
+
+                taken.assign(tracked, false);
+                for (uint32_t other : interferes[value->id]) {
+                    if (location[other] >= 0) taken[location[other]] = true;
+                }
+                std::vector<int> candidates;
+                if (value->slot >= 0) candidates.push_back(value->slot);
+                if (value->op == IrOp::PHI) {
+                    for (IrValue* operand : value->operands) {
+                        if (operand->op != IrOp::CONST && location[operand->id] >= 0) {
+                            candidates.push_back(location[operand->id]);
+                        }
+                    }
+                }
+                for (int candidate : candidates) {
+                    if (!taken[candidate]) {
+                        location[value->id] = candidate;
+                        break;
+                    }
+                }
+                if (location[value->id] >= 0) continue;
+
+                int address = first_temp;
+                while (address < static_cast<int>(tracked) && taken[address]) address++;
+                if (address >= options.data_limit) {
+                    throw std::runtime_error("IrBackend Error: Out of memory for temporaries");
+                }
+                location[value->id] = address;
+            }
+        }
+    }
+
+
+    AsmBuffer code;
+    std::vector<LabelId> block_labels;  // by block id
+
+
+    // Loads a value into A, computing it if it was inlined.
+    void emitValue(IrValue* value) {
+        if (value->op == IrOp::CONST) {
+            code.emit(Opcode::LDI, Reg::A, static_cast<uint16_t>(value->constant));
+        } else if (!inlined[value->id]) {
+            code.emit(Opcode::LDA, Reg::A, static_cast<uint16_t>(location[value->id]));
+        } else {
+            emitArithmetic(value);
+        }
+    }
+
+
+    void emitArithmetic(IrValue* value) {
+        emitOperands(value->operands[0], value->operands[1], value->op == IrOp::ADD);
+        code.emit(value->op == IrOp::ADD ? Opcode::ADD : Opcode::SUB);
+    }
+
+
+    // Leaves `left` in A and `right` in B, in the same order CodeGenerator uses for AST
+    // operands. Constants and materialized values can be loaded without touching B.
+    void emitOperands(IrValue* left, IrValue* right, bool commutative) {
+        bool left_leaf = !inlined[left->id];
+        bool right_leaf = !inlined[right->id];
+        if (right->op == IrOp::CONST) {
+            emitValue(left);
+            code.emit(Opcode::LDI, Reg::B, static_cast<uint16_t>(right->constant));
+        } else if (right_leaf) {
+            if (left_leaf) {
+                emitValue(right);
+                emitMove(Reg::B, Reg::A);
+                emitValue(left);
+            } else if (commutative) {
+                emitValue(left);
+                emitMove(Reg::B, Reg::A);
+                emitValue(right);
+            } else {
+                emitValue(left);
+                code.emit(Opcode::PUSH, Reg::A);
+                emitValue(right);
+                emitMove(Reg::B, Reg::A);
+                code.emit(Opcode::POP, Reg::A);
+            }
+        } else if (left_leaf) {
+            emitValue(right);
+            emitMove(Reg::B, Reg::A);
+            emitValue(left);
+        } else {
+            emitValue(right);
+            code.emit(Opcode::PUSH, Reg::A);
+            emitValue(left);
+            code.emit(Opcode::POP, Reg::B);
+        }
+    }
+
+
+    void emitMove(Reg destination, Reg source) {
+        code.emit(Opcode::MOV, destination, static_cast<uint16_t>(source));
+    }
+
+
+    CopySource sourceOf(const IrValue* value) const {
+        if (value->op == IrOp::CONST) return {true, value->constant};
+        return {false, location[value->id]};
+    }
+
+
+    // Performs all copies as if at once. A copy is emitted once nothing still needs to
+    // read its destination; when only cycles remain, one value is parked in B.
+    void emitParallelCopy(std::vector<Copy> copies) {
+        copies.erase(std::remove_if(copies.begin(), copies.end(), [](const Copy& copy) {
+            return !copy.source.is_constant && copy.source.value == copy.destination;
+        }), copies.end());
+
+        const int IN_B = -1;
+        while (!copies.empty()) {
+            bool progressed = false;
+            for (size_t i = 0; i < copies.size(); ++i) {
+                int destination = copies[i].destination;
+                bool still_read = std::any_of(copies.begin(), copies.end(), [&](const Copy& other) {
+                    return !other.source.is_constant && other.source.value == destination;
+                });
+                if (still_read) continue;
+
+                const CopySource& source = copies[i].source;
+                if (source.is_constant) {
+                    code.emit(Opcode::LDI, Reg::A, static_cast<uint16_t>(source.value));
+                } else if (source.value == IN_B) {
+                    emitMove(Reg::A, Reg::B);
+                } else {
+                    code.emit(Opcode::LDA, Reg::A, static_cast<uint16_t>(source.value));
+                }
+                code.emit(Opcode::STA, Reg::A, static_cast<uint16_t>(destination));
+                copies.erase(copies.begin() + i);
+                progressed = true;
+                break;
+            }
+            if (progressed) continue;
+
+            int parked = copies.front().destination;
+            code.emit(Opcode::LDA, Reg::A, static_cast<uint16_t>(parked));
+            emitMove(Reg::B, Reg::A);
+            for (Copy& copy : copies) {
+                if (!copy.source.is_constant && copy.source.value == parked) copy.source.value = IN_B;
+            }
+        }
+    }
+
+
+    std::vector<Copy> edgeCopies(const IrBlock* from, const IrBlock* to) const {
+        std::vector<Copy> copies;
+        size_t index = std::find(to->preds.begin(), to->preds.end(), from) - to->preds.begin();
+        for (IrValue* value : to->instructions) {
+            if (value->op != IrOp::PHI || !materialized(value)) continue;
+            CopySource source = sourceOf(value->operands[index]);
+            if (source.is_constant || source.value != location[value->id]) {
+                copies.push_back({location[value->id], source});
+            }
+        }
+        return copies;
+    }
+
+
+    // Every block gets a label up front; the ones no jump uses are dropped at the end.
+    // Copies for the not-equal edge of a branch go in a stub after all the blocks.
+    AsmBuffer emit() {
+        struct Stub {
+            LabelId label;
+            std::vector<Copy> copies;
+            const IrBlock* target;
+            uint32_t source;
+        };
+        std::vector<Stub> stubs;
+
+        if (code.keepsComments()) {
+            for (size_t slot = 0; slot < function.slot_names.size(); ++slot) {
+                code.comment("Variable '" + function.slot_names[slot] + "' allocated at address " + std::to_string(slot));
+            }
+        }
+        size_t block_count = function.blocks.size();
+        block_labels.resize(block_count);
+        for (size_t b = 0; b < block_count; ++b) block_labels[b] = code.newLabel();
+
+        for (size_t b = 0; b < block_count; ++b) {
+            IrBlock& block = function.blocks[b];
+            const IrBlock* next = b + 1 < block_count ? &function.blocks[b + 1] : nullptr;
+            code.bind(block_labels[b]);
+
+            for (IrValue* value : block.instructions) {
+                if (value->op != IrOp::ADD && value->op != IrOp::SUB) continue;
+                if (inlined[value->id]) continue;
+                code.setSource(value->source);
+                emitArithmetic(value);
+                code.emit(Opcode::STA, Reg::A, static_cast<uint16_t>(location[value->id]));
+                if (value->slot >= 0 && code.keepsComments()) code.annotate(function.slot_names[value->slot]);
+            }
+
+            code.setSource(block.source);
+            switch (block.terminator) {
+                case IrTerminator::JUMP: {
+                    const IrBlock* target = block.succs[0];
+                    emitParallelCopy(edgeCopies(&block, target));
+                    if (target != next) code.emitJump(Opcode::JMP, block_labels[target->id]);
+                    break;
+                }
+                case IrTerminator::BRANCH_EQ: {
+                    const IrBlock* taken = block.succs[0];
+                    const IrBlock* other = block.succs[1];
+                    emitOperands(block.condition[0], block.condition[1], true);
+                    code.emit(Opcode::CMP);
+
+                    std::vector<Copy> other_copies = edgeCopies(&block, other);
+                    if (other_copies.empty()) {
+                        code.emitJump(Opcode::JNE, block_labels[other->id]);
+                    } else {
+                        LabelId stub = code.newLabel("L" + std::to_string(block.id) + "_" + std::to_string(other->id));
+                        code.emitJump(Opcode::JNE, stub);
+                        stubs.push_back({stub, std::move(other_copies), other, block.source});
+                    }
+                    code.annotate("Jump if not equal");
+                    emitParallelCopy(edgeCopies(&block, taken));
+                    if (taken != next) code.emitJump(Opcode::JMP, block_labels[taken->id]);
+                    break;
+                }
+                case IrTerminator::EXIT: {
+                    std::vector<Copy> copies;
+                    for (const IrExitValue& exit : function.exit_values) {
+                        copies.push_back({exit.slot, sourceOf(exit.value)});
+                    }
+                    emitParallelCopy(copies);
+                    code.emit(Opcode::HLT);
+                    break;
+                }
+            }
+        }
+
+        for (Stub& stub : stubs) {
+            code.bind(stub.label);
+            code.setSource(stub.source);
+            emitParallelCopy(std::move(stub.copies));
+            code.emitJump(Opcode::JMP, block_labels[stub.target->id]);
+        }
+        code.removeUnusedLabels();
+        return std::move(code);
+    }
+};
+
+}
+
+
+AsmBuffer emitAssembly(IrFunction& function, IrBackendOptions options) {
+    return IrBackend(function, options).run();
+}
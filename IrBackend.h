@@ -0,0 +1,26 @@
+#ifndef IR_BACKEND_H
+#define IR_BACKEND_H
+
+
+#include "AsmBuffer.h"
+#include "Ir.h"
+
+
+struct IrBackendOptions {
+    // First address the backend may not use for temporaries; the CPU's stack starts here.
+    int data_limit = MachineModel().dataLimit();
+    // Record variable names and addresses as comments, for --emit=asm.
+    bool annotate = false;
+};
+
+
+// Emits 8-bit CPU assembly from SSA form. Slot n lives at address n, as with
+// CodeGenerator. Single-use values are folded into the expression that uses them and
+// evaluated in registers; every other value gets a memory location, chosen so that
+// values that are live at the same time never share one, preferring the home address
+// of the variable the value was assigned to. Phis and the final values of live-out
+// variables turn into copies on the incoming edges and before hlt.
+AsmBuffer emitAssembly(IrFunction& function, IrBackendOptions options = IrBackendOptions());
+
+
+#endif
@@ -0,0 +1,373 @@
+#include "IrBuilder.h"
+#include "AstVisitor.h"
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace {
+
+// Declarations in `statements`, nested ones included: the slots the program's own
+// variables take.
+size_t countDeclarations(const NodeList<Statement>& statements) {
+    size_t count = 0;
+    for (const Statement* stmt : statements) {
+        switch (stmt->kind) {
+            case NodeKind::VAR_DECL: count++; break;
+            case NodeKind::BLOCK_STATEMENT: count += countDeclarations(static_cast<const BlockStatement*>(stmt)->statements); break;
+            case NodeKind::IF_STATEMENT: count += countDeclarations(static_cast<const IfStatement*>(stmt)->body->statements); break;
+            case NodeKind::WHILE_STATEMENT: count += countDeclarations(static_cast<const WhileStatement*>(stmt)->body->statements); break;
+            default: break;
+        }
+    }
+    return count;
+}
+
+
+class IrBuilder : private AstVisitor<IrBuilder, IrValue*> {
+public:
+    IrBuilder(const SymbolTable& symbols, IrFunction& function) : symbols(symbols), function(function) {}
+
+
+    void build(const Program& program, const std::vector<std::string>& live_out) {
+        symbol_slots.assign(symbols.size(), -1);
+        // Temporaries take the slots after the program's variables, as in CodeGenerator.
+        size_t first_temporary = countDeclarations(program.statements);
+        for (uint32_t i = 0; i < program.temporaries.count; ++i) {
+            symbol_slots[program.temporaries[i]->symbol] = static_cast<int>(first_temporary + i);
+        }
+        current = newBlock();
+        seal(current);
+        visit(&program);
+        for (const VarDecl* temporary : program.temporaries) function.slot_names.emplace_back(symbols.name(temporary->symbol));
+
+        current->terminator = IrTerminator::EXIT;
+        for (const std::string& name : live_out) {
+            if (std::find(function.slot_names.begin(), function.slot_names.end(), name) == function.slot_names.end()) {
+                throw std::runtime_error("IrBuilder Error: Live-out variable '" + name + "' is not declared");
+            }
+        }
+        function.slot_live_out.assign(function.slot_names.size(), false);
+        for (size_t slot = 0; slot < function.slot_names.size(); ++slot) {
+            const std::string& name = function.slot_names[slot];
+            if (!live_out.empty() && std::find(live_out.begin(), live_out.end(), name) == live_out.end()) continue;
+            function.slot_live_out[slot] = true;
+            function.exit_values.push_back({static_cast<int>(slot), readVariable(static_cast<int>(slot), current)});
+        }
+        removeTrivialPhis();
+        function.renumber();
+    }
+
+
+private:
+    const SymbolTable& symbols;
+    IrFunction& function;
+    IrBlock* current = nullptr;
+    // Source offset of the statement being lowered.
+    uint32_t statement = UINT32_MAX;
+    std::vector<int> symbol_slots;      // indexed by SymbolId, -1 if undeclared
+    std::vector<IrValue*> initials;     // indexed by slot
+
+    // Per block, indexed by IrBlock::id.
+    std::vector<std::vector<IrValue*>> definitions;     // then by slot
+    std::vector<bool> sealed;
+    std::vector<std::vector<IrValue*>> incomplete_phis;
+
+    friend class AstVisitor<IrBuilder, IrValue*>;
+
+
+    IrBlock* newBlock() {
+        IrBlock* block = function.newBlock();
+        definitions.emplace_back();
+        sealed.push_back(false);
+        incomplete_phis.emplace_back();
+        return block;
+    }
+
+
+    static void addEdge(IrBlock* from, IrBlock* to) {
+        from->succs.push_back(to);
+        to->preds.push_back(from);
+    }
+
+
+    static IrValue* resolve(IrValue* value) {
+        while (value->replacement) value = value->replacement;
+        return value;
+    }
+
+
+    void writeVariable(int slot, IrBlock* block, IrValue* value) {
+        std::vector<IrValue*>& defs = definitions[block->id];
+        if (defs.size() <= static_cast<size_t>(slot)) defs.resize(slot + 1, nullptr);
+        defs[slot] = value;
+    }
+
+
+    IrValue* readVariable(int slot, IrBlock* block) {
+        const std::vector<IrValue*>& defs = definitions[block->id];
+        if (static_cast<size_t>(slot) < defs.size() && defs[slot]) return resolve(defs[slot]);
+        return readVariableRecursive(slot, block);
+    }
+
+
+    IrValue* readVariableRecursive(int slot, IrBlock* block) {
+        IrValue* value;
+        if (!sealed[block->id]) {
+            // More predecessors may still be added; the operands are filled in by seal().
+            value = newPhi(slot, block);
+            incomplete_phis[block->id].push_back(value);
+        } else if (block->preds.empty()) {
+            value = initial(slot);
+        } else if (block->preds.size() == 1) {
+            value = readVariable(slot, block->preds[0]);
+        } else {
+            // Break cycles through loops by defining the phi before reading its operands.
+            IrValue* phi = newPhi(slot, block);
+            writeVariable(slot, block, phi);
+            value = addPhiOperands(phi);
+        }
+        writeVariable(slot, block, value);
+        return value;
+    }
+
+
+    IrValue* newPhi(int slot, IrBlock* block) {
+        IrValue* phi = function.newValue(IrOp::PHI, block);
+        phi->slot = slot;
+        auto& list = block->instructions;
+        auto position = std::find_if(list.begin(), list.end(), [](IrValue* v) { return v->op != IrOp::PHI; });
+        list.insert(position, phi);
+        return phi;
+    }
+
+
+    IrValue* addPhiOperands(IrValue* phi) {
+        for (IrBlock* pred : phi->block->preds) {
+            phi->operands.push_back(readVariable(phi->slot, pred));
+        }
+        return tryRemoveTrivialPhi(phi);
+    }
+
+
+    // A phi whose operands are all the same value (or the phi itself) is replaced by
+    // that value. Phis that become trivial as a result are cleaned up by
+    // removeTrivialPhis() once construction is done.
+    IrValue* tryRemoveTrivialPhi(IrValue* phi) {
+        IrValue* same = nullptr;
+        for (IrValue* operand : phi->operands) {
+            operand = resolve(operand);
+            if (operand == same || operand == phi) continue;
+            if (same) return phi;
+            same = operand;
+        }
+        if (!same) same = initial(phi->slot);
+        phi->replacement = same;
+        auto& list = phi->block->instructions;
+        list.erase(std::find(list.begin(), list.end(), phi));
+        return same;
+    }
+
+
+    void seal(IrBlock* block) {
+        for (IrValue* phi : incomplete_phis[block->id]) addPhiOperands(phi);
+        incomplete_phis[block->id].clear();
+        sealed[block->id] = true;
+    }
+
+
+    IrValue* initial(int slot) {
+        if (initials.size() <= static_cast<size_t>(slot)) initials.resize(slot + 1, nullptr);
+        if (!initials[slot]) {
+            IrBlock* entry = &function.blocks.front();
+            IrValue* value = function.newValue(IrOp::INITIAL, entry);
+            value->slot = slot;
+            entry->instructions.insert(entry->instructions.begin(), value);
+            initials[slot] = value;
+        }
+        return initials[slot];
+    }
+
+
+    void removeTrivialPhis() {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (IrBlock& block : function.blocks) {
+                for (size_t i = 0; i < block.instructions.size(); ++i) {
+                    IrValue* value = block.instructions[i];
+                    for (IrValue*& operand : value->operands) operand = resolve(operand);
+                    if (value->op == IrOp::PHI && tryRemoveTrivialPhi(value) != value) {
+                        changed = true;
+                        --i;
+                    }
+                }
+            }
+        }
+        for (IrBlock& block : function.blocks) {
+            for (IrValue*& operand : block.condition) {
+                if (operand) operand = resolve(operand);
+            }
+        }
+        for (IrExitValue& exit : function.exit_values) exit.value = resolve(exit.value);
+    }
+
+
+    int slotOf(SymbolId symbol) const {
+        if (symbol_slots[symbol] < 0) {
+            throw std::runtime_error("IrBuilder Error: Undeclared variable '" + std::string(symbols.name(symbol)) + "'");
+        }
+        return symbol_slots[symbol];
+    }
+
+
+    IrValue* visit(const Program* program) {
+        for (const Statement* stmt : program->statements) visit(stmt);
+        return nullptr;
+    }
+
+
+    IrValue* visit(const Statement* stmt) {
+        statement = stmt->offset;
+        return dispatch(stmt);
+    }
+    IrValue* visit(const Expression* expr) { return dispatch(expr); }
+
+
+    IrValue* visit(const VarDecl* stmt) {
+        symbol_slots[stmt->symbol] = static_cast<int>(function.slot_names.size());
+        function.slot_names.emplace_back(symbols.name(stmt->symbol));
+        return nullptr;
+    }
+
+
+    IrValue* visit(const Assignment* stmt) {
+        IrValue* value = visit(stmt->value);
+        int slot = slotOf(stmt->symbol);
+        if (value->slot < 0 && value->op != IrOp::CONST) value->slot = slot;
+        writeVariable(slot, current, value);
+        return nullptr;
+    }
+
+
+    const BinaryOp* comparison(const Expression* condition, const char* statement) const {
+        auto compare = static_cast<const BinaryOp*>(condition);
+        if (condition->kind != NodeKind::BINARY_OP ||
+            (compare->op != BinaryOperator::EQUAL && compare->op != BinaryOperator::NOT_EQUAL)) {
+            throw std::runtime_error(std::string("IrBuilder Error: ") + statement +
+                                     " condition must be an '==' or '!=' comparison");
+        }
+        return compare;
+    }
+
+
+    // Successors are added as (condition holds, condition fails). BRANCH_EQ takes
+    // succs[0] on equality, so for `!=` they swap.
+    static void orderSuccessors(IrBlock* block, const BinaryOp* condition) {
+        if (condition->op == BinaryOperator::NOT_EQUAL) std::swap(block->succs[0], block->succs[1]);
+    }
+
+
+    IrValue* visit(const IfStatement* stmt) {
+        const BinaryOp* condition = comparison(stmt->condition, "If");
+        IrBlock* head = current;
+        head->terminator = IrTerminator::BRANCH_EQ;
+        head->source = stmt->offset;
+        head->condition[0] = visit(condition->left);
+        head->condition[1] = visit(condition->right);
+
+        IrBlock* body = newBlock();
+        addEdge(head, body);
+        seal(body);
+        current = body;
+        visit(stmt->body);
+        IrBlock* body_end = current;
+        body_end->terminator = IrTerminator::JUMP;
+        body_end->source = stmt->offset;
+
+        IrBlock* join = newBlock();
+        addEdge(head, join);
+        addEdge(body_end, join);
+        seal(join);
+        current = join;
+        orderSuccessors(head, condition);
+        return nullptr;
+    }
+
+
+    // Laid out as entry, body, test, exit: the entry jumps to the test, which branches
+    // back to the body. The body is generated before the test exists, so it stays
+    // unsealed, and its reads become phis, until the back edge is known.
+    IrValue* visit(const WhileStatement* stmt) {
+        const BinaryOp* condition = comparison(stmt->condition, "While");
+        IrBlock* entry = current;
+        entry->terminator = IrTerminator::JUMP;
+        entry->source = stmt->offset;
+
+        IrBlock* body = newBlock();
+        current = body;
+        visit(stmt->body);
+        IrBlock* body_end = current;
+        body_end->terminator = IrTerminator::JUMP;
+        body_end->source = stmt->offset;
+
+        IrBlock* test = newBlock();
+        addEdge(entry, test);
+        addEdge(body_end, test);
+        seal(test);
+        current = test;
+        statement = stmt->offset;
+        test->source = stmt->offset;
+        test->condition[0] = visit(condition->left);
+        test->condition[1] = visit(condition->right);
+
+        IrBlock* exit = newBlock();
+        test->terminator = IrTerminator::BRANCH_EQ;
+        addEdge(test, body);
+        addEdge(test, exit);
+        orderSuccessors(test, condition);
+        seal(body);
+        seal(exit);
+        current = exit;
+        return nullptr;
+    }
+
+
+    IrValue* visit(const BlockStatement* stmt) {
+        for (const Statement* statement : stmt->statements) visit(statement);
+        return nullptr;
+    }
+
+
+    IrValue* visit(const NumberLiteral* expr) {
+        return function.constant(expr->value);
+    }
+
+
+    IrValue* visit(const Identifier* expr) {
+        return readVariable(slotOf(expr->symbol), current);
+    }
+
+
+    IrValue* visit(const BinaryOp* expr) {
+        IrValue* left = visit(expr->left);
+        IrValue* right = visit(expr->right);
+        // Used as a value, `==` and `!=` leave the left operand in A, the same as CodeGenerator.
+        if (expr->op == BinaryOperator::EQUAL || expr->op == BinaryOperator::NOT_EQUAL) return left;
+
+        IrValue* value = function.newValue(expr->op == BinaryOperator::ADD ? IrOp::ADD : IrOp::SUB, current);
+        value->operands = {left, right};
+        value->source = statement;
+        current->instructions.push_back(value);
+        return value;
+    }
+};
+
+}
+
+
+std::unique_ptr<IrFunction> buildIr(const Program& program, const SymbolTable& symbols,
+                                    const std::vector<std::string>& live_out) {
+    auto function = std::make_unique<IrFunction>();
+    IrBuilder(symbols, *function).build(program, live_out);
+    return function;
+}
@@ -0,0 +1,25 @@
+#ifndef IR_BUILDER_H
+#define IR_BUILDER_H
+
+
+#include "ast.h"
+#include "Ir.h"
+#include "SymbolTable.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// Lowers a program into SSA form, building phis on the fly as in Braun et al., "Simple
+// and Efficient Construction of Static Single Assignment Form": each block records the
+// current value of every slot, reads walk up the predecessors, and phis are only placed
+// where two different values meet. Every declaration gets its own slot, numbered in the
+// order CodeGenerator assigns addresses.
+//
+// `live_out` names the variables whose final values must end up in memory; when it is
+// empty, every declared variable is live out.
+std::unique_ptr<IrFunction> buildIr(const Program& program, const SymbolTable& symbols,
+                                    const std::vector<std::string>& live_out = {});
+
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef ISA_H
+#define ISA_H
+
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Instruction set of the 8-bit CPU, as executed by CPU and produced by the code
+// generators.
+enum class Opcode : uint8_t {
+    LDI,    // reg = operand
+    LDA,    // A = memory[operand]
+    STA,    // memory[operand] = A
+    MOV,    // reg = register `operand`
+    ADD,    // A = A + B
+    SUB,    // A = A - B
+    CMP,    // flags from A - B
+    JMP,    // pc = operand
+    JNE,    // pc = operand unless the zero flag is set
+    PUSH,   // memory[sp--] = reg
+    POP,    // reg = memory[++sp]
+    HLT
+};
+
+constexpr unsigned OPCODE_COUNT = static_cast<unsigned>(Opcode::HLT) + 1;
+
+
+enum class Reg : uint8_t {
+    A,
+    B
+};
+
+
+// One decoded instruction. Jump operands are instruction indices once assembled.
+struct MachineInstr {
+    Opcode op;
+    Reg reg;
+    uint16_t operand;
+};
+
+static_assert(sizeof(MachineInstr) == 4, "MachineInstr should stay packed in 4 bytes");
+
+
+// Instructions the 16-bit program counter can address. A longer program can be loaded,
+// but execution wraps from the last of these back to instruction 0.
+constexpr size_t MAX_PROGRAM_SIZE = 65536;
+
+
+// Size of the simulated machine. Memory operands are 16 bits wide and wrap at the
+// memory size, which is a power of two from 256 to 65536 bytes. The stack takes the
+// top `stack_size` bytes; variables and temporaries are allocated below it.
+struct MachineModel {
+    uint32_t memory_size = 256;
+    uint32_t stack_size = 32;
+
+    bool valid() const {
+        return memory_size >= 256 && memory_size <= 65536 && (memory_size & (memory_size - 1)) == 0 &&
+               stack_size > 0 && stack_size < memory_size;
+    }
+    // First address past the data area, where the stack starts.
+    uint32_t dataLimit() const { return memory_size - stack_size; }
+    uint16_t addressMask() const { return static_cast<uint16_t>(memory_size - 1); }
+};
+
+
+// Cycles each opcode takes on the modeled hardware: memory and stack operations cost
+// more than register ones. Opcodes outside the ISA run as one-cycle no-ops. Costs are
+// kept small enough that a straight run of the whole program fits in 32 bits.
+struct CycleCosts {
+    static constexpr unsigned MAX_CYCLES = 50;
+
+    // Indexed by opcode: lda, sta, push and pop take 3, jmp and jne 2, the rest 1.
+    uint8_t cycles[OPCODE_COUNT] = {1, 3, 3, 1, 1, 1, 1, 2, 2, 3, 3, 1};
+
+    unsigned of(Opcode op) const {
+        unsigned index = static_cast<unsigned>(op);
+        return index < OPCODE_COUNT ? cycles[index] : 1;
+    }
+    bool valid() const {
+        for (uint8_t cost : cycles) {
+            if (cost > MAX_CYCLES) return false;
+        }
+        return true;
+    }
+};
+
+
+inline const char* opcodeName(Opcode op) {
+    switch (op) {
+        case Opcode::LDI: return "ldi";
+        case Opcode::LDA: return "lda";
+        case Opcode::STA: return "sta";
+        case Opcode::MOV: return "mov";
+        case Opcode::ADD: return "add";
+        case Opcode::SUB: return "sub";
+        case Opcode::CMP: return "cmp";
+        case Opcode::JMP: return "jmp";
+        case Opcode::JNE: return "jne";
+        case Opcode::PUSH: return "push";
+        case Opcode::POP: return "pop";
+        case Opcode::HLT: return "hlt";
+    }
+    return "?";
+}
+
+
+inline const char* registerName(Reg reg) {
+    return reg == Reg::A ? "A" : "B";
+}
+
+
+#endif
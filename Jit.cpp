@@ -0,0 +1,442 @@
+#include "Jit.h"
+#include <stdexcept>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define CPU_HAS_JIT 1
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define CPU_HAS_JIT 0
+#endif
+
+
+#if CPU_HAS_JIT
+
+namespace {
+
+enum HostReg : unsigned {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+
+// Register assignment for generated code. Guest registers keep their value in the low
+// byte with the upper bits zero, so they can be used directly as memory indices.
+constexpr unsigned REG_A = RBX;
+constexpr unsigned REG_B = R12;
+constexpr unsigned REG_SP = R13;
+constexpr unsigned REG_MEMORY = R14;
+constexpr unsigned REG_ZERO = R15;
+constexpr unsigned REG_CARRY = RBP;
+constexpr unsigned REG_EXECUTED = R9;
+constexpr unsigned REG_CYCLES = R10;
+constexpr unsigned REG_STATE = RDI;     // first argument, JitState*
+constexpr unsigned REG_EXIT_PC = RCX;
+
+
+enum Condition : uint8_t {
+    CC_B = 0x2,
+    CC_E = 0x4,
+    CC_A = 0x7,
+    CC_L = 0xC,
+    CC_GE = 0xD
+};
+
+
+class X86Emitter {
+public:
+    size_t size() const { return bytes.size(); }
+    const std::vector<uint8_t>& code() const { return bytes; }
+
+    // mov r32, imm32
+    void movImmediate(unsigned reg, uint32_t value) {
+        rex(false, 0, 0, reg, false);
+        byte(0xB8 + (reg & 7));
+        imm32(value);
+    }
+
+    // mov r32, r32
+    void movRegister(unsigned dst, unsigned src) {
+        direct({0x89}, src, dst, false, false);
+    }
+
+    // movzx r32, byte [base + disp32]
+    void loadByte(unsigned dst, unsigned base, int32_t disp) {
+        memory({0x0F, 0xB6}, dst, base, disp, false, false);
+    }
+
+    // movzx r32, byte [base + index]
+    void loadByteIndexed(unsigned dst, unsigned base, unsigned index) {
+        indexed({0x0F, 0xB6}, dst, base, index, false);
+    }
+
+    // mov byte [base + disp32], r8
+    void storeByte(unsigned base, int32_t disp, unsigned src) {
+        memory({0x88}, src, base, disp, false, true);
+    }
+
+    // mov byte [base + index], r8
+    void storeByteIndexed(unsigned base, unsigned index, unsigned src) {
+        indexed({0x88}, src, base, index, true);
+    }
+
+    // mov r64 / r32, [base + disp32] and mov [base + disp32], r64 / r32
+    void load64(unsigned dst, unsigned base, int32_t disp) { memory({0x8B}, dst, base, disp, true, false); }
+    void load32(unsigned dst, unsigned base, int32_t disp) { memory({0x8B}, dst, base, disp, false, false); }
+    void store64(unsigned base, int32_t disp, unsigned src) { memory({0x89}, src, base, disp, true, false); }
+    void store32(unsigned base, int32_t disp, unsigned src) { memory({0x89}, src, base, disp, false, false); }
+
+    // add/sub/cmp/test r/m8, r8
+    void add8(unsigned dst, unsigned src) { direct({0x00}, src, dst, false, true); }
+    void sub8(unsigned dst, unsigned src) { direct({0x28}, src, dst, false, true); }
+    void cmp8(unsigned lhs, unsigned rhs) { direct({0x38}, rhs, lhs, false, true); }
+    void test8(unsigned lhs, unsigned rhs) { direct({0x84}, rhs, lhs, false, true); }
+
+    // inc/dec r32
+    void inc32(unsigned reg) { direct({0xFF}, 0, reg, false, false); }
+    void dec32(unsigned reg) { direct({0xFF}, 1, reg, false, false); }
+
+    // setcc r8; the upper bits of the register are left as they are.
+    void set(Condition condition, unsigned reg) {
+        direct({0x0F, static_cast<uint8_t>(0x90 | condition)}, 0, reg, false, true);
+    }
+
+    // cmp r32, imm32
+    void cmpImmediate(unsigned reg, int32_t value) {
+        direct({0x81}, 7, reg, false, false);
+        imm32(static_cast<uint32_t>(value));
+    }
+
+    // add r64, imm32
+    void addImmediate64(unsigned reg, int32_t value) {
+        direct({0x81}, 0, reg, true, false);
+        imm32(static_cast<uint32_t>(value));
+    }
+
+    void push(unsigned reg) {
+        rex(false, 0, 0, reg, false);
+        byte(0x50 + (reg & 7));
+    }
+
+    void pop(unsigned reg) {
+        rex(false, 0, 0, reg, false);
+        byte(0x58 + (reg & 7));
+    }
+
+    void ret() { byte(0xC3); }
+
+    // Jumps with a rel32 displacement; both return the position to patch().
+    size_t jump() {
+        byte(0xE9);
+        return placeholder();
+    }
+
+    size_t jump(Condition condition) {
+        byte(0x0F);
+        byte(0x80 | condition);
+        return placeholder();
+    }
+
+    void patch(size_t at, size_t target) {
+        int32_t rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+        std::memcpy(&bytes[at], &rel, sizeof(rel));
+    }
+
+
+private:
+    std::vector<uint8_t> bytes;
+
+    void byte(uint8_t value) { bytes.push_back(value); }
+
+    void imm32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) byte(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    size_t placeholder() {
+        size_t at = size();
+        imm32(0);
+        return at;
+    }
+
+    // Byte operations always get a REX prefix so that encodings 4-7 mean spl, bpl,
+    // sil and dil rather than ah, ch, dh and bh.
+    void rex(bool wide, unsigned reg, unsigned index, unsigned base, bool byte_registers) {
+        uint8_t prefix = 0x40 | (wide << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+        if (prefix != 0x40 || byte_registers) byte(prefix);
+    }
+
+    void opcode(std::initializer_list<uint8_t> bytes_of_opcode) {
+        for (uint8_t value : bytes_of_opcode) byte(value);
+    }
+
+    void direct(std::initializer_list<uint8_t> op, unsigned reg, unsigned rm, bool wide, bool byte_registers) {
+        rex(wide, reg, 0, rm, byte_registers);
+        opcode(op);
+        byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    // [base + disp32]; rsp and r12 as a base would need a SIB byte and are never used.
+    void memory(std::initializer_list<uint8_t> op, unsigned reg, unsigned base, int32_t disp,
+                bool wide, bool byte_registers) {
+        rex(wide, reg, 0, base, byte_registers);
+        opcode(op);
+        byte(0x80 | ((reg & 7) << 3) | (base & 7));
+        imm32(static_cast<uint32_t>(disp));
+    }
+
+    // [base + index]; rbp and r13 as a base would need a displacement and are never used.
+    void indexed(std::initializer_list<uint8_t> op, unsigned reg, unsigned base, unsigned index, bool byte_registers) {
+        rex(false, reg, index, base, byte_registers);
+        opcode(op);
+        byte(0x04 | ((reg & 7) << 3));
+        byte(((index & 7) << 3) | (base & 7));
+    }
+};
+
+
+unsigned hostRegister(Reg reg) {
+    return reg == Reg::A ? REG_A : REG_B;
+}
+
+
+#define STATE_FIELD(field) static_cast<int32_t>(offsetof(JitState, field))
+
+
+// Translates the reachable part of a program. The 16-bit program counter can only
+// address the first MAX_PROGRAM_SIZE instructions, and running off the end of the last
+// one wraps to 0 as it does in the interpreter. Each block adds its instruction count and
+// cycles to the counters when it is left, so they only need to be exact at exits.
+std::vector<uint8_t> translate(const MachineInstr* program, size_t count, const MachineModel& machine,
+                               const CycleCosts& costs) {
+    const size_t n = std::min(count, MAX_PROGRAM_SIZE);
+    const uint16_t mask = machine.addressMask();
+    const int32_t stack_base = static_cast<int32_t>(machine.dataLimit());
+    const int32_t stack_top = static_cast<int32_t>(machine.memory_size - 1);
+    auto isJump = [](Opcode op) { return op == Opcode::JMP || op == Opcode::JNE; };
+
+    std::vector<bool> leader(n, false);
+    if (n > 0) leader[0] = true;
+    for (size_t i = 0; i < n; ++i) {
+        Opcode op = program[i].op;
+        if (isJump(op)) {
+            size_t target = program[i].operand;
+            if (target < n) leader[target] = true;
+        }
+        if ((isJump(op) || op == Opcode::HLT) && i + 1 < n) leader[i + 1] = true;
+    }
+
+    struct BlockJump { size_t at; uint32_t pc; };
+    struct Fault { size_t at; uint32_t pc; uint32_t executed; uint32_t cycles; JitExit reason; };
+    std::vector<size_t> block_start(n, 0);
+    std::vector<BlockJump> block_jumps;
+    std::vector<Fault> faults;
+    std::vector<size_t> exit_jumps;
+
+    X86Emitter e;
+    auto branchTo = [&](size_t at, uint32_t pc) { block_jumps.push_back({at, pc}); };
+    auto leave = [&](uint32_t pc, JitExit reason) {
+        e.movImmediate(REG_EXIT_PC, pc);
+        e.movImmediate(RAX, static_cast<uint32_t>(reason));
+        exit_jumps.push_back(e.jump());
+    };
+    auto countExecuted = [&](uint32_t executed, uint32_t cycles) {
+        if (executed) e.addImmediate64(REG_EXECUTED, static_cast<int32_t>(executed));
+        if (cycles) e.addImmediate64(REG_CYCLES, static_cast<int32_t>(cycles));
+    };
+
+    for (unsigned reg : {RBX, RBP, R12, R13, R14, R15}) e.push(reg);
+    e.loadByte(REG_A, REG_STATE, STATE_FIELD(reg_A));
+    e.loadByte(REG_B, REG_STATE, STATE_FIELD(reg_B));
+    e.load32(REG_SP, REG_STATE, STATE_FIELD(sp));
+    e.loadByte(REG_ZERO, REG_STATE, STATE_FIELD(zero_flag));
+    e.loadByte(REG_CARRY, REG_STATE, STATE_FIELD(carry_flag));
+    e.load64(REG_MEMORY, REG_STATE, STATE_FIELD(memory));
+    e.load64(REG_EXECUTED, REG_STATE, STATE_FIELD(executed));
+    e.load64(REG_CYCLES, REG_STATE, STATE_FIELD(cycles));
+    if (n == 0) branchTo(e.jump(), 0);
+
+    uint32_t executed = 0;
+    uint32_t cycles = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (leader[i]) {
+            block_start[i] = e.size();
+            executed = 0;
+            cycles = 0;
+        }
+        const MachineInstr& instr = program[i];
+        uint32_t pc = static_cast<uint32_t>(i);
+        bool falls_through = true;
+
+        switch (instr.op) {
+            case Opcode::LDI:
+                e.movImmediate(hostRegister(instr.reg), static_cast<uint8_t>(instr.operand));
+                break;
+            case Opcode::LDA:
+                e.loadByte(REG_A, REG_MEMORY, instr.operand & mask);
+                break;
+            case Opcode::STA:
+                e.storeByte(REG_MEMORY, instr.operand & mask, REG_A);
+                break;
+            case Opcode::MOV:
+                e.movRegister(hostRegister(instr.reg), hostRegister(static_cast<Reg>(instr.operand)));
+                break;
+
+            // The 8-bit host instructions produce exactly the guest's wraparound, and their
+            // flags give the guest's zero and carry without any masking.
+            case Opcode::ADD:
+                e.add8(REG_A, REG_B);
+                e.set(CC_B, REG_CARRY);
+                e.set(CC_E, REG_ZERO);
+                break;
+            case Opcode::SUB:
+                e.sub8(REG_A, REG_B);
+                e.set(CC_E, REG_ZERO);
+                e.cmp8(REG_B, REG_A);
+                e.set(CC_A, REG_CARRY);
+                break;
+            case Opcode::CMP:
+                e.cmp8(REG_A, REG_B);
+                e.set(CC_E, REG_ZERO);
+                e.set(CC_B, REG_CARRY);
+                break;
+
+            case Opcode::JMP:
+                countExecuted(executed + 1, cycles + costs.of(instr.op));
+                branchTo(e.jump(), instr.operand);
+                falls_through = false;
+                break;
+            case Opcode::JNE:
+                // Taken when the guest zero flag is clear.
+                countExecuted(executed + 1, cycles + costs.of(instr.op));
+                e.test8(REG_ZERO, REG_ZERO);
+                branchTo(e.jump(CC_E), instr.operand);
+                if (i + 1 == n) branchTo(e.jump(), static_cast<uint16_t>(i + 1));
+                falls_through = false;
+                break;
+
+            case Opcode::PUSH:
+                e.storeByteIndexed(REG_MEMORY, REG_SP, hostRegister(instr.reg));
+                e.dec32(REG_SP);
+                e.cmpImmediate(REG_SP, stack_base);
+                faults.push_back({e.jump(CC_L), pc, executed, cycles, JitExit::STACK_OVERFLOW});
+                break;
+            case Opcode::POP:
+                e.cmpImmediate(REG_SP, stack_top);
+                faults.push_back({e.jump(CC_GE), pc, executed, cycles, JitExit::STACK_UNDERFLOW});
+                e.inc32(REG_SP);
+                e.loadByteIndexed(hostRegister(instr.reg), REG_MEMORY, REG_SP);
+                break;
+            case Opcode::HLT:
+                countExecuted(executed, cycles);
+                leave(pc, JitExit::HALTED);
+                falls_through = false;
+                break;
+            default:
+                break;
+        }
+        if (!falls_through) continue;
+
+        // Blocks end before every leader; the next block follows directly unless the
+        // program counter wraps or leaves the program.
+        executed++;
+        cycles += costs.of(instr.op);
+        if (i + 1 < n && !leader[i + 1]) continue;
+        countExecuted(executed, cycles);
+        if (i + 1 == n) branchTo(e.jump(), static_cast<uint16_t>(i + 1));
+    }
+
+    for (const Fault& fault : faults) {
+        e.patch(fault.at, e.size());
+        countExecuted(fault.executed, fault.cycles);
+        leave(fault.pc, fault.reason);
+    }
+    std::map<uint32_t, size_t> exit_stubs;
+    for (const BlockJump& jump : block_jumps) {
+        if (jump.pc < n) {
+            e.patch(jump.at, block_start[jump.pc]);
+            continue;
+        }
+        auto stub = exit_stubs.find(jump.pc);
+        if (stub == exit_stubs.end()) {
+            stub = exit_stubs.emplace(jump.pc, e.size()).first;
+            leave(jump.pc, JitExit::HALTED);
+        }
+        e.patch(jump.at, stub->second);
+    }
+
+    for (size_t at : exit_jumps) e.patch(at, e.size());
+    e.storeByte(REG_STATE, STATE_FIELD(reg_A), REG_A);
+    e.storeByte(REG_STATE, STATE_FIELD(reg_B), REG_B);
+    e.store32(REG_STATE, STATE_FIELD(sp), REG_SP);
+    e.storeByte(REG_STATE, STATE_FIELD(zero_flag), REG_ZERO);
+    e.storeByte(REG_STATE, STATE_FIELD(carry_flag), REG_CARRY);
+    e.store32(REG_STATE, STATE_FIELD(pc), REG_EXIT_PC);
+    e.store64(REG_STATE, STATE_FIELD(executed), REG_EXECUTED);
+    e.store64(REG_STATE, STATE_FIELD(cycles), REG_CYCLES);
+    for (unsigned reg : {R15, R14, R13, R12, RBP, RBX}) e.pop(reg);
+    e.ret();
+    return e.code();
+}
+
+#undef STATE_FIELD
+
+}
+
+#endif
+
+
+JitProgram::JitProgram(const MachineInstr* program, size_t count, const MachineModel& machine,
+                       const CycleCosts& costs) {
+#if CPU_HAS_JIT
+    std::vector<uint8_t> native = translate(program, count, machine, costs);
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t length = (native.size() + page - 1) / page * page;
+    void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("JIT Error: Cannot map code buffer");
+    }
+    std::memcpy(mapping, native.data(), native.size());
+    if (mprotect(mapping, length, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mapping, length);
+        throw std::runtime_error("JIT Error: Cannot make code buffer executable");
+    }
+    code = mapping;
+    code_size = native.size();
+    mapped_size = length;
+#else
+    (void)program;
+    (void)count;
+    (void)machine;
+    (void)costs;
+    throw std::runtime_error("JIT Error: Not supported on this platform");
+#endif
+}
+
+
+JitProgram::~JitProgram() {
+#if CPU_HAS_JIT
+    if (code) munmap(code, mapped_size);
+#endif
+}
+
+
+bool JitProgram::isSupported() {
+    return CPU_HAS_JIT;
+}
+
+
+JitExit JitProgram::run(JitState& state) const {
+#if CPU_HAS_JIT
+    using Entry = uint32_t (*)(JitState*);
+    return static_cast<JitExit>(reinterpret_cast<Entry>(code)(&state));
+#else
+    (void)state;
+    throw std::runtime_error("JIT Error: Not supported on this platform");
+#endif
+}
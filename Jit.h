@@ -0,0 +1,56 @@
+#ifndef JIT_H
+#define JIT_H
+
+
+#include "Isa.h"
+#include <cstddef>
+#include <cstdint>
+
+
+// CPU state as the generated code reads it on entry and writes it back on exit.
+struct JitState {
+    uint8_t* memory;
+    uint64_t executed;
+    uint64_t cycles;
+    uint32_t pc;
+    uint32_t sp;
+    uint8_t reg_A;
+    uint8_t reg_B;
+    uint8_t zero_flag;
+    uint8_t carry_flag;
+};
+
+
+enum class JitExit : uint32_t {
+    HALTED,             // hlt, or the program counter left the program
+    STACK_OVERFLOW,
+    STACK_UNDERFLOW
+};
+
+
+// Native x86-64 translation of a program, one basic block at a time. Blocks start at
+// jump targets and after jmp, jne and hlt; they chain to each other with direct jumps
+// and only return to C++ when the program stops. A, B, SP and both flags live in host
+// registers throughout, as do the instruction and cycle counts. Only available on Linux x86-64; elsewhere isSupported() is
+// false and the constructor throws.
+class JitProgram {
+public:
+    JitProgram(const MachineInstr* program, size_t count, const MachineModel& machine,
+               const CycleCosts& costs = CycleCosts());
+    ~JitProgram();
+    JitProgram(const JitProgram&) = delete;
+    JitProgram& operator=(const JitProgram&) = delete;
+
+    static bool isSupported();
+    JitExit run(JitState& state) const;
+    size_t codeSize() const { return code_size; }
+
+
+private:
+    void* code = nullptr;
+    size_t code_size = 0;
+    size_t mapped_size = 0;
+};
+
+
+#endif
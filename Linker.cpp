@@ -0,0 +1,109 @@
+#include "Linker.h"
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+
+
+namespace {
+
+constexpr uint32_t NO_ADDRESS = UINT32_MAX;
+
+
+struct Definition {
+    uint32_t address;
+    size_t module;
+};
+
+}
+
+
+ObjectFile linkObjects(const std::vector<LinkInput>& inputs) {
+    ObjectFile linked;
+    bool debug_info = !inputs.empty();
+    for (const LinkInput& input : inputs) {
+        if (!input.object->isRelocatable()) {
+            throw std::runtime_error("Linker Error: '" + input.name + "' is not a relocatable object");
+        }
+        debug_info = debug_info && input.object->hasDebugInfo();
+    }
+
+    // Declared variables get consecutive addresses, module by module. Within a module a
+    // redeclared name exports its last declaration, as later code in the module sees it.
+    // The optimizer's temporaries ($0, $1, ...) are private to their module.
+    std::vector<std::vector<uint32_t>> addresses(inputs.size());
+    std::unordered_map<std::string, Definition> definitions;
+    uint32_t next_address = 0;
+    for (size_t m = 0; m < inputs.size(); ++m) {
+        const ObjectView& object = *inputs[m].object;
+        addresses[m].assign(object.symbolCount(), NO_ADDRESS);
+        for (size_t i = 0; i < object.symbolCount(); ++i) {
+            if (object.symbolKind(i) != ObjectSymbolKind::VARIABLE) continue;
+            std::string name(object.symbolName(i));
+            addresses[m][i] = next_address;
+            linked.symbols.push_back({ObjectSymbolKind::VARIABLE, name, next_address});
+            if (name[0] == '$') {
+                next_address++;
+                continue;
+            }
+            auto [it, inserted] = definitions.try_emplace(name, Definition{next_address, m});
+            if (!inserted && it->second.module != m) {
+                throw std::runtime_error("Linker Error: Variable '" + name + "' is declared in both '" +
+                                         inputs[it->second.module].name + "' and '" + inputs[m].name + "'");
+            }
+            it->second.address = next_address;
+            next_address++;
+        }
+    }
+    linked.variable_count = next_address;
+
+    for (size_t m = 0; m < inputs.size(); ++m) {
+        const ObjectView& object = *inputs[m].object;
+        for (size_t i = 0; i < object.symbolCount(); ++i) {
+            if (object.symbolKind(i) != ObjectSymbolKind::EXTERN) continue;
+            std::string name(object.symbolName(i));
+            auto it = definitions.find(name);
+            if (it == definitions.end()) {
+                throw std::runtime_error("Linker Error: Undefined variable '" + name + "' used in '" + inputs[m].name + "'");
+            }
+            addresses[m][i] = it->second.address;
+        }
+    }
+
+    for (size_t m = 0; m < inputs.size(); ++m) {
+        const ObjectView& object = *inputs[m].object;
+        const std::string& module = inputs[m].name;
+        size_t base = linked.instructions.size();
+        size_t count = object.instructionCount();
+        linked.instructions.insert(linked.instructions.end(), object.instructions(), object.instructions() + count);
+
+        for (size_t r = 0; r < object.relocationCount(); ++r) {
+            const ObjectRelocationEntry& relocation = object.relocation(r);
+            if (relocation.instruction >= count) {
+                throw std::runtime_error("Linker Error: Corrupt relocation in '" + module + "'");
+            }
+            MachineInstr& instr = linked.instructions[base + relocation.instruction];
+            if (relocation.kind == ObjectRelocationKind::CODE) {
+                size_t target = base + instr.operand;
+                if (target > UINT16_MAX) throw std::runtime_error("Linker Error: Program is too large");
+                instr.operand = static_cast<uint16_t>(target);
+            } else {
+                if (relocation.symbol >= addresses[m].size() || addresses[m][relocation.symbol] == NO_ADDRESS) {
+                    throw std::runtime_error("Linker Error: Corrupt relocation in '" + module + "'");
+                }
+                instr.operand = static_cast<uint16_t>(addresses[m][relocation.symbol]);
+            }
+        }
+        for (size_t i = 0; i < object.symbolCount(); ++i) {
+            if (object.symbolKind(i) != ObjectSymbolKind::LABEL) continue;
+            linked.symbols.push_back({ObjectSymbolKind::LABEL, module + "." + std::string(object.symbolName(i)),
+                                      static_cast<uint32_t>(base + object.symbolValue(i))});
+        }
+        if (debug_info) {
+            for (size_t i = 0; i < count; ++i) linked.debug_comments.emplace_back(object.comment(i));
+        }
+    }
+
+    linked.instructions.push_back({Opcode::HLT, Reg::A, 0});
+    if (debug_info) linked.debug_comments.emplace_back();
+    return linked;
+}
@@ -0,0 +1,26 @@
+#ifndef LINKER_H
+#define LINKER_H
+
+
+#include "ObjectFile.h"
+#include <string>
+#include <vector>
+
+
+struct LinkInput {
+    // Used in diagnostics and as the prefix of the module's labels.
+    std::string name;
+    const ObjectView* object;
+};
+
+
+// Merges relocatable modules into one executable object. The modules run in the given
+// order followed by a single hlt. Variables are laid out module by module, in slot order,
+// so each module keeps its declaration order; every extern is bound to the variable of
+// that name some module declares. A name declared by two modules, or used as an extern
+// but declared by none, is an error. Temporaries the optimizer introduced, whose names
+// start with '$', are never shared between modules.
+ObjectFile linkObjects(const std::vector<LinkInput>& inputs);
+
+
+#endif
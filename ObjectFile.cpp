@@ -0,0 +1,246 @@
+#include "ObjectFile.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+
+ObjectFile makeObject(const AsmBuffer& code, const std::vector<std::string>& variables, bool debug_info) {
+    ObjectFile object;
+    object.instructions = assemble(code);
+    object.variable_count = static_cast<uint32_t>(variables.size());
+    if (debug_info) object.debug_comments.reserve(object.instructions.size());
+
+    uint32_t position = 0;
+    for (const AsmItem& item : code.items()) {
+        if (item.kind == AsmItem::Kind::LABEL) {
+            object.symbols.push_back({ObjectSymbolKind::LABEL, code.labelName(item.label), position});
+        } else if (item.kind == AsmItem::Kind::INSTRUCTION) {
+            if (debug_info) {
+                object.debug_comments.push_back(item.comment == AsmItem::NONE ? std::string() : code.commentText(item.comment));
+            }
+            position++;
+        }
+    }
+    for (size_t address = 0; address < variables.size(); ++address) {
+        object.symbols.push_back({ObjectSymbolKind::VARIABLE, variables[address], static_cast<uint32_t>(address)});
+    }
+    return object;
+}
+
+
+// The code generator only uses memory for variables, so every lda and sta operand is a
+// slot, and its symbol is the slot's entry among the trailing VARIABLE/EXTERN symbols.
+ObjectFile makeRelocatableObject(const AsmBuffer& code, const std::vector<std::string>& variables,
+                                 const std::vector<bool>& externs, bool debug_info) {
+    ObjectFile object = makeObject(code, variables, debug_info);
+    object.relocatable = true;
+    size_t first_slot = object.symbols.size() - variables.size();
+    for (size_t slot = 0; slot < externs.size(); ++slot) {
+        if (externs[slot]) object.symbols[first_slot + slot].kind = ObjectSymbolKind::EXTERN;
+    }
+    for (size_t i = 0; i < object.instructions.size(); ++i) {
+        const MachineInstr& instr = object.instructions[i];
+        ObjectRelocationEntry relocation{};
+        relocation.instruction = static_cast<uint32_t>(i);
+        if (instr.op == Opcode::JMP || instr.op == Opcode::JNE) {
+            relocation.kind = ObjectRelocationKind::CODE;
+        } else if (instr.op == Opcode::LDA || instr.op == Opcode::STA) {
+            if (instr.operand >= variables.size()) {
+                throw std::runtime_error("ObjectFile Error: Memory operand " + std::to_string(instr.operand) + " is not a variable slot");
+            }
+            relocation.kind = ObjectRelocationKind::DATA;
+            relocation.symbol = static_cast<uint32_t>(first_slot + instr.operand);
+        } else {
+            continue;
+        }
+        object.relocations.push_back(relocation);
+    }
+    return object;
+}
+
+
+namespace {
+
+template <typename T>
+void put(std::string& out, size_t offset, const T* data, size_t count) {
+    if (count) std::memcpy(&out[offset], data, sizeof(T) * count);
+}
+
+
+uint32_t addString(std::string& strings, const std::string& text) {
+    uint32_t offset = static_cast<uint32_t>(strings.size());
+    strings += text;
+    strings += '\0';
+    return offset;
+}
+
+
+// True if `count` items of `size` bytes at `offset` lie inside a buffer of `total` bytes.
+bool sectionFits(uint64_t offset, uint64_t count, uint64_t size, uint64_t total) {
+    return offset % 4 == 0 && offset <= total && count * size <= total - offset;
+}
+
+}
+
+
+std::string encodeObject(const ObjectFile& object) {
+    std::string strings;
+    std::vector<ObjectSymbolEntry> symbols;
+    symbols.reserve(object.symbols.size());
+    for (const ObjectSymbol& symbol : object.symbols) {
+        ObjectSymbolEntry entry{};
+        entry.name = addString(strings, symbol.name);
+        entry.value = symbol.value;
+        entry.kind = symbol.kind;
+        symbols.push_back(entry);
+    }
+    std::vector<uint32_t> debug;
+    debug.reserve(object.debug_comments.size());
+    for (const std::string& comment : object.debug_comments) {
+        debug.push_back(comment.empty() ? OBJECT_NO_STRING : addString(strings, comment));
+    }
+
+    ObjectHeader header{};
+    std::memcpy(header.magic, OBJECT_MAGIC, sizeof(header.magic));
+    header.version = OBJECT_VERSION;
+    header.flags = (object.debug_comments.empty() ? 0 : OBJECT_HAS_DEBUG) | (object.relocatable ? OBJECT_RELOCATABLE : 0);
+    header.variable_count = object.variable_count;
+    header.instruction_offset = sizeof(ObjectHeader);
+    header.instruction_count = static_cast<uint32_t>(object.instructions.size());
+    header.symbol_offset = header.instruction_offset + header.instruction_count * sizeof(MachineInstr);
+    header.symbol_count = static_cast<uint32_t>(symbols.size());
+    header.relocation_offset = header.symbol_offset + header.symbol_count * sizeof(ObjectSymbolEntry);
+    header.relocation_count = static_cast<uint32_t>(object.relocations.size());
+    header.debug_offset = header.relocation_offset + header.relocation_count * sizeof(ObjectRelocationEntry);
+    header.debug_count = static_cast<uint32_t>(debug.size());
+    header.string_offset = header.debug_offset + header.debug_count * sizeof(uint32_t);
+    header.string_size = static_cast<uint32_t>(strings.size());
+
+    std::string out(header.string_offset + header.string_size, '\0');
+    put(out, 0, &header, 1);
+    put(out, header.instruction_offset, object.instructions.data(), object.instructions.size());
+    put(out, header.symbol_offset, symbols.data(), symbols.size());
+    put(out, header.relocation_offset, object.relocations.data(), object.relocations.size());
+    put(out, header.debug_offset, debug.data(), debug.size());
+    put(out, header.string_offset, strings.data(), strings.size());
+    return out;
+}
+
+
+void writeObject(const std::string& path, const ObjectFile& object) {
+    writeObject(path, encodeObject(object));
+}
+
+
+void writeObject(const std::string& path, std::string_view bytes) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out || !out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()))) {
+        throw std::runtime_error("ObjectFile Error: Cannot write '" + path + "'");
+    }
+}
+
+
+bool ObjectView::isObject(std::string_view bytes) {
+    return bytes.size() >= sizeof(OBJECT_MAGIC) && std::memcmp(bytes.data(), OBJECT_MAGIC, sizeof(OBJECT_MAGIC)) == 0;
+}
+
+
+// Only the header is checked here, so opening an object costs the same regardless of
+// its size. String offsets are checked when they are read.
+ObjectView::ObjectView(std::string_view bytes) : bytes(bytes) {
+    if (bytes.size() < sizeof(ObjectHeader) || !isObject(bytes)) {
+        throw std::runtime_error("ObjectFile Error: Not an object file");
+    }
+    if (reinterpret_cast<uintptr_t>(bytes.data()) % alignof(ObjectHeader) != 0) {
+        throw std::runtime_error("ObjectFile Error: Object data is misaligned");
+    }
+    header = reinterpret_cast<const ObjectHeader*>(bytes.data());
+    if (header->version != OBJECT_VERSION) {
+        throw std::runtime_error("ObjectFile Error: Unsupported version " + std::to_string(header->version));
+    }
+
+    size_t total = bytes.size();
+    bool has_debug = header->flags & OBJECT_HAS_DEBUG;
+    if (!sectionFits(header->instruction_offset, header->instruction_count, sizeof(MachineInstr), total) ||
+        !sectionFits(header->symbol_offset, header->symbol_count, sizeof(ObjectSymbolEntry), total) ||
+        !sectionFits(header->relocation_offset, header->relocation_count, sizeof(ObjectRelocationEntry), total) ||
+        !sectionFits(header->debug_offset, header->debug_count, sizeof(uint32_t), total) ||
+        header->string_offset > total || header->string_size > total - header->string_offset ||
+        (header->string_size > 0 && bytes[header->string_offset + header->string_size - 1] != '\0') ||
+        (has_debug && header->debug_count != header->instruction_count)) {
+        throw std::runtime_error("ObjectFile Error: Corrupt object file");
+    }
+
+    code = reinterpret_cast<const MachineInstr*>(bytes.data() + header->instruction_offset);
+    symbols = reinterpret_cast<const ObjectSymbolEntry*>(bytes.data() + header->symbol_offset);
+    relocations = reinterpret_cast<const ObjectRelocationEntry*>(bytes.data() + header->relocation_offset);
+    debug = has_debug ? reinterpret_cast<const uint32_t*>(bytes.data() + header->debug_offset) : nullptr;
+}
+
+
+std::string_view ObjectView::string(uint32_t offset) const {
+    if (offset >= header->string_size) return {};
+    return std::string_view(bytes.data() + header->string_offset + offset);
+}
+
+
+std::string_view ObjectView::comment(size_t instruction) const {
+    if (!debug || instruction >= instructionCount() || debug[instruction] == OBJECT_NO_STRING) return {};
+    return string(debug[instruction]);
+}
+
+
+AsmBuffer disassemble(const ObjectView& object) {
+    AsmBuffer code(true);
+    size_t count = object.instructionCount();
+    const MachineInstr* instructions = object.instructions();
+    auto isJump = [](const MachineInstr& instr) { return instr.op == Opcode::JMP || instr.op == Opcode::JNE; };
+
+    // Labels by position; jumps to a position without a symbol get a generated name.
+    size_t end = count;
+    for (size_t i = 0; i < count; ++i) {
+        if (isJump(instructions[i])) end = std::max<size_t>(end, instructions[i].operand);
+    }
+    std::vector<std::pair<size_t, LabelId>> labels;
+    std::vector<LabelId> label_at(end + 1, AsmItem::NONE);
+    for (size_t i = 0; i < object.symbolCount(); ++i) {
+        uint32_t value = object.symbolValue(i);
+        if (object.symbolKind(i) == ObjectSymbolKind::VARIABLE) {
+            code.comment("Variable '" + std::string(object.symbolName(i)) + "' allocated at " +
+                         (object.isRelocatable() ? "slot " : "address ") + std::to_string(value));
+            continue;
+        }
+        if (object.symbolKind(i) == ObjectSymbolKind::EXTERN) {
+            code.comment("Extern '" + std::string(object.symbolName(i)) + "' at slot " + std::to_string(value));
+            continue;
+        }
+        LabelId label = code.newLabel(std::string(object.symbolName(i)));
+        labels.push_back({value, label});
+        if (value <= end && label_at[value] == AsmItem::NONE) label_at[value] = label;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        uint16_t target = instructions[i].operand;
+        if (isJump(instructions[i]) && label_at[target] == AsmItem::NONE) {
+            label_at[target] = code.newLabel("L" + std::to_string(target));
+            labels.push_back({target, label_at[target]});
+        }
+    }
+    std::stable_sort(labels.begin(), labels.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    size_t next_label = 0;
+    for (size_t i = 0; i < count; ++i) {
+        while (next_label < labels.size() && labels[next_label].first <= i) code.bind(labels[next_label++].second);
+        const MachineInstr& instr = instructions[i];
+        if (isJump(instr)) {
+            code.emitJump(instr.op, label_at[instr.operand]);
+        } else {
+            code.emit(instr.op, instr.reg, instr.operand);
+        }
+        std::string_view comment = object.comment(i);
+        if (!comment.empty()) code.annotate(std::string(comment));
+    }
+    while (next_label < labels.size()) code.bind(labels[next_label++].second);
+    return code;
+}
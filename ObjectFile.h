@@ -0,0 +1,159 @@
+#ifndef OBJECT_FILE_H
+#define OBJECT_FILE_H
+
+
+#include "AsmBuffer.h"
+#include "Isa.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Binary object layout (.slo). All fields are in host byte order and every section
+// starts on a 4-byte boundary, so a mapped file can be used in place:
+//
+//   ObjectHeader
+//   instructions   MachineInstr[instruction_count], jump targets already resolved
+//   symbols        ObjectSymbolEntry[symbol_count]
+//   relocations    ObjectRelocationEntry[relocation_count]
+//   debug          uint32_t[debug_count], per instruction: string offset of its comment
+//   strings        symbol names and comments, NUL-terminated
+//
+// An executable object is ready to run. A relocatable object (OBJECT_RELOCATABLE) is one
+// module of a multi-file program: jump targets count from the module's first instruction,
+// memory operands are slot numbers of the module's VARIABLE and EXTERN symbols, and
+// every operand the linker has to rewrite has a relocation entry.
+constexpr char OBJECT_MAGIC[4] = {'S', 'L', 'O', 'B'};
+constexpr uint16_t OBJECT_VERSION = 2;
+constexpr uint16_t OBJECT_HAS_DEBUG = 1;
+constexpr uint16_t OBJECT_RELOCATABLE = 2;
+constexpr uint32_t OBJECT_NO_STRING = UINT32_MAX;
+
+
+struct ObjectHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t flags;
+    uint32_t variable_count;
+    uint32_t instruction_offset;
+    uint32_t instruction_count;
+    uint32_t symbol_offset;
+    uint32_t symbol_count;
+    uint32_t relocation_offset;
+    uint32_t relocation_count;
+    uint32_t debug_offset;
+    uint32_t debug_count;
+    uint32_t string_offset;
+    uint32_t string_size;
+};
+
+static_assert(sizeof(ObjectHeader) == 52, "ObjectHeader layout is part of the file format");
+
+
+enum class ObjectSymbolKind : uint8_t {
+    LABEL,      // value is an instruction index
+    VARIABLE,   // value is a data address, or a slot in a relocatable object
+    EXTERN      // slot of a variable defined by another module
+};
+
+
+struct ObjectSymbolEntry {
+    uint32_t name;      // offset into the string section
+    uint32_t value;
+    ObjectSymbolKind kind;
+    uint8_t reserved[3];
+};
+
+static_assert(sizeof(ObjectSymbolEntry) == 12, "ObjectSymbolEntry layout is part of the file format");
+
+
+enum class ObjectRelocationKind : uint8_t {
+    CODE,   // jump target: add the module's first instruction index
+    DATA    // memory operand: replace with the address of `symbol`
+};
+
+
+struct ObjectRelocationEntry {
+    uint32_t instruction;
+    uint32_t symbol;    // index of a VARIABLE or EXTERN symbol, for DATA
+    ObjectRelocationKind kind;
+    uint8_t reserved[3];
+};
+
+static_assert(sizeof(ObjectRelocationEntry) == 12, "ObjectRelocationEntry layout is part of the file format");
+
+
+struct ObjectSymbol {
+    ObjectSymbolKind kind;
+    std::string name;
+    uint32_t value;
+};
+
+
+// Everything that goes into an object file, in unpacked form.
+struct ObjectFile {
+    std::vector<MachineInstr> instructions;
+    std::vector<ObjectSymbol> symbols;
+    std::vector<ObjectRelocationEntry> relocations;
+    bool relocatable = false;
+    // One entry per instruction when non-empty; empty strings mean no comment.
+    std::vector<std::string> debug_comments;
+    uint32_t variable_count = 0;
+};
+
+
+// Assembles `code` and records its labels, the given variables (by address) and, with
+// `debug_info`, the comments of an annotated buffer.
+ObjectFile makeObject(const AsmBuffer& code, const std::vector<std::string>& variables, bool debug_info);
+// The same for a module generated with CodeGenOptions::externs: `variables` and `externs`
+// describe its slots, and every jump and memory operand gets a relocation.
+ObjectFile makeRelocatableObject(const AsmBuffer& code, const std::vector<std::string>& variables,
+                                 const std::vector<bool>& externs, bool debug_info);
+
+std::string encodeObject(const ObjectFile& object);
+void writeObject(const std::string& path, const ObjectFile& object);
+// Writes an already encoded object.
+void writeObject(const std::string& path, std::string_view bytes);
+
+
+// Read-only view of an encoded object. The constructor checks the header and that every
+// section lies inside `bytes`; nothing is copied, so `bytes` must outlive the view.
+class ObjectView {
+public:
+    explicit ObjectView(std::string_view bytes);
+    static bool isObject(std::string_view bytes);
+
+    const MachineInstr* instructions() const { return code; }
+    size_t instructionCount() const { return header->instruction_count; }
+    uint32_t variableCount() const { return header->variable_count; }
+    size_t symbolCount() const { return header->symbol_count; }
+    ObjectSymbolKind symbolKind(size_t index) const { return symbols[index].kind; }
+    std::string_view symbolName(size_t index) const { return string(symbols[index].name); }
+    uint32_t symbolValue(size_t index) const { return symbols[index].value; }
+    bool hasDebugInfo() const { return header->flags & OBJECT_HAS_DEBUG; }
+    bool isRelocatable() const { return header->flags & OBJECT_RELOCATABLE; }
+    size_t relocationCount() const { return header->relocation_count; }
+    const ObjectRelocationEntry& relocation(size_t index) const { return relocations[index]; }
+    // The comment recorded for an instruction, or an empty view.
+    std::string_view comment(size_t instruction) const;
+
+
+private:
+    std::string_view bytes;
+    const ObjectHeader* header;
+    const MachineInstr* code;
+    const ObjectSymbolEntry* symbols;
+    const ObjectRelocationEntry* relocations;
+    const uint32_t* debug;
+
+    std::string_view string(uint32_t offset) const;
+};
+
+
+// Rebuilds an annotated buffer from an object, for --emit=asm on a .slo file.
+AsmBuffer disassemble(const ObjectView& object);
+
+
+#endif
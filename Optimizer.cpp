@@ -0,0 +1,706 @@
+#include "Optimizer.h"
+#include "AstVisitor.h"
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace {
+
+// A new node standing for code at `origin`'s source position.
+template <typename T>
+T* placedAt(T* node, const Node* origin) {
+    node->offset = origin->offset;
+    return node;
+}
+
+
+bool isComparison(const Expression* expr) {
+    if (expr->kind != NodeKind::BINARY_OP) return false;
+    BinaryOperator op = static_cast<const BinaryOp*>(expr)->op;
+    return op == BinaryOperator::EQUAL || op == BinaryOperator::NOT_EQUAL;
+}
+
+
+bool refersTo(const Expression* expr, SymbolId symbol) {
+    return expr->kind == NodeKind::IDENTIFIER && static_cast<const Identifier*>(expr)->symbol == symbol;
+}
+
+
+bool isAssigned(const std::vector<SymbolId>& assigned, SymbolId symbol) {
+    return std::find(assigned.begin(), assigned.end(), symbol) != assigned.end();
+}
+
+
+// Every assignment in `stmt`, nested ones included; a symbol assigned twice is listed twice.
+void collectAssignments(const Statement* stmt, std::vector<SymbolId>& out) {
+    switch (stmt->kind) {
+        case NodeKind::ASSIGNMENT:
+            out.push_back(static_cast<const Assignment*>(stmt)->symbol);
+            break;
+        case NodeKind::BLOCK_STATEMENT:
+            for (const Statement* child : static_cast<const BlockStatement*>(stmt)->statements) {
+                collectAssignments(child, out);
+            }
+            break;
+        case NodeKind::IF_STATEMENT:
+            collectAssignments(static_cast<const IfStatement*>(stmt)->body, out);
+            break;
+        case NodeKind::WHILE_STATEMENT:
+            collectAssignments(static_cast<const WhileStatement*>(stmt)->body, out);
+            break;
+        default:
+            break;
+    }
+}
+
+
+// Statements in `stmt`, nested ones included, for the unrolling limit. Blocks only group.
+int countStatements(const Statement* stmt) {
+    switch (stmt->kind) {
+        case NodeKind::BLOCK_STATEMENT: {
+            int count = 0;
+            for (const Statement* child : static_cast<const BlockStatement*>(stmt)->statements) {
+                count += countStatements(child);
+            }
+            return count;
+        }
+        case NodeKind::IF_STATEMENT:
+            return 1 + countStatements(static_cast<const IfStatement*>(stmt)->body);
+        case NodeKind::WHILE_STATEMENT:
+            return 1 + countStatements(static_cast<const WhileStatement*>(stmt)->body);
+        default:
+            return 1;
+    }
+}
+
+
+// For `i = i + c`, `i = c + i` or `i = i - c`, the step c, with `negative` set for the
+// subtraction; null for any other assignment.
+const Expression* inductionStep(const Assignment* update, bool& negative) {
+    if (update->value->kind != NodeKind::BINARY_OP) return nullptr;
+    auto value = static_cast<const BinaryOp*>(update->value);
+    negative = value->op == BinaryOperator::SUBTRACT;
+    if (value->op == BinaryOperator::ADD && refersTo(value->right, update->symbol)) return value->left;
+    if ((value->op == BinaryOperator::ADD || negative) && refersTo(value->left, update->symbol)) return value->right;
+    return nullptr;
+}
+
+
+Expression* cloneExpression(Arena& arena, const Expression* expr) {
+    switch (expr->kind) {
+        case NodeKind::NUMBER_LITERAL:
+            return placedAt(arena.make<NumberLiteral>(static_cast<const NumberLiteral*>(expr)->value), expr);
+        case NodeKind::IDENTIFIER:
+            return placedAt(arena.make<Identifier>(static_cast<const Identifier*>(expr)->symbol), expr);
+        default: {
+            auto op = static_cast<const BinaryOp*>(expr);
+            return placedAt(arena.make<BinaryOp>(op->op, cloneExpression(arena, op->left), cloneExpression(arena, op->right)), expr);
+        }
+    }
+}
+
+
+BlockStatement* cloneBlock(Arena& arena, const BlockStatement* block);
+
+
+Statement* cloneStatement(Arena& arena, const Statement* stmt) {
+    switch (stmt->kind) {
+        case NodeKind::ASSIGNMENT: {
+            auto assignment = static_cast<const Assignment*>(stmt);
+            return placedAt(arena.make<Assignment>(assignment->symbol, cloneExpression(arena, assignment->value)), stmt);
+        }
+        case NodeKind::BLOCK_STATEMENT:
+            return cloneBlock(arena, static_cast<const BlockStatement*>(stmt));
+        case NodeKind::IF_STATEMENT: {
+            auto branch = static_cast<const IfStatement*>(stmt);
+            return placedAt(arena.make<IfStatement>(cloneExpression(arena, branch->condition), cloneBlock(arena, branch->body)), stmt);
+        }
+        case NodeKind::WHILE_STATEMENT: {
+            auto loop = static_cast<const WhileStatement*>(stmt);
+            return placedAt(arena.make<WhileStatement>(cloneExpression(arena, loop->condition), cloneBlock(arena, loop->body)), stmt);
+        }
+        default:
+            return placedAt(arena.make<VarDecl>(static_cast<const VarDecl*>(stmt)->symbol), stmt);
+    }
+}
+
+
+BlockStatement* cloneBlock(Arena& arena, const BlockStatement* block) {
+    BlockStatement* copy = placedAt(arena.make<BlockStatement>(), block);
+    copy->statements.count = block->statements.count;
+    copy->statements.items = arena.allocateArray<Statement*>(block->statements.count);
+    for (uint32_t i = 0; i < block->statements.count; ++i) {
+        copy->statements.items[i] = cloneStatement(arena, block->statements[i]);
+    }
+    return copy;
+}
+
+
+// A block of `times` copies of the body's statements. The first copy is the original,
+// so every clone is made before anything rewrites it.
+BlockStatement* repeatBody(Arena& arena, const BlockStatement* body, int times) {
+    uint32_t count = body->statements.count;
+    BlockStatement* block = placedAt(arena.make<BlockStatement>(), body);
+    block->statements.count = count * static_cast<uint32_t>(times);
+    block->statements.items = arena.allocateArray<Statement*>(block->statements.count);
+    for (uint32_t i = 0; i < count; ++i) {
+        block->statements.items[i] = body->statements[i];
+        for (int copy = 1; copy < times; ++copy) {
+            block->statements.items[copy * count + i] = cloneStatement(arena, body->statements[i]);
+        }
+    }
+    return block;
+}
+
+
+NodeList<Statement> makeList(Arena& arena, const std::vector<Statement*>& statements) {
+    NodeList<Statement> list;
+    list.count = static_cast<uint32_t>(statements.size());
+    list.items = arena.allocateArray<Statement*>(statements.size());
+    std::copy(statements.begin(), statements.end(), list.items);
+    return list;
+}
+
+
+class ConstantFolder : private AstVisitor<ConstantFolder, Node*, false> {
+public:
+    ConstantFolder(Program& program, size_t symbol_count, bool zero_declarations, const LoopOptions& loops)
+        : program(program), known(symbol_count, UNKNOWN), declared_value(zero_declarations ? 0 : UNKNOWN),
+          loops(loops) {}
+
+    void run() { program.statements = foldList(program.statements); }
+
+
+private:
+    // Values are tracked as the CPU holds them: 0-255, or UNKNOWN.
+    static constexpr int UNKNOWN = -1;
+
+    Program& program;
+    std::vector<int> known;
+    int declared_value;
+    const LoopOptions& loops;
+
+    friend class AstVisitor<ConstantFolder, Node*, false>;
+
+
+    Statement* fold(Statement* stmt) { return static_cast<Statement*>(dispatch(stmt)); }
+    Expression* fold(Expression* expr) { return static_cast<Expression*>(dispatch(expr)); }
+
+
+    static int constantValue(const Expression* expr) {
+        if (expr->kind != NodeKind::NUMBER_LITERAL) return UNKNOWN;
+        return static_cast<const NumberLiteral*>(expr)->value & 0xFF;
+    }
+
+
+    // The value `expr` has with the variables as currently known, without folding it.
+    // Variables in `assigned`, if given, count as unknown.
+    int valueOf(const Expression* expr, const std::vector<SymbolId>* assigned = nullptr) const {
+        switch (expr->kind) {
+            case NodeKind::NUMBER_LITERAL:
+                return static_cast<const NumberLiteral*>(expr)->value & 0xFF;
+            case NodeKind::IDENTIFIER: {
+                SymbolId symbol = static_cast<const Identifier*>(expr)->symbol;
+                if (assigned && isAssigned(*assigned, symbol)) return UNKNOWN;
+                return known[symbol];
+            }
+            default: {
+                auto op = static_cast<const BinaryOp*>(expr);
+                int left = valueOf(op->left, assigned);
+                if (op->op == BinaryOperator::EQUAL || op->op == BinaryOperator::NOT_EQUAL) return left;
+                int right = valueOf(op->right, assigned);
+                if (left == UNKNOWN || right == UNKNOWN) return UNKNOWN;
+                return (op->op == BinaryOperator::ADD ? left + right : left - right) & 0xFF;
+            }
+        }
+    }
+
+
+    // Iterations of a loop that steps one counter towards a fixed bound: the counter is
+    // only assigned by one `i = i + c` or `i = i - c` directly in the body, the condition
+    // compares it with a value the loop does not change, and its value on entry is
+    // known. UNKNOWN if the loop has no such counter or never ends.
+    int tripCount(const WhileStatement* loop, const std::vector<SymbolId>& assigned) const {
+        auto condition = static_cast<const BinaryOp*>(loop->condition);
+        for (const Statement* stmt : loop->body->statements) {
+            if (stmt->kind != NodeKind::ASSIGNMENT) continue;
+            auto update = static_cast<const Assignment*>(stmt);
+            SymbolId counter = update->symbol;
+            bool negative = false;
+            const Expression* step_expr = inductionStep(update, negative);
+            if (!step_expr || known[counter] == UNKNOWN) continue;
+            if (std::count(assigned.begin(), assigned.end(), counter) != 1) continue;
+            int step = valueOf(step_expr, &assigned);
+            int bound = UNKNOWN;
+            if (refersTo(condition->left, counter)) bound = valueOf(condition->right, &assigned);
+            if (refersTo(condition->right, counter)) bound = valueOf(condition->left, &assigned);
+            if (step == UNKNOWN || bound == UNKNOWN) continue;
+
+            if (negative) step = (256 - step) & 0xFF;
+            bool runs_while_equal = condition->op == BinaryOperator::EQUAL;
+            int value = known[counter];
+            for (int trips = 0; trips <= 256; ++trips) {
+                if ((value == bound) != runs_while_equal) return trips;
+                value = (value + step) & 0xFF;
+            }
+            return UNKNOWN;
+        }
+        return UNKNOWN;
+    }
+
+
+    void learnEqual(const Expression* variable, const Expression* value) {
+        int constant = constantValue(value);
+        if (variable->kind == NodeKind::IDENTIFIER && constant != UNKNOWN) {
+            known[static_cast<const Identifier*>(variable)->symbol] = constant;
+        }
+    }
+
+
+    // Folds each statement in place, dropping the ones that fold away entirely.
+    NodeList<Statement> foldList(NodeList<Statement> list) {
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < list.count; ++i) {
+            if (Statement* folded = fold(list.items[i])) list.items[kept++] = folded;
+        }
+        list.count = kept;
+        return list;
+    }
+
+
+    // What remains of a block that never runs: its declarations still reserve memory,
+    // which reads as zero.
+    Statement* declarationsOnly(BlockStatement* block) {
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < block->statements.count; ++i) {
+            Statement* stmt = block->statements.items[i];
+            if (stmt->kind == NodeKind::BLOCK_STATEMENT) {
+                stmt = declarationsOnly(static_cast<BlockStatement*>(stmt));
+            } else if (stmt->kind == NodeKind::IF_STATEMENT) {
+                stmt = declarationsOnly(static_cast<IfStatement*>(stmt)->body);
+            } else if (stmt->kind == NodeKind::VAR_DECL) {
+                known[static_cast<VarDecl*>(stmt)->symbol] = declared_value;
+            } else {
+                stmt = nullptr;
+            }
+            if (stmt) block->statements.items[kept++] = stmt;
+        }
+        block->statements.count = kept;
+        return kept ? block : nullptr;
+    }
+
+
+    Node* visit(NumberLiteral* node) { return node; }
+
+
+    Node* visit(Identifier* node) {
+        int value = known[node->symbol];
+        if (value == UNKNOWN) return node;
+        return placedAt(program.arena.make<NumberLiteral>(value), node);
+    }
+
+
+    Node* visit(BinaryOp* node) {
+        node->left = fold(node->left);
+        node->right = fold(node->right);
+        // `==` and `!=` have no value of their own; they only feed the cmp of a branch.
+        if (node->op == BinaryOperator::EQUAL || node->op == BinaryOperator::NOT_EQUAL) return node;
+
+        int left = constantValue(node->left);
+        int right = constantValue(node->right);
+        if (left != UNKNOWN && right != UNKNOWN) {
+            int value = node->op == BinaryOperator::ADD ? left + right : left - right;
+            return placedAt(program.arena.make<NumberLiteral>(value & 0xFF), node);
+        }
+        if (right == 0) return node->left;
+        if (left == 0 && node->op == BinaryOperator::ADD) return node->right;
+        return node;
+    }
+
+
+    Node* visit(VarDecl* node) {
+        known[node->symbol] = declared_value;
+        return node;
+    }
+
+
+    Node* visit(Assignment* node) {
+        node->value = fold(node->value);
+        known[node->symbol] = constantValue(node->value);
+        return node;
+    }
+
+
+    Node* visit(BlockStatement* node) {
+        node->statements = foldList(node->statements);
+        return node->statements.empty() ? nullptr : node;
+    }
+
+
+    Node* visit(IfStatement* node) {
+        if (!isComparison(node->condition)) return node;
+        auto condition = static_cast<BinaryOp*>(node->condition);
+
+        condition->left = fold(condition->left);
+        condition->right = fold(condition->right);
+        int left = constantValue(condition->left);
+        int right = constantValue(condition->right);
+        if (left != UNKNOWN && right != UNKNOWN) {
+            if ((left == right) == (condition->op == BinaryOperator::EQUAL)) return visit(node->body);
+            return declarationsOnly(node->body);
+        }
+
+        // The body may or may not run: afterwards only values it left unchanged are known.
+        std::vector<int> before = known;
+        node->body->statements = foldList(node->body->statements);
+        for (size_t i = 0; i < known.size(); ++i) {
+            if (known[i] != before[i]) known[i] = UNKNOWN;
+        }
+        return node->body->statements.empty() ? nullptr : node;
+    }
+
+
+    // A loop with a known trip count is unrolled, fully if that stays within the limit
+    // and otherwise by a factor that divides the count, so that no copy needs the test.
+    Node* visit(WhileStatement* node) {
+        if (!isComparison(node->condition)) return node;
+        auto condition = static_cast<BinaryOp*>(node->condition);
+        std::vector<SymbolId> assigned;
+        collectAssignments(node->body, assigned);
+
+        // A loop whose condition fails on entry never runs, and it declares nothing.
+        int left = valueOf(condition->left);
+        int right = valueOf(condition->right);
+        if (left != UNKNOWN && right != UNKNOWN && (left == right) != (condition->op == BinaryOperator::EQUAL)) {
+            return nullptr;
+        }
+
+        int trips = loops.unroll_limit > 0 ? tripCount(node, assigned) : UNKNOWN;
+        if (trips != UNKNOWN) {
+            int64_t size = countStatements(node->body);
+            if (trips * size <= loops.unroll_limit) return visit(repeatBody(program.arena, node->body, trips));
+            for (int factor = std::min(loops.unroll_factor, trips); factor > 1; --factor) {
+                if (trips % factor == 0 && factor * size <= loops.unroll_limit) {
+                    node->body = repeatBody(program.arena, node->body, factor);
+                    break;
+                }
+            }
+        }
+
+        // The body runs any number of times: only what it leaves unchanged stays known.
+        for (SymbolId symbol : assigned) known[symbol] = UNKNOWN;
+        condition->left = fold(condition->left);
+        condition->right = fold(condition->right);
+        node->body->statements = foldList(node->body->statements);
+        for (SymbolId symbol : assigned) known[symbol] = UNKNOWN;
+
+        // The loop only ends once its condition fails, so `while (i != 10)` leaves i at 10.
+        if (condition->op == BinaryOperator::NOT_EQUAL) {
+            learnEqual(condition->left, condition->right);
+            learnEqual(condition->right, condition->left);
+        }
+        return node;
+    }
+
+
+    Node* visit(Program* node) { return node; }
+};
+
+
+// Strength reduction and loop-invariant code motion over the folded tree, innermost loop
+// first. What either takes out of a loop is computed in front of it, into temporaries
+// named $0, $1, ..., which no identifier in the source can clash with.
+class LoopOptimizer {
+public:
+    LoopOptimizer(Program& program, SymbolTable& symbols, const LoopOptions& options)
+        : program(program), symbols(symbols), options(options), first_temporary(symbols.size()) {}
+
+
+    void run() {
+        program.statements = optimizeList(program.statements);
+        program.temporaries.count = static_cast<uint32_t>(temporaries.size());
+        program.temporaries.items = program.arena.allocateArray<VarDecl*>(temporaries.size());
+        for (size_t i = 0; i < temporaries.size(); ++i) {
+            program.temporaries.items[i] = program.arena.make<VarDecl>(temporaries[i]);
+        }
+    }
+
+
+private:
+    // An expression k*i + n, where i is an induction variable and n does not change in
+    // the loop. `uses` counts the occurrences of i and `leaves` all operands.
+    struct LinearForm {
+        int coefficient = 0;
+        int uses = 0;
+        int leaves = 0;
+    };
+
+    Program& program;
+    SymbolTable& symbols;
+    const LoopOptions& options;
+    SymbolId first_temporary;
+    std::vector<SymbolId> temporaries;
+
+    // State for the loop being optimized: the assignments in its body, the statements to
+    // run in front of it, and the temporary holding each expression taken out of it,
+    // keyed by describe().
+    std::vector<SymbolId> assigned;
+    std::vector<Statement*> preheader;
+    std::unordered_map<std::string, SymbolId> moved;
+
+
+    NodeList<Statement> optimizeList(NodeList<Statement> list) {
+        std::vector<Statement*> out;
+        bool grew = false;
+        for (Statement* stmt : list) {
+            if (stmt->kind == NodeKind::BLOCK_STATEMENT) {
+                auto block = static_cast<BlockStatement*>(stmt);
+                block->statements = optimizeList(block->statements);
+            } else if (stmt->kind == NodeKind::IF_STATEMENT) {
+                BlockStatement* body = static_cast<IfStatement*>(stmt)->body;
+                body->statements = optimizeList(body->statements);
+            } else if (stmt->kind == NodeKind::WHILE_STATEMENT) {
+                std::vector<Statement*> before = optimizeLoop(static_cast<WhileStatement*>(stmt));
+                grew = grew || !before.empty();
+                out.insert(out.end(), before.begin(), before.end());
+            }
+            out.push_back(stmt);
+        }
+        return grew ? makeList(program.arena, out) : list;
+    }
+
+
+    // Returns the statements to run in front of the loop.
+    std::vector<Statement*> optimizeLoop(WhileStatement* loop) {
+        loop->body->statements = optimizeList(loop->body->statements);
+        assigned.clear();
+        collectAssignments(loop->body, assigned);
+        preheader.clear();
+        moved.clear();
+        if (options.reduce_strength) reduceStrength(loop);
+        if (options.hoist_invariants) hoistInvariants(loop);
+        return std::move(preheader);
+    }
+
+
+    // An induction variable i is assigned once per iteration, by `i = i + c` directly in
+    // the body with a constant c. An expression that adds up i at least twice has a
+    // temporary t take its place: t is set to the expression in front of the loop and
+    // advanced by k*c right after i is, so it always equals k*i + n.
+    void reduceStrength(WhileStatement* loop) {
+        NodeList<Statement>& body = loop->body->statements;
+        std::vector<std::vector<Statement*>> updates(body.count);
+        for (uint32_t p = 0; p < body.count; ++p) {
+            if (body[p]->kind != NodeKind::ASSIGNMENT) continue;
+            auto update = static_cast<const Assignment*>(body[p]);
+            bool negative = false;
+            const Expression* step_expr = inductionStep(update, negative);
+            if (!step_expr || step_expr->kind != NodeKind::NUMBER_LITERAL) continue;
+            if (std::count(assigned.begin(), assigned.end(), update->symbol) != 1) continue;
+            int step = static_cast<const NumberLiteral*>(step_expr)->value & 0xFF;
+            if (negative) step = (256 - step) & 0xFF;
+
+            auto reduce = [&](Expression* expr) { return reduceExpression(expr, update->symbol, step, updates[p]); };
+            for (uint32_t q = 0; q < body.count; ++q) {
+                if (q != p) rewriteExpressions(body[q], reduce);
+            }
+            rewriteCondition(loop->condition, reduce);
+        }
+
+        std::vector<Statement*> out;
+        for (uint32_t p = 0; p < body.count; ++p) {
+            out.push_back(body[p]);
+            out.insert(out.end(), updates[p].begin(), updates[p].end());
+        }
+        if (out.size() != body.count) body = makeList(program.arena, out);
+    }
+
+
+    Expression* reduceExpression(Expression* expr, SymbolId counter, int step, std::vector<Statement*>& updates) {
+        if (expr->kind != NodeKind::BINARY_OP) return expr;
+        auto op = static_cast<BinaryOp*>(expr);
+        LinearForm form;
+        if (linearIn(expr, counter, 1, form) && form.uses >= 2 && form.leaves >= 3) {
+            bool created = false;
+            SymbolId temporary = moveOut(expr, created);
+            int delta = ((form.coefficient * step) % 256 + 256) % 256;
+            if (created) {
+                assigned.push_back(temporary);
+                if (delta != 0) {
+                    Expression* advanced = placedAt(program.arena.make<BinaryOp>(
+                        BinaryOperator::ADD, placedAt(program.arena.make<Identifier>(temporary), expr),
+                        placedAt(program.arena.make<NumberLiteral>(delta), expr)), expr);
+                    updates.push_back(placedAt(program.arena.make<Assignment>(temporary, advanced), expr));
+                }
+            }
+            return placedAt(program.arena.make<Identifier>(temporary), expr);
+        }
+        op->left = reduceExpression(op->left, counter, step, updates);
+        op->right = reduceExpression(op->right, counter, step, updates);
+        return expr;
+    }
+
+
+    bool linearIn(const Expression* expr, SymbolId counter, int sign, LinearForm& form) const {
+        switch (expr->kind) {
+            case NodeKind::NUMBER_LITERAL:
+                form.leaves++;
+                return true;
+            case NodeKind::IDENTIFIER: {
+                SymbolId symbol = static_cast<const Identifier*>(expr)->symbol;
+                form.leaves++;
+                if (symbol != counter) return !isAssigned(assigned, symbol);
+                form.coefficient += sign;
+                form.uses++;
+                return true;
+            }
+            default: {
+                auto op = static_cast<const BinaryOp*>(expr);
+                if (op->op != BinaryOperator::ADD && op->op != BinaryOperator::SUBTRACT) return false;
+                return linearIn(op->left, counter, sign, form) &&
+                       linearIn(op->right, counter, op->op == BinaryOperator::SUBTRACT ? -sign : sign, form);
+            }
+        }
+    }
+
+
+    // Expressions the loop cannot change are computed once, in front of it. So is a
+    // temporary that an inner loop set up in this body, if its value does not change.
+    void hoistInvariants(WhileStatement* loop) {
+        NodeList<Statement>& body = loop->body->statements;
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < body.count; ++i) {
+            Statement* stmt = body.items[i];
+            if (stmt->kind == NodeKind::ASSIGNMENT) {
+                auto assignment = static_cast<Assignment*>(stmt);
+                if (assignment->symbol >= first_temporary && isInvariant(assignment->value) &&
+                    std::count(assigned.begin(), assigned.end(), assignment->symbol) == 1) {
+                    assigned.erase(std::find(assigned.begin(), assigned.end(), assignment->symbol));
+                    preheader.push_back(stmt);
+                    continue;
+                }
+            }
+            body.items[kept++] = stmt;
+        }
+        body.count = kept;
+
+        auto hoist = [&](Expression* expr) { return hoistExpression(expr); };
+        for (Statement* stmt : body) rewriteExpressions(stmt, hoist);
+        rewriteCondition(loop->condition, hoist);
+    }
+
+
+    Expression* hoistExpression(Expression* expr) {
+        if (expr->kind != NodeKind::BINARY_OP) return expr;
+        auto op = static_cast<BinaryOp*>(expr);
+        bool arithmetic = op->op == BinaryOperator::ADD || op->op == BinaryOperator::SUBTRACT;
+        if (arithmetic && isInvariant(expr) && hasVariable(expr)) {
+            bool created = false;
+            return placedAt(program.arena.make<Identifier>(moveOut(expr, created)), expr);
+        }
+        op->left = hoistExpression(op->left);
+        op->right = hoistExpression(op->right);
+        return expr;
+    }
+
+
+    bool isInvariant(const Expression* expr) const {
+        switch (expr->kind) {
+            case NodeKind::NUMBER_LITERAL:
+                return true;
+            case NodeKind::IDENTIFIER:
+                return !isAssigned(assigned, static_cast<const Identifier*>(expr)->symbol);
+            default: {
+                auto op = static_cast<const BinaryOp*>(expr);
+                return isInvariant(op->left) && isInvariant(op->right);
+            }
+        }
+    }
+
+
+    static bool hasVariable(const Expression* expr) {
+        if (expr->kind == NodeKind::IDENTIFIER) return true;
+        if (expr->kind != NodeKind::BINARY_OP) return false;
+        auto op = static_cast<const BinaryOp*>(expr);
+        return hasVariable(op->left) || hasVariable(op->right);
+    }
+
+
+    static std::string describe(const Expression* expr) {
+        switch (expr->kind) {
+            case NodeKind::NUMBER_LITERAL:
+                return std::to_string(static_cast<const NumberLiteral*>(expr)->value & 0xFF);
+            case NodeKind::IDENTIFIER:
+                return "#" + std::to_string(static_cast<const Identifier*>(expr)->symbol);
+            default: {
+                auto op = static_cast<const BinaryOp*>(expr);
+                return "(" + describe(op->left) + std::string(operatorSymbol(op->op)) + describe(op->right) + ")";
+            }
+        }
+    }
+
+
+    // The temporary holding `expr` in front of the loop. The first occurrence of an
+    // expression moves there and sets `created`; later ones share its temporary.
+    SymbolId moveOut(Expression* expr, bool& created) {
+        auto [it, inserted] = moved.try_emplace(describe(expr), 0);
+        created = inserted;
+        if (inserted) {
+            it->second = symbols.intern("$" + std::to_string(temporaries.size()));
+            temporaries.push_back(it->second);
+            preheader.push_back(placedAt(program.arena.make<Assignment>(it->second, expr), expr));
+        }
+        return it->second;
+    }
+
+
+    // Applies `rewrite` to every expression `stmt` evaluates, nested statements included.
+    template <typename Rewrite>
+    static void rewriteExpressions(Statement* stmt, Rewrite& rewrite) {
+        switch (stmt->kind) {
+            case NodeKind::ASSIGNMENT: {
+                auto assignment = static_cast<Assignment*>(stmt);
+                assignment->value = rewrite(assignment->value);
+                break;
+            }
+            case NodeKind::BLOCK_STATEMENT:
+                for (Statement* child : static_cast<BlockStatement*>(stmt)->statements) rewriteExpressions(child, rewrite);
+                break;
+            case NodeKind::IF_STATEMENT: {
+                auto branch = static_cast<IfStatement*>(stmt);
+                rewriteCondition(branch->condition, rewrite);
+                rewriteExpressions(branch->body, rewrite);
+                break;
+            }
+            case NodeKind::WHILE_STATEMENT: {
+                auto loop = static_cast<WhileStatement*>(stmt);
+                rewriteCondition(loop->condition, rewrite);
+                rewriteExpressions(loop->body, rewrite);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+
+    // The comparison itself stays, for the cmp; only its operands are rewritten.
+    template <typename Rewrite>
+    static void rewriteCondition(Expression* condition, Rewrite& rewrite) {
+        if (!isComparison(condition)) return;
+        auto compare = static_cast<BinaryOp*>(condition);
+        compare->left = rewrite(compare->left);
+        compare->right = rewrite(compare->right);
+    }
+};
+
+}
+
+
+void optimizeProgram(Program& program, SymbolTable& symbols, int level, bool zero_declarations, const LoopOptions& loops) {
+    if (level <= 0) return;
+    ConstantFolder(program, symbols.size(), zero_declarations, loops).run();
+    if (loops.hoist_invariants || loops.reduce_strength) LoopOptimizer(program, symbols, loops).run();
+}
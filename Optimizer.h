@@ -0,0 +1,41 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+
+#include "ast.h"
+#include "SymbolTable.h"
+
+
+// Limits and switches for the while-loop optimizations run from level 1 up.
+struct LoopOptions {
+    // A loop whose trip count is known when it is reached is replaced by that many
+    // copies of its body, if they come to at most this many statements. 0 disables
+    // unrolling altogether.
+    int unroll_limit = 32;
+    // A loop too long to unroll fully runs this many copies of its body per test
+    // instead, or the largest smaller factor that divides the trip count and stays
+    // within unroll_limit. 1 disables partial unrolling.
+    int unroll_factor = 4;
+    // Move expressions that do not change inside a loop in front of it.
+    bool hoist_invariants = true;
+    // Replace expressions that add up an induction variable several times, the only way
+    // to multiply in the language, by a temporary stepped along with the variable.
+    bool reduce_strength = true;
+};
+
+
+// AST-level optimizations, run between Parser::parse and CodeGenerator::generate.
+// Level 0 leaves the tree untouched; level 1 and above fold constants with the CPU's
+// 8-bit wraparound, propagate known variable values through straight-line code, remove
+// if statements whose condition is known and optimize while loops as set by `loops`.
+// Hoisting and strength reduction introduce temporaries, which are listed in
+// Program::temporaries.
+//
+// A declaration normally makes its variable a known 0, since memory starts zeroed. A
+// module linked with others passes `zero_declarations` false: a module that ran before
+// it may already have written the variable.
+void optimizeProgram(Program& program, SymbolTable& symbols, int level, bool zero_declarations = true,
+                     const LoopOptions& loops = LoopOptions());
+
+
+#endif
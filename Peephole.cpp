@@ -0,0 +1,232 @@
+#include "Peephole.h"
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+
+namespace {
+
+Reg sourceRegister(const AsmItem& item) {
+    return static_cast<Reg>(item.instr.operand);
+}
+
+
+bool writesA(const AsmItem& item) {
+    return item.is(Opcode::LDI, Reg::A) || item.is(Opcode::LDA) || item.is(Opcode::MOV, Reg::A);
+}
+
+
+bool writesB(const AsmItem& item) {
+    return item.is(Opcode::LDI, Reg::B) || item.is(Opcode::MOV, Reg::B);
+}
+
+
+AsmItem makeInstruction(Opcode op, Reg reg, uint16_t operand) {
+    AsmItem item;
+    item.instr = {op, reg, operand};
+    return item;
+}
+
+
+bool sameAddress(const AsmItem& a, const AsmItem& b) {
+    return a.instr.operand == b.instr.operand;
+}
+
+
+// sta N; lda N  ->  sta N
+bool storeThenLoad(const AsmItem* const* w, std::vector<AsmItem>& out) {
+    if (!w[0]->is(Opcode::STA) || !w[1]->is(Opcode::LDA) || !sameAddress(*w[0], *w[1])) return false;
+    out.push_back(*w[0]);
+    return true;
+}
+
+
+// lda N; sta N  ->  lda N
+bool loadThenStore(const AsmItem* const* w, std::vector<AsmItem>& out) {
+    if (!w[0]->is(Opcode::LDA) || !w[1]->is(Opcode::STA) || !sameAddress(*w[0], *w[1])) return false;
+    out.push_back(*w[0]);
+    return true;
+}
+
+
+// sta N; sta N  ->  sta N
+bool repeatedStore(const AsmItem* const* w, std::vector<AsmItem>& out) {
+    if (!w[0]->is(Opcode::STA) || !w[1]->is(Opcode::STA) || !sameAddress(*w[0], *w[1])) return false;
+    out.push_back(*w[0]);
+    return true;
+}
+
+
+// push R; pop R  ->  (nothing)
+bool pushPopSame(const AsmItem* const* w, std::vector<AsmItem>&) {
+    return w[0]->is(Opcode::PUSH) && w[1]->is(Opcode::POP) && w[0]->instr.reg == w[1]->instr.reg;
+}
+
+
+// push A; pop B  ->  mov B A   (and the mirror image)
+bool pushPopMove(const AsmItem* const* w, std::vector<AsmItem>& out) {
+    if (w[0]->is(Opcode::PUSH, Reg::A) && w[1]->is(Opcode::POP, Reg::B)) {
+        out.push_back(makeInstruction(Opcode::MOV, Reg::B, static_cast<uint16_t>(Reg::A)));
+        return true;
+    }
+    if (w[0]->is(Opcode::PUSH, Reg::B) && w[1]->is(Opcode::POP, Reg::A)) {
+        out.push_back(makeInstruction(Opcode::MOV, Reg::A, static_cast<uint16_t>(Reg::B)));
+        return true;
+    }
+    return false;
+}
+
+
+// A load into A that is overwritten before anything reads A. None of these touch flags.
+bool deadWriteA(const AsmItem* const* w, std::vector<AsmItem>& out) {
+    if (!writesA(*w[0]) || !writesA(*w[1])) return false;
+    out.push_back(*w[1]);
+    return true;
+}
+
+
+// ldi B n; mov B A  ->  mov B A, and likewise for any pair of plain writes to B.
+bool deadWriteB(const AsmItem* const* w, std::vector<AsmItem>& out) {
+    if (!writesB(*w[0]) || !writesB(*w[1])) return false;
+    out.push_back(*w[1]);
+    return true;
+}
+
+
+// sta N; <load into A that does not read N>; sta N  ->  drop the first store
+bool overwrittenStore(const AsmItem* const* w, std::vector<AsmItem>& out) {
+    if (!w[0]->is(Opcode::STA) || !w[2]->is(Opcode::STA) || !sameAddress(*w[0], *w[2])) return false;
+    if (!writesA(*w[1]) || (w[1]->is(Opcode::LDA) && sameAddress(*w[1], *w[0]))) return false;
+    out.push_back(*w[1]);
+    out.push_back(*w[2]);
+    return true;
+}
+
+
+// push A; ldi A n; mov B A; pop A  ->  ldi B n   (the stack-operand sequence for a literal)
+bool spilledLiteral(const AsmItem* const* w, std::vector<AsmItem>& out) {
+    if (!w[0]->is(Opcode::PUSH, Reg::A) || !w[1]->is(Opcode::LDI, Reg::A) || !w[2]->is(Opcode::MOV, Reg::B) ||
+        !w[3]->is(Opcode::POP, Reg::A)) {
+        return false;
+    }
+    if (sourceRegister(*w[2]) != Reg::A) return false;
+    out.push_back(makeInstruction(Opcode::LDI, Reg::B, w[1]->instr.operand));
+    return true;
+}
+
+
+// mov A B; mov B A  ->  mov A B   (both registers already hold the same value)
+bool moveBack(const AsmItem* const* w, std::vector<AsmItem>& out) {
+    if (!w[0]->is(Opcode::MOV) || !w[1]->is(Opcode::MOV)) return false;
+    if (w[0]->instr.reg != sourceRegister(*w[1]) || sourceRegister(*w[0]) != w[1]->instr.reg) return false;
+    out.push_back(*w[0]);
+    return true;
+}
+
+}
+
+
+const std::vector<PeepholeRule>& defaultPeepholeRules() {
+    static const std::vector<PeepholeRule> rules = {
+        {"store-load", 2, storeThenLoad},
+        {"load-store", 2, loadThenStore},
+        {"store-store", 2, repeatedStore},
+        {"push-pop", 2, pushPopSame},
+        {"push-pop-move", 2, pushPopMove},
+        {"dead-write-a", 2, deadWriteA},
+        {"dead-write-b", 2, deadWriteB},
+        {"move-back", 2, moveBack},
+        {"overwritten-store", 3, overwrittenStore},
+        {"spilled-literal", 4, spilledLiteral},
+    };
+    return rules;
+}
+
+
+PeepholeOptimizer::PeepholeOptimizer(const std::vector<PeepholeRule>& rules) : table(rules) {
+    totals.fired.assign(table.size(), 0);
+}
+
+
+void PeepholeOptimizer::optimize(AsmBuffer& code) {
+    totals.instructions_before += code.instructionCount();
+    do {
+        totals.passes++;
+    } while (runPass(code.items()));
+    totals.instructions_after += code.instructionCount();
+}
+
+
+// One left-to-right scan that compacts `items` in place. The window at each instruction
+// is gathered once, skipping comment items and stopping at a label; comments inside a
+// rewritten window are re-emitted after the replacement. Instructions a rule makes up
+// keep the source position of the window's first instruction. Returns true if any rule
+// fired.
+bool PeepholeOptimizer::runPass(std::vector<AsmItem>& items) {
+    size_t widest = 0;
+    for (const PeepholeRule& rule : table) widest = std::max(widest, rule.window);
+
+    std::vector<size_t> positions;
+    std::vector<const AsmItem*> window;
+    std::vector<AsmItem> replacement;
+    bool changed = false;
+
+    size_t write = 0;
+    size_t i = 0;
+    while (i < items.size()) {
+        size_t consumed = 0;
+        if (items[i].kind == AsmItem::Kind::INSTRUCTION) {
+            positions.clear();
+            window.clear();
+            for (size_t j = i; j < items.size() && window.size() < widest; ++j) {
+                if (items[j].kind == AsmItem::Kind::LABEL) break;
+                if (items[j].kind == AsmItem::Kind::INSTRUCTION) {
+                    positions.push_back(j);
+                    window.push_back(&items[j]);
+                }
+            }
+            for (size_t r = 0; r < table.size(); ++r) {
+                const PeepholeRule& rule = table[r];
+                if (window.size() < rule.window) continue;
+                replacement.clear();
+                if (rule.rewrite(window.data(), replacement)) {
+                    for (AsmItem& item : replacement) {
+                        if (item.source == AsmItem::NONE) item.source = window[0]->source;
+                    }
+                    totals.fired[r]++;
+                    consumed = rule.window;
+                    break;
+                }
+            }
+        }
+
+        if (consumed == 0) {
+            if (write != i) items[write] = std::move(items[i]);
+            write++;
+            i++;
+            continue;
+        }
+
+        // The replacement is shorter than the window, so the output never overtakes the
+        // unread part of `items`.
+        changed = true;
+        size_t last = positions[consumed - 1];
+        for (size_t j = i; j <= last; ++j) {
+            if (items[j].kind == AsmItem::Kind::COMMENT) replacement.push_back(std::move(items[j]));
+        }
+        for (AsmItem& item : replacement) items[write++] = std::move(item);
+        i = last + 1;
+    }
+    items.resize(write);
+    return changed;
+}
+
+
+void PeepholeOptimizer::printStats(std::ostream& out) const {
+    out << "--- Peephole Statistics ---" << std::endl;
+    for (size_t r = 0; r < table.size(); ++r) {
+        out << std::left << std::setw(20) << table[r].name << std::right << std::setw(8) << totals.fired[r] << std::endl;
+    }
+    out << "Passes: " << totals.passes << ", instructions: " << totals.instructions_before
+        << " -> " << totals.instructions_after << std::endl;
+}
@@ -0,0 +1,55 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+
+#include "AsmBuffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+
+// A rewrite over `window` consecutive instructions. `rewrite` returns false when the
+// pattern does not match; otherwise it fills `out` with the replacement, which must be
+// shorter than the window so that iterating to a fixpoint terminates.
+struct PeepholeRule {
+    const char* name;
+    size_t window;
+    bool (*rewrite)(const AsmItem* const* window, std::vector<AsmItem>& out);
+};
+
+
+// The built-in rule table. Adding a pattern means adding a row here.
+const std::vector<PeepholeRule>& defaultPeepholeRules();
+
+
+struct PeepholeStats {
+    std::vector<uint64_t> fired;    // indexed like the rule table
+    size_t passes = 0;
+    size_t instructions_before = 0;
+    size_t instructions_after = 0;
+};
+
+
+// Sliding-window optimizer that runs between the code generators and assemble(). Every
+// rule is tried at every instruction and the whole buffer is rescanned until a pass
+// changes nothing. Labels are barriers that no window may span; comments are carried
+// along. Stats accumulate across calls to optimize().
+class PeepholeOptimizer {
+public:
+    explicit PeepholeOptimizer(const std::vector<PeepholeRule>& rules = defaultPeepholeRules());
+    void optimize(AsmBuffer& code);
+    const std::vector<PeepholeRule>& rules() const { return table; }
+    const PeepholeStats& stats() const { return totals; }
+    void printStats(std::ostream& out) const;
+
+
+private:
+    const std::vector<PeepholeRule>& table;
+    PeepholeStats totals;
+
+    bool runPass(std::vector<AsmItem>& items);
+};
+
+
+#endif
@@ -0,0 +1,213 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+
+namespace {
+
+struct BasicBlock {
+    size_t begin;
+    size_t end;
+    uint64_t entries;
+    uint64_t executed;
+};
+
+
+// Blocks start at instruction 0, at jump targets and after jmp, jne and hlt, as in the
+// JIT. Every entry into a block runs its first instruction, so that count is its entries.
+std::vector<BasicBlock> basicBlocks(const MachineInstr* program, const std::vector<uint64_t>& counts) {
+    size_t count = counts.size();
+    std::vector<bool> leader(count + 1, false);
+    leader[0] = true;
+    for (size_t i = 0; i < count; ++i) {
+        Opcode op = program[i].op;
+        if (op == Opcode::JMP || op == Opcode::JNE) {
+            if (program[i].operand < count) leader[program[i].operand] = true;
+        }
+        if (op == Opcode::JMP || op == Opcode::JNE || op == Opcode::HLT) leader[i + 1] = true;
+    }
+
+    std::vector<BasicBlock> blocks;
+    for (size_t begin = 0; begin < count;) {
+        size_t end = begin + 1;
+        while (end < count && !leader[end]) end++;
+        uint64_t executed = std::accumulate(counts.begin() + begin, counts.begin() + end, uint64_t{0});
+        blocks.push_back({begin, end, counts[begin], executed});
+        begin = end;
+    }
+    return blocks;
+}
+
+
+std::string instructionText(const MachineInstr& instr) {
+    std::string text = opcodeName(instr.op);
+    switch (instr.op) {
+        case Opcode::LDI:
+            return text + " " + registerName(instr.reg) + " " + std::to_string(instr.operand);
+        case Opcode::LDA:
+        case Opcode::STA:
+        case Opcode::JMP:
+        case Opcode::JNE:
+            return text + " " + std::to_string(instr.operand);
+        case Opcode::MOV:
+            return text + " " + registerName(instr.reg) + " " + registerName(static_cast<Reg>(instr.operand));
+        case Opcode::PUSH:
+        case Opcode::POP:
+            return text + " " + registerName(instr.reg);
+        default:
+            return text;
+    }
+}
+
+
+std::string percent(uint64_t part, uint64_t total) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << (total ? 100.0 * static_cast<double>(part) / static_cast<double>(total) : 0.0) << "%";
+    return out.str();
+}
+
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) text.remove_suffix(1);
+    return text;
+}
+
+
+uint32_t lineOf(const ProfileSource& source, size_t pc) {
+    if (!source.line_table || pc >= source.line_table->size()) return 0;
+    return (*source.line_table)[pc].line;
+}
+
+
+// Folded stack frames are separated by ';' and the count by the last space, so a frame
+// cannot contain ';'. Statements end in one, which carries no information anyway.
+std::string frame(std::string_view text) {
+    std::string out;
+    for (char c : trim(text)) {
+        if (c != ';') out += c;
+    }
+    return std::string(trim(out));
+}
+
+}
+
+
+std::vector<SourceLocation> lineTable(const AsmBuffer& code, const LineIndex& lines) {
+    std::vector<SourceLocation> table;
+    for (uint32_t offset : sourceOffsets(code)) {
+        table.push_back(offset == AsmItem::NONE ? SourceLocation() : lines.locate(offset));
+    }
+    return table;
+}
+
+
+void ExecutionProfile::attach(const MachineInstr* instructions, size_t count) {
+    if (program == instructions && counts.size() == count) return;
+    program = instructions;
+    counts.assign(count, 0);
+}
+
+
+uint64_t ExecutionProfile::total() const {
+    return std::accumulate(counts.begin(), counts.end(), uint64_t{0});
+}
+
+
+void ExecutionProfile::print(std::ostream& out, const ProfileSource& source, size_t limit) const {
+    uint64_t executed = total();
+    out << "--- Execution Profile ---" << std::endl;
+    out << "Instructions executed: " << executed << std::endl;
+
+    std::vector<size_t> hot;
+    for (size_t pc = 0; pc < counts.size(); ++pc) {
+        if (counts[pc]) hot.push_back(pc);
+    }
+    std::stable_sort(hot.begin(), hot.end(), [&](size_t a, size_t b) { return counts[a] > counts[b]; });
+    out << "Hottest instructions:" << std::endl;
+    for (size_t i = 0; i < hot.size() && i < limit; ++i) {
+        size_t pc = hot[i];
+        out << std::setw(8) << pc << std::setw(14) << counts[pc] << std::setw(8) << percent(counts[pc], executed) << "  ";
+        if (uint32_t line = lineOf(source, pc)) {
+            out << std::left << std::setw(12) << instructionText(program[pc]) << std::right << "  line " << line << ":"
+                << (*source.line_table)[pc].column;
+        } else {
+            out << instructionText(program[pc]);
+        }
+        out << std::endl;
+    }
+
+    std::vector<BasicBlock> blocks = basicBlocks(program, counts);
+    std::stable_sort(blocks.begin(), blocks.end(), [](const BasicBlock& a, const BasicBlock& b) { return a.executed > b.executed; });
+    out << "Hottest basic blocks:" << std::endl;
+    for (size_t i = 0; i < blocks.size() && i < limit && blocks[i].executed; ++i) {
+        const BasicBlock& block = blocks[i];
+        std::string range = std::to_string(block.begin) + "-" + std::to_string(block.end - 1);
+        out << std::setw(13) << range << std::setw(12) << block.entries << " entries" << std::setw(14) << block.executed
+            << " instructions" << std::setw(8) << percent(block.executed, executed);
+        uint32_t first = 0;
+        uint32_t last = 0;
+        for (size_t pc = block.begin; pc < block.end; ++pc) {
+            uint32_t line = lineOf(source, pc);
+            if (!line) continue;
+            first = first ? std::min(first, line) : line;
+            last = std::max(last, line);
+        }
+        if (first) out << "  line" << (first == last ? " " + std::to_string(first) : "s " + std::to_string(first) + "-" + std::to_string(last));
+        out << std::endl;
+    }
+
+    if (!source.line_table) return;
+    std::vector<uint64_t> per_line;
+    uint64_t unattributed = 0;
+    for (size_t pc = 0; pc < counts.size(); ++pc) {
+        uint32_t line = lineOf(source, pc);
+        if (!line) {
+            unattributed += counts[pc];
+            continue;
+        }
+        if (per_line.size() <= line) per_line.resize(line + 1, 0);
+        per_line[line] += counts[pc];
+    }
+    out << "Source lines:" << std::endl;
+    for (uint32_t line = 1; line < per_line.size(); ++line) {
+        if (!per_line[line]) continue;
+        out << std::setw(8) << line << std::setw(14) << per_line[line] << std::setw(8) << percent(per_line[line], executed);
+        if (source.lines) out << "  " << trim(source.lines->line(line));
+        out << std::endl;
+    }
+    if (unattributed) {
+        out << std::setw(8) << "-" << std::setw(14) << unattributed << std::setw(8) << percent(unattributed, executed)
+            << "  (no source line)" << std::endl;
+    }
+}
+
+
+void ExecutionProfile::printFolded(std::ostream& out, const ProfileSource& source) const {
+    std::string root = frame(source.name);
+    std::vector<std::string> block_frames;
+    if (!source.line_table) {
+        block_frames.resize(counts.size());
+        for (const BasicBlock& block : basicBlocks(program, counts)) {
+            std::string name = "block " + std::to_string(block.begin) + "-" + std::to_string(block.end - 1);
+            std::fill(block_frames.begin() + block.begin, block_frames.begin() + block.end, name);
+        }
+    }
+
+    for (size_t pc = 0; pc < counts.size(); ++pc) {
+        if (!counts[pc]) continue;
+        out << root << ";";
+        if (!source.line_table) {
+            out << block_frames[pc];
+        } else if (uint32_t line = lineOf(source, pc)) {
+            out << "line " << line;
+            std::string text = source.lines ? frame(source.lines->line(line)) : std::string();
+            if (!text.empty()) out << ": " << text;
+        } else {
+            out << "[no source line]";
+        }
+        out << ";" << pc << ": " << instructionText(program[pc]) << " " << counts[pc] << "\n";
+    }
+}
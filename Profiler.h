@@ -0,0 +1,54 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+
+#include "AsmBuffer.h"
+#include "Isa.h"
+#include "lexer.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// The line table: the source location of each instruction assemble(code) returns, from
+// the offsets the code generators recorded. Instructions without one get line 0.
+std::vector<SourceLocation> lineTable(const AsmBuffer& code, const LineIndex& lines);
+
+
+// What the reports know about the program besides its instructions. Without a line
+// table, e.g. for an object file, code is reported by address and basic block only.
+struct ProfileSource {
+    // The root frame of the folded stacks.
+    std::string name = "program";
+    const std::vector<SourceLocation>* line_table = nullptr;
+    const LineIndex* lines = nullptr;
+};
+
+
+// Execution counts per instruction, filled in by CPU::runCounted(). Counts add up over
+// runs of the same program, which must outlive the profile.
+class ExecutionProfile {
+public:
+    // Counts from here on are for `program`; the old counts are dropped if it differs.
+    void attach(const MachineInstr* program, size_t count);
+    void record(size_t pc) { counts[pc]++; }
+    uint64_t count(size_t pc) const { return counts[pc]; }
+    uint64_t total() const;
+    // The hottest instructions and basic blocks, and with a line table the total of
+    // every source line that ran, in line order.
+    void print(std::ostream& out, const ProfileSource& source = ProfileSource(), size_t limit = 10) const;
+    // One `name;line;instruction count` line per executed instruction: the folded stack
+    // format flamegraph.pl and speedscope read. Without a line table the middle frame
+    // is the instruction's basic block.
+    void printFolded(std::ostream& out, const ProfileSource& source = ProfileSource()) const;
+
+
+private:
+    const MachineInstr* program = nullptr;
+    std::vector<uint64_t> counts;
+};
+
+
+#endif
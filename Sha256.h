@@ -0,0 +1,36 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+
+// Incremental SHA-256 (FIPS 180-4).
+class Sha256 {
+public:
+    using Digest = std::array<uint8_t, 32>;
+
+    Sha256();
+    void update(std::string_view data);
+    // Pads and returns the digest. The object must not be updated afterwards.
+    Digest finish();
+
+    static Digest hash(std::string_view data);
+    static std::string toHex(const Digest& digest);
+
+
+private:
+    uint32_t state[8];
+    uint8_t block[64];
+    size_t block_size = 0;
+    uint64_t total_bytes = 0;
+
+    void compress(const uint8_t* data);
+};
+
+
+#endif
@@ -0,0 +1,19 @@
+#include "SymbolTable.h"
+
+
+SymbolId SymbolTable::intern(std::string_view name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) return it->second;
+
+    SymbolId id = static_cast<SymbolId>(names.size());
+    names.push_back(storage.copyString(name));
+    ids.emplace(names.back(), id);
+    return id;
+}
+
+
+void SymbolTable::clear() {
+    ids.clear();
+    names.clear();
+    storage.reset();
+}
@@ -0,0 +1,32 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Arena.h"
+
+
+using SymbolId = uint32_t;
+
+
+class SymbolTable {
+public:
+    SymbolId intern(std::string_view name);
+    std::string_view name(SymbolId id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+    // Forgets every name but keeps the allocated storage, for reuse on another file.
+    void clear();
+
+
+private:
+    // Name text lives in the arena, so the views used as keys stay valid.
+    Arena storage{4 * 1024};
+    std::vector<std::string_view> names;
+    std::unordered_map<std::string_view, SymbolId> ids;
+};
+
+
+#endif
@@ -0,0 +1,93 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+
+WorkStealingPool::WorkStealingPool(unsigned threads) {
+    thread_count = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < thread_count; ++i) queues.push_back(std::make_unique<Queue>());
+    for (unsigned worker = 1; worker < thread_count; ++worker) {
+        this->threads.emplace_back([this, worker] { workerLoop(worker); });
+    }
+}
+
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) thread.join();
+}
+
+
+void WorkStealingPool::run(size_t count, const std::function<void(size_t, unsigned)>& work) {
+    if (count == 0) return;
+    task = &work;
+    remaining = count;
+    for (unsigned worker = 0; worker < thread_count; ++worker) {
+        size_t begin = count * worker / thread_count;
+        size_t end = count * (worker + 1) / thread_count;
+        std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+        for (size_t index = begin; index < end; ++index) queues[worker]->items.push_back(index);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation++;
+    }
+    wake.notify_all();
+
+    drain(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return remaining == 0; });
+    task = nullptr;
+}
+
+
+void WorkStealingPool::workerLoop(unsigned worker) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        drain(worker);
+    }
+}
+
+
+void WorkStealingPool::drain(unsigned worker) {
+    size_t index;
+    while (take(worker, index)) {
+        (*task)(index, worker);
+        if (remaining.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.notify_all();
+        }
+    }
+}
+
+
+bool WorkStealingPool::take(unsigned worker, size_t& index) {
+    {
+        Queue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.items.empty()) {
+            index = own.items.front();
+            own.items.pop_front();
+            return true;
+        }
+    }
+    for (unsigned offset = 1; offset < thread_count; ++offset) {
+        Queue& victim = *queues[(worker + offset) % thread_count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.items.empty()) {
+            index = victim.items.back();
+            victim.items.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
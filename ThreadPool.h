@@ -0,0 +1,60 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed set of worker threads with one task queue each. run() deals the indices out in
+// contiguous chunks, one per queue; a worker takes from the front of its own queue and,
+// once that is empty, steals from the back of the others. The calling thread works as
+// worker 0, so a pool of one thread runs everything inline.
+class WorkStealingPool {
+public:
+    // 0 means one thread per hardware thread.
+    explicit WorkStealingPool(unsigned threads = 0);
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned threadCount() const { return thread_count; }
+    // Calls task(index, worker) for every index in [0, count) and returns once all
+    // calls have finished. `worker` is below threadCount() and identifies the calling
+    // thread, for per-thread state. Tasks must not throw.
+    void run(size_t count, const std::function<void(size_t, unsigned)>& task);
+
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> items;
+    };
+
+    unsigned thread_count;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    uint64_t generation = 0;
+    bool stopping = false;
+    std::atomic<size_t> remaining{0};
+    const std::function<void(size_t, unsigned)>* task = nullptr;
+
+    void workerLoop(unsigned worker);
+    void drain(unsigned worker);
+    bool take(unsigned worker, size_t& index);
+};
+
+
+#endif
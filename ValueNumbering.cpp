@@ -0,0 +1,147 @@
+#include "ValueNumbering.h"
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+
+namespace {
+
+struct ExpressionKey {
+    IrOp op;
+    uint32_t left;
+    uint32_t right;
+
+    bool operator==(const ExpressionKey& other) const {
+        return op == other.op && left == other.left && right == other.right;
+    }
+};
+
+
+struct ExpressionKeyHash {
+    size_t operator()(const ExpressionKey& key) const {
+        size_t hash = static_cast<size_t>(key.op);
+        hash = hash * 1000003u ^ key.left;
+        hash = hash * 1000003u ^ key.right;
+        return hash;
+    }
+};
+
+
+IrValue* resolve(IrValue* value) {
+    while (value->replacement) value = value->replacement;
+    return value;
+}
+
+
+class ValueNumbering {
+public:
+    explicit ValueNumbering(IrFunction& function) : function(function) {}
+
+
+    size_t run() {
+        function.renumber();
+        computeDominators(function);
+
+        // Preorder walk of the dominator tree. Expressions entered while visiting a block
+        // stay visible to the blocks it dominates and are dropped when the walk leaves it.
+        struct Frame {
+            IrBlock* block;
+            size_t next_child;
+            size_t scope_start;
+        };
+        std::vector<Frame> stack;
+        stack.push_back({&function.blocks.front(), 0, scope.size()});
+        visit(stack.back().block);
+        while (!stack.empty()) {
+            Frame& frame = stack.back();
+            if (frame.next_child < frame.block->dominated.size()) {
+                IrBlock* child = frame.block->dominated[frame.next_child++];
+                stack.push_back({child, 0, scope.size()});
+                visit(child);
+                continue;
+            }
+            while (scope.size() > frame.scope_start) {
+                table.erase(scope.back());
+                scope.pop_back();
+            }
+            stack.pop_back();
+        }
+
+        resolveAllUses();
+        return replaced;
+    }
+
+
+private:
+    IrFunction& function;
+    std::unordered_map<ExpressionKey, IrValue*, ExpressionKeyHash> table;
+    std::vector<ExpressionKey> scope;
+    size_t replaced = 0;
+
+
+    void replace(IrValue* value, IrValue* with) {
+        value->replacement = with;
+        replaced++;
+    }
+
+
+    void visit(IrBlock* block) {
+        std::map<std::vector<uint32_t>, IrValue*> phis;
+        std::vector<uint32_t> phi_key;
+        auto& list = block->instructions;
+        for (IrValue* value : list) {
+            for (IrValue*& operand : value->operands) operand = resolve(operand);
+
+            if (value->op == IrOp::PHI) {
+                // A phi whose operands are all one value is that value. Operands from
+                // blocks not visited yet may still be replaced later, but replacement
+                // only ever merges values, so a match found now stays valid.
+                IrValue* same = value->operands[0];
+                bool trivial = std::all_of(value->operands.begin(), value->operands.end(),
+                                           [&](IrValue* operand) { return operand == same || operand == value; });
+                if (trivial && same != value) {
+                    replace(value, same);
+                    continue;
+                }
+                phi_key.clear();
+                for (IrValue* operand : value->operands) phi_key.push_back(operand->id);
+                auto [it, inserted] = phis.emplace(phi_key, value);
+                if (!inserted) replace(value, it->second);
+                continue;
+            }
+            if (value->op != IrOp::ADD && value->op != IrOp::SUB) continue;
+
+            ExpressionKey key{value->op, value->operands[0]->id, value->operands[1]->id};
+            if (value->op == IrOp::ADD && key.left > key.right) std::swap(key.left, key.right);
+            auto [it, inserted] = table.emplace(key, value);
+            if (inserted) {
+                scope.push_back(key);
+            } else {
+                replace(value, it->second);
+            }
+        }
+        list.erase(std::remove_if(list.begin(), list.end(), [](IrValue* value) { return value->replacement; }),
+                   list.end());
+    }
+
+
+    void resolveAllUses() {
+        for (IrBlock& block : function.blocks) {
+            for (IrValue* value : block.instructions) {
+                for (IrValue*& operand : value->operands) operand = resolve(operand);
+            }
+            for (IrValue*& operand : block.condition) {
+                if (operand) operand = resolve(operand);
+            }
+        }
+        for (IrExitValue& exit : function.exit_values) exit.value = resolve(exit.value);
+    }
+};
+
+}
+
+
+size_t numberValues(IrFunction& function) {
+    return ValueNumbering(function).run();
+}
@@ -0,0 +1,19 @@
+#ifndef VALUE_NUMBERING_H
+#define VALUE_NUMBERING_H
+
+
+#include "Ir.h"
+#include <cstddef>
+
+
+// Global value numbering over the dominator tree. Arithmetic values are hash-consed on
+// their opcode and operands (with the operands of add put in a canonical order), so an
+// expression that was already computed in a dominating block, or earlier in the same
+// block, is reused instead of recomputed. SSA guarantees that the operands cannot have
+// been reassigned in between. Phis that merge the same values in the same block are
+// merged too. Returns the number of values replaced; the replaced values are left
+// unreachable, so run eliminateDeadStores() or renumber() afterwards.
+size_t numberValues(IrFunction& function);
+
+
+#endif
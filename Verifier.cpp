@@ -0,0 +1,121 @@
+#include "Verifier.h"
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+
+namespace {
+
+constexpr int64_t UNBOUNDED = std::numeric_limits<int32_t>::max();
+// A loop head whose interval has grown this many times gets it widened to unbounded.
+constexpr int WIDEN_AFTER = 2;
+
+
+// Stack depth in bytes pushed since entry; empty while low > high.
+struct Depth {
+    int64_t low;
+    int64_t high;
+};
+
+
+ProgramVerification failure(ProgramVerification& result, size_t at, std::string reason) {
+    result.verified = false;
+    result.instruction = at;
+    result.reason = std::move(reason);
+    return result;
+}
+
+}
+
+
+ProgramVerification verifyProgram(const MachineInstr* program, size_t count, const MachineModel& machine) {
+    ProgramVerification result;
+    const size_t n = std::min(count, MAX_PROGRAM_SIZE);
+    // A push that leaves the stack deeper than this faults.
+    const int64_t capacity = static_cast<int64_t>(machine.stack_size) - 1;
+
+    std::vector<Depth> depth(n, Depth{0, -1});
+    std::vector<uint8_t> changes(n, 0);
+    std::vector<size_t> worklist;
+
+    // Joins `in` into the interval of `target` and queues it if that grew. Returns false
+    // if `target` is not an instruction, i.e. control would leave the program. Every
+    // cycle contains a backward edge, so widening only at their targets ends every loop.
+    auto flowTo = [&](size_t from, size_t target, Depth in) {
+        if (target >= n) return false;
+        Depth& current = depth[target];
+        if (current.low > current.high) {
+            current = in;
+            worklist.push_back(target);
+            return true;
+        }
+        Depth joined{std::min(current.low, in.low), std::max(current.high, in.high)};
+        if (joined.low == current.low && joined.high == current.high) return true;
+        if (target <= from && ++changes[target] > WIDEN_AFTER) {
+            if (joined.low < current.low) joined.low = -UNBOUNDED;
+            if (joined.high > current.high) joined.high = UNBOUNDED;
+        }
+        current = joined;
+        worklist.push_back(target);
+        return true;
+    };
+
+    if (!flowTo(0, 0, Depth{0, 0})) return failure(result, 0, "Program is empty");
+    while (!worklist.empty()) {
+        size_t i = worklist.back();
+        worklist.pop_back();
+        const MachineInstr& instr = program[i];
+        Depth in = depth[i];
+        Depth out = in;
+
+        switch (instr.op) {
+            case Opcode::LDA:
+            case Opcode::STA:
+                if (instr.operand >= machine.memory_size) {
+                    return failure(result, i, "Address " + std::to_string(instr.operand) + " is outside memory");
+                }
+                result.min_address = std::min<uint32_t>(result.min_address, instr.operand);
+                result.max_address = std::max<uint32_t>(result.max_address, instr.operand);
+                break;
+            case Opcode::PUSH:
+                out = {in.low + 1, in.high + 1};
+                if (out.high > capacity) return failure(result, i, "Stack may overflow");
+                result.max_stack_depth = std::max(result.max_stack_depth, static_cast<uint32_t>(out.high));
+                break;
+            case Opcode::POP:
+                if (in.low < 1) return failure(result, i, "Stack may underflow");
+                out = {in.low - 1, in.high - 1};
+                break;
+            case Opcode::JMP:
+            case Opcode::JNE:
+                if (!flowTo(i, instr.operand, out)) {
+                    return failure(result, i, "Jump to " + std::to_string(instr.operand) + " leaves the program");
+                }
+                break;
+            default:
+                break;
+        }
+        if (instr.op == Opcode::HLT || instr.op == Opcode::JMP) continue;
+        if (!flowTo(i, i + 1, out)) return failure(result, i, "Execution can run past the last instruction");
+    }
+
+    for (const Depth& d : depth) {
+        if (d.low <= d.high) result.reachable_instructions++;
+    }
+    result.verified = true;
+    return result;
+}
+
+
+void ProgramVerification::print(std::ostream& out) const {
+    out << "--- Program Verification ---" << std::endl;
+    if (!verified) {
+        out << "Not verified: instruction " << instruction << ": " << reason << std::endl;
+        return;
+    }
+    out << "Verified: " << reachable_instructions << " reachable instruction(s), stack depth up to "
+        << max_stack_depth;
+    if (min_address <= max_address) out << ", addresses " << min_address << "-" << max_address;
+    out << std::endl;
+}
@@ -0,0 +1,39 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+
+#include "Isa.h"
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+
+// What verifyProgram() proved about a program. A verified program, started with at
+// least max_stack_depth free stack bytes, never overflows or underflows the stack,
+// only addresses memory that exists and never leaves the program except through hlt.
+struct ProgramVerification {
+    bool verified = false;
+    // Why the proof failed, and the instruction where it did.
+    std::string reason;
+    size_t instruction = 0;
+    // Deepest the stack gets, in bytes pushed since entry.
+    uint32_t max_stack_depth = 0;
+    // Range of lda and sta operands; min_address > max_address if there are none.
+    uint32_t min_address = UINT32_MAX;
+    uint32_t max_address = 0;
+    size_t reachable_instructions = 0;
+
+    void print(std::ostream& out) const;
+};
+
+
+// Abstract interpretation over the program's control flow graph, starting at
+// instruction 0. Each reachable instruction gets the interval of stack depths it can
+// run at; intervals are joined where paths meet and widened at instructions whose
+// interval keeps growing, so loops that push without popping are caught quickly.
+// Only reachable instructions are checked. Runs in time linear in the program size.
+ProgramVerification verifyProgram(const MachineInstr* program, size_t count, const MachineModel& machine);
+
+
+#endif
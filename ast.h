@@ -2,77 +2,159 @@
 #define AST_H
 
 
-#include <string>
-#include <vector>
-#include <memory>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include "Arena.h"
+#include "SymbolTable.h"
+
+
+// All nodes of a Program live in its arena and are released together with it;
+// children are plain pointers and node destructors are never run.
 
 
 struct Statement;
 struct Expression;
 
 
+enum class NodeKind : uint8_t {
+    NUMBER_LITERAL,
+    IDENTIFIER,
+    BINARY_OP,
+    VAR_DECL,
+    ASSIGNMENT,
+    BLOCK_STATEMENT,
+    IF_STATEMENT,
+    WHILE_STATEMENT,
+    PROGRAM
+};
+
+
+enum class BinaryOperator : uint8_t {
+    ADD,
+    SUBTRACT,
+    EQUAL,
+    NOT_EQUAL
+};
+
+
+inline std::string_view operatorSymbol(BinaryOperator op) {
+    switch (op) {
+        case BinaryOperator::ADD: return "+";
+        case BinaryOperator::SUBTRACT: return "-";
+        case BinaryOperator::EQUAL: return "==";
+        case BinaryOperator::NOT_EQUAL: return "!=";
+    }
+    return "?";
+}
+
+
 struct Node {
-    virtual ~Node() = default;
+    NodeKind kind;
+    // Byte offset of the node's first token in the source; see LineIndex in lexer.h.
+    // Nodes the optimizer creates take the offset of the code they stand for.
+    uint32_t offset = 0;
+    explicit Node(NodeKind k) : kind(k) {}
 };
 
 
-struct Expression : public Node {};
+// Fixed-size array of child pointers, allocated in the owning Program's arena.
+template <typename T>
+struct NodeList {
+    T** items = nullptr;
+    uint32_t count = 0;
+
+    T** begin() const { return items; }
+    T** end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T* operator[](size_t index) const { return items[index]; }
+};
+
+
+struct Expression : public Node {
+    using Node::Node;
+};
 
 
 struct NumberLiteral : public Expression {
     int value;
-    explicit NumberLiteral(int val) : value(val) {}
+    explicit NumberLiteral(int val) : Expression(NodeKind::NUMBER_LITERAL), value(val) {}
 };
 
 
 struct Identifier : public Expression {
-    std::string name;
-    explicit Identifier(std::string n) : name(std::move(n)) {}
+    SymbolId symbol;
+    explicit Identifier(SymbolId sym) : Expression(NodeKind::IDENTIFIER), symbol(sym) {}
 };
 
 
 struct BinaryOp : public Expression {
-    std::string op;
-    std::unique_ptr<Expression> left;
-    std::unique_ptr<Expression> right;
-    BinaryOp(std::string o, std::unique_ptr<Expression> l, std::unique_ptr<Expression> r)
-        : op(std::move(o)), left(std::move(l)), right(std::move(r)) {}
+    BinaryOperator op;
+    Expression* left;
+    Expression* right;
+    BinaryOp(BinaryOperator o, Expression* l, Expression* r)
+        : Expression(NodeKind::BINARY_OP), op(o), left(l), right(r) {}
 };
 
 
-struct Statement : public Node {};
+struct Statement : public Node {
+    using Node::Node;
+};
 
 
 struct VarDecl : public Statement {
-    std::string varName;
-    explicit VarDecl(std::string name) : varName(std::move(name)) {}
+    SymbolId symbol;
+    explicit VarDecl(SymbolId sym) : Statement(NodeKind::VAR_DECL), symbol(sym) {}
 };
 
 
 struct Assignment : public Statement {
-    std::string varName;
-    std::unique_ptr<Expression> value;
-    Assignment(std::string name, std::unique_ptr<Expression> val)
-        : varName(std::move(name)), value(std::move(val)) {}
+    SymbolId symbol;
+    Expression* value;
+    Assignment(SymbolId sym, Expression* val)
+        : Statement(NodeKind::ASSIGNMENT), symbol(sym), value(val) {}
 };
 
 
 struct BlockStatement : public Statement {
-    std::vector<std::unique_ptr<Statement>> statements;
+    NodeList<Statement> statements;
+    BlockStatement() : Statement(NodeKind::BLOCK_STATEMENT) {}
 };
 
 
 struct IfStatement : public Statement {
-    std::unique_ptr<Expression> condition;
-    std::unique_ptr<BlockStatement> body;
-    IfStatement(std::unique_ptr<Expression> cond, std::unique_ptr<BlockStatement> b)
-        : condition(std::move(cond)), body(std::move(b)) {}
+    Expression* condition;
+    BlockStatement* body;
+    IfStatement(Expression* cond, BlockStatement* b)
+        : Statement(NodeKind::IF_STATEMENT), condition(cond), body(b) {}
+};
+
+
+// The body runs for as long as the condition, a `==` or `!=` comparison, holds. It
+// cannot declare variables, since a declaration would only be zero the first time round.
+struct WhileStatement : public Statement {
+    Expression* condition;
+    BlockStatement* body;
+    WhileStatement(Expression* cond, BlockStatement* b)
+        : Statement(NodeKind::WHILE_STATEMENT), condition(cond), body(b) {}
 };
 
 
 struct Program : public Node {
-    std::vector<std::unique_ptr<Statement>> statements;
+    Arena arena;
+    NodeList<Statement> statements;
+    // Variables the optimizer introduced. They are placed after every declared variable,
+    // so optimizing never moves a variable of the program.
+    NodeList<VarDecl> temporaries;
+    Program() : Node(NodeKind::PROGRAM) {}
 };
 
 
+static_assert(std::is_trivially_destructible<BinaryOp>::value && std::is_trivially_destructible<IfStatement>::value &&
+              std::is_trivially_destructible<WhileStatement>::value &&
+              std::is_trivially_destructible<BlockStatement>::value && std::is_trivially_destructible<Assignment>::value,
+              "arena-allocated AST nodes must be trivially destructible");
+
+
 #endif
@@ -1,97 +1,291 @@
 #include "lexer.h"
-#include <cctype>
-#include <iostream>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <string>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LEXER_SIMD_WIDTH 32
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LEXER_SIMD_WIDTH 16
+#else
+#define LEXER_SIMD_WIDTH 0
+#endif
 
-Lexer::Lexer(const std::string& source) : source(source), position(0) {}
+#if defined(_MSC_VER) && LEXER_SIMD_WIDTH
+#include <intrin.h>
+#endif
 
 
-char Lexer::peek() {
-    if (position >= source.length()) {
-        return '\0';
+namespace {
+
+enum CharClass : uint8_t {
+    CHAR_SPACE = 1 << 0,
+    CHAR_DIGIT = 1 << 1,
+    CHAR_IDENT_START = 1 << 2,
+    CHAR_IDENT = 1 << 3,
+};
+
+
+struct CharClassTable {
+    uint8_t classes[256];
+
+    constexpr CharClassTable() : classes() {
+        for (int c = 0; c < 256; ++c) {
+            uint8_t cls = 0;
+            if (c == ' ' || (c >= '\t' && c <= '\r')) cls |= CHAR_SPACE;
+            if (c >= '0' && c <= '9') cls |= CHAR_DIGIT | CHAR_IDENT;
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') cls |= CHAR_IDENT_START | CHAR_IDENT;
+            classes[c] = cls;
+        }
     }
-    return source[position];
+};
+
+
+constexpr CharClassTable char_classes;
+
+
+inline bool hasClass(char c, uint8_t cls) {
+    return (char_classes.classes[static_cast<unsigned char>(c)] & cls) != 0;
+}
+
+
+#if LEXER_SIMD_WIDTH
+
+inline unsigned countTrailingZeros(uint32_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+#endif
+
+
+#if LEXER_SIMD_WIDTH == 32
+
+using Block = __m256i;
+constexpr uint32_t FULL_MASK = 0xFFFFFFFFu;
+
+inline Block loadBlock(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+inline Block splat(char c) { return _mm256_set1_epi8(c); }
+inline Block eq(Block a, Block b) { return _mm256_cmpeq_epi8(a, b); }
+inline Block gt(Block a, Block b) { return _mm256_cmpgt_epi8(a, b); }
+inline Block both(Block a, Block b) { return _mm256_and_si256(a, b); }
+inline Block either(Block a, Block b) { return _mm256_or_si256(a, b); }
+inline uint32_t bitmask(Block a) { return static_cast<uint32_t>(_mm256_movemask_epi8(a)); }
+
+#elif LEXER_SIMD_WIDTH == 16
+
+using Block = __m128i;
+constexpr uint32_t FULL_MASK = 0xFFFFu;
+
+inline Block loadBlock(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline Block splat(char c) { return _mm_set1_epi8(c); }
+inline Block eq(Block a, Block b) { return _mm_cmpeq_epi8(a, b); }
+inline Block gt(Block a, Block b) { return _mm_cmpgt_epi8(a, b); }
+inline Block both(Block a, Block b) { return _mm_and_si128(a, b); }
+inline Block either(Block a, Block b) { return _mm_or_si128(a, b); }
+inline uint32_t bitmask(Block a) { return static_cast<uint32_t>(_mm_movemask_epi8(a)); }
+
+#endif
+
+
+#if LEXER_SIMD_WIDTH
+
+// Byte-wise lo <= x <= hi. Comparisons are signed, so bytes >= 0x80 never match an ASCII range.
+inline Block inRange(Block x, char lo, char hi) {
+    return both(gt(x, splat(static_cast<char>(lo - 1))), gt(splat(static_cast<char>(hi + 1)), x));
 }
 
 
-char Lexer::advance() {
-    if (position >= source.length()) {
-        return '\0';
+inline uint32_t spaceMask(Block x) {
+    return bitmask(either(eq(x, splat(' ')), inRange(x, '\t', '\r')));
+}
+
+
+inline uint32_t identifierMask(Block x) {
+    // OR-ing in 0x20 folds 'A'-'Z' onto 'a'-'z' without pulling any other byte into that range.
+    Block lower = either(x, splat(0x20));
+    return bitmask(either(either(inRange(lower, 'a', 'z'), inRange(x, '0', '9')), eq(x, splat('_'))));
+}
+
+#endif
+
+
+// Each scanner returns the first position in [p, end) whose byte is not part of the run.
+
+const char* skipSpaceRun(const char* p, const char* end) {
+#if LEXER_SIMD_WIDTH
+    while (end - p >= LEXER_SIMD_WIDTH) {
+        uint32_t mask = spaceMask(loadBlock(p));
+        if (mask != FULL_MASK) return p + countTrailingZeros(~mask);
+        p += LEXER_SIMD_WIDTH;
     }
-    return source[position++];
+#endif
+    while (p < end && hasClass(*p, CHAR_SPACE)) ++p;
+    return p;
 }
 
 
-void Lexer::skipWhitespace() {
-    while (peek() != '\0' && isspace(peek())) {
-        advance();
+const char* skipIdentifierRun(const char* p, const char* end) {
+#if LEXER_SIMD_WIDTH
+    while (end - p >= LEXER_SIMD_WIDTH) {
+        uint32_t mask = identifierMask(loadBlock(p));
+        if (mask != FULL_MASK) return p + countTrailingZeros(~mask);
+        p += LEXER_SIMD_WIDTH;
     }
+#endif
+    while (p < end && hasClass(*p, CHAR_IDENT)) ++p;
+    return p;
 }
 
 
-Token Lexer::getNextToken() {
-    skipWhitespace();
+const char* findLineEnd(const char* p, const char* end) {
+#if LEXER_SIMD_WIDTH
+    while (end - p >= LEXER_SIMD_WIDTH) {
+        uint32_t mask = bitmask(eq(loadBlock(p), splat('\n')));
+        if (mask != 0) return p + countTrailingZeros(mask);
+        p += LEXER_SIMD_WIDTH;
+    }
+#endif
+    const void* newline = std::memchr(p, '\n', static_cast<size_t>(end - p));
+    return newline ? static_cast<const char*>(newline) : end;
+}
 
+}
 
-    char current_char = peek();
 
-    if (current_char == '\0') {
-        return {TokenType::END_OF_FILE, ""};
-    }
+Lexer::Lexer(std::string_view source, SymbolTable& symbols) : source(source), symbols(symbols), position(0) {}
 
 
-    if (isdigit(current_char)) {
-        std::string number;
-        while (peek() != '\0' && isdigit(peek())) {
-            number += advance();
+void Lexer::skipWhitespaceAndComments() {
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+    const char* p = begin + position;
+
+    for (;;) {
+        p = skipSpaceRun(p, end);
+        if (end - p >= 2 && p[0] == '/' && p[1] == '/') {
+            p = findLineEnd(p + 2, end);
+            continue;
         }
-        return {TokenType::INTEGER_LITERAL, number};
+        break;
     }
+    position = static_cast<size_t>(p - begin);
+}
+
+
+Token Lexer::makeToken(TokenType type, size_t start, uint32_t value) {
+    return {type, static_cast<uint32_t>(start), static_cast<uint32_t>(position - start), value};
+}
+
+
+Token Lexer::getNextToken() {
+    skipWhitespaceAndComments();
+
+
+    size_t start = position;
+    if (start >= source.size()) {
+        return makeToken(TokenType::END_OF_FILE, start);
+    }
+
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+    char current_char = begin[start];
 
 
-    if (isalpha(current_char) || current_char == '_') {
-        std::string identifier;
-        while (peek() != '\0' && (isalnum(peek()) || peek() == '_')) {
-            identifier += advance();
+    if (hasClass(current_char, CHAR_DIGIT)) {
+        const char* p = begin + start;
+        uint32_t number = 0;
+        bool too_large = false;
+        while (p < end && hasClass(*p, CHAR_DIGIT)) {
+            uint32_t digit = static_cast<uint32_t>(*p++ - '0');
+            too_large = too_large || number > (INT_MAX - digit) / 10;
+            if (!too_large) number = number * 10 + digit;
         }
-        if (identifier == "int") return {TokenType::INT, identifier};
-        if (identifier == "if") return {TokenType::IF, identifier};
-        return {TokenType::IDENTIFIER, identifier};
+        position = static_cast<size_t>(p - begin);
+        if (too_large) {
+            throw std::runtime_error("Lexer Error: Integer literal '" + std::string(source.substr(start, position - start)) +
+                                     "' is out of range at offset " + std::to_string(start));
+        }
+        return makeToken(TokenType::INTEGER_LITERAL, start, number);
+    }
+
+
+    if (hasClass(current_char, CHAR_IDENT_START)) {
+        position = static_cast<size_t>(skipIdentifierRun(begin + start + 1, end) - begin);
+        std::string_view identifier = source.substr(start, position - start);
+        if (identifier == "int") return makeToken(TokenType::INT, start);
+        if (identifier == "if") return makeToken(TokenType::IF, start);
+        if (identifier == "while") return makeToken(TokenType::WHILE, start);
+        return makeToken(TokenType::IDENTIFIER, start, symbols.intern(identifier));
     }
 
 
+    position++;
     switch (current_char) {
         case '=':
-            advance();
-            if (peek() == '=') {
-                advance();
-                return {TokenType::EQUAL, "=="};
+            if (position < source.size() && begin[position] == '=') {
+                position++;
+                return makeToken(TokenType::EQUAL, start);
             }
-            return {TokenType::ASSIGN, "="};
+            return makeToken(TokenType::ASSIGN, start);
+        case '!':
+            if (position < source.size() && begin[position] == '=') {
+                position++;
+                return makeToken(TokenType::NOT_EQUAL, start);
+            }
+            break;
         case '+':
-            advance();
-            return {TokenType::PLUS, "+"};
+            return makeToken(TokenType::PLUS, start);
         case '-':
-            advance();
-            return {TokenType::MINUS, "-"};
+            return makeToken(TokenType::MINUS, start);
         case '(':
-            advance();
-            return {TokenType::LPAREN, "("};
+            return makeToken(TokenType::LPAREN, start);
         case ')':
-            advance();
-            return {TokenType::RPAREN, ")"};
+            return makeToken(TokenType::RPAREN, start);
         case '{':
-            advance();
-            return {TokenType::LBRACE, "{"};
+            return makeToken(TokenType::LBRACE, start);
         case '}':
-            advance();
-            return {TokenType::RBRACE, "}"};
+            return makeToken(TokenType::RBRACE, start);
         case ';':
-            advance();
-            return {TokenType::SEMICOLON, ";"};
+            return makeToken(TokenType::SEMICOLON, start);
+    }
+
+
+    return makeToken(TokenType::UNKNOWN, start);
+}
+
+
+
+LineIndex::LineIndex(std::string_view source) : source(source) {
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+    line_starts.push_back(0);
+    for (const char* p = findLineEnd(begin, end); p < end; p = findLineEnd(p + 1, end)) {
+        line_starts.push_back(static_cast<uint32_t>(p + 1 - begin));
     }
+}
+
+
+SourceLocation LineIndex::locate(uint32_t offset) const {
+    auto next = std::upper_bound(line_starts.begin(), line_starts.end(), offset);
+    uint32_t line = static_cast<uint32_t>(next - line_starts.begin());
+    return {line, offset - line_starts[line - 1] + 1};
+}
 
 
-    advance();
-    return {TokenType::UNKNOWN, std::string(1, current_char)};
+std::string_view LineIndex::line(uint32_t number) const {
+    if (number == 0 || number > line_starts.size()) return {};
+    size_t start = line_starts[number - 1];
+    size_t end = number < line_starts.size() ? line_starts[number] - 1 : source.size();
+    if (end > start && source[end - 1] == '\r') end--;
+    return source.substr(start, end - start);
 }
@@ -1,18 +1,22 @@
 #ifndef LEXER_H
 #define LEXER_H
 
-#include <string>
+#include <cstdint>
+#include <string_view>
 #include <vector>
+#include "SymbolTable.h"
 
-enum class TokenType {
+enum class TokenType : uint8_t {
     INT,
     IF,
+    WHILE,
     IDENTIFIER,
     INTEGER_LITERAL,
     ASSIGN,
     PLUS,
     MINUS,
     EQUAL,
+    NOT_EQUAL,
     LPAREN,
     RPAREN,
     LBRACE,
@@ -22,24 +26,56 @@ enum class TokenType {
     UNKNOWN
 };
 
+// A token is a span into the source buffer. `value` holds the interned
+// SymbolId for identifiers and the parsed number for integer literals. Its line and
+// column come from a LineIndex over the same buffer.
 struct Token
 {   
     TokenType type;
-    std::string value;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t value;
 };
 
 class Lexer {
 public:
-    Lexer(const std::string& source);
+    // The source buffer is not copied and must outlive the lexer and its tokens.
+    Lexer(std::string_view source, SymbolTable& symbols);
     Token getNextToken();
+    std::string_view text(const Token& token) const { return source.substr(token.offset, token.length); }
+    std::string_view sourceText() const { return source; }
 private:
-    std::string source;
+    std::string_view source;
+    SymbolTable& symbols;
     size_t position;
     
-    char peek();
-    char advance();
-    void skipWhitespace();
+    // Skips whitespace and `//` line comments in SIMD-width blocks where available.
+    void skipWhitespaceAndComments();
+    Token makeToken(TokenType type, size_t start, uint32_t value = 0);
+};
+
+
+// 1-based line and column of a source byte; line 0 means no source position.
+struct SourceLocation {
+    uint32_t line = 0;
+    uint32_t column = 0;
+};
+
+
+// Maps the byte offsets tokens and AST nodes record to lines and columns. It is built
+// in one pass over the source when someone needs positions, so the lexer does not
+// count lines on the hot path. The source must outlive the index.
+class LineIndex {
+public:
+    explicit LineIndex(std::string_view source);
+    SourceLocation locate(uint32_t offset) const;
+    // The text of a 1-based line without its line break, or an empty view.
+    std::string_view line(uint32_t number) const;
+    size_t lineCount() const { return line_starts.size(); }
+private:
+    std::string_view source;
+    std::vector<uint32_t> line_starts;
 };
     
 
-#endif // LEXER_H
\ No newline at end of file
+#endif // LEXER_H
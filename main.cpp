@@ -2,23 +2,46 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 #include "lexer.h"
 #include "parser.h"
 #include "ast.h"
+#include "AstPrinter.h"
 #include "CodeGenerator.h"
 #include "CPU.h"
+#include "AsmBuffer.h"
+#include "ObjectFile.h"
+#include "SymbolTable.h"
+#include "Benchmarks.h"
+#include "MappedFile.h"
+#include "Optimizer.h"
+#include "Peephole.h"
+#include "IrBuilder.h"
+#include "IrBackend.h"
+#include "ValueNumbering.h"
+#include "BatchCompiler.h"
+#include "ThreadPool.h"
+#include "CompileCache.h"
+#include "Linker.h"
+#include "Profiler.h"
+#include "CycleModel.h"
 
 
 std::string tokenTypeToString(TokenType type) {
     switch (type) {
         case TokenType::INT: return "INT";
         case TokenType::IF: return "IF";
+        case TokenType::WHILE: return "WHILE";
         case TokenType::IDENTIFIER: return "IDENTIFIER";
         case TokenType::INTEGER_LITERAL: return "INTEGER_LITERAL";
         case TokenType::ASSIGN: return "ASSIGN";
         case TokenType::PLUS: return "PLUS";
         case TokenType::MINUS: return "MINUS";
         case TokenType::EQUAL: return "EQUAL";
+        case TokenType::NOT_EQUAL: return "NOT_EQUAL";
         case TokenType::LPAREN: return "LPAREN";
         case TokenType::RPAREN: return "RPAREN";
         case TokenType::LBRACE: return "LBRACE";
@@ -31,45 +54,574 @@ std::string tokenTypeToString(TokenType type) {
 }
 
 
-void printAST(const Node* node, int indent = 0) {
-    if (!node) return;
-    std::string indentation(indent * 2, ' ');
-
-
-    if (auto p = dynamic_cast<const Program*>(node)) {
-        std::cout << indentation << "Program" << std::endl;
-        for (const auto& stmt : p->statements) {
-            printAST(stmt.get(), indent + 1);
-        }
-    } else if (auto vd = dynamic_cast<const VarDecl*>(node)) {
-        std::cout << indentation << "VarDecl: " << vd->varName << std::endl;
-    } else if (auto a = dynamic_cast<const Assignment*>(node)) {
-        std::cout << indentation << "Assignment: " << a->varName << std::endl;
-        printAST(a->value.get(), indent + 1);
-    } else if (auto is = dynamic_cast<const IfStatement*>(node)) {
-        std::cout << indentation << "IfStatement" << std::endl;
-        std::cout << indentation << "  Condition:" << std::endl;
-        printAST(is->condition.get(), indent + 2);
-        std::cout << indentation << "  Body:" << std::endl;
-        printAST(is->body.get(), indent + 2);
-    } else if (auto bs = dynamic_cast<const BlockStatement*>(node)) {
-        std::cout << indentation << "Block" << std::endl;
-        for (const auto& stmt : bs->statements) {
-            printAST(stmt.get(), indent + 1);
-        }
-    } else if (auto bo = dynamic_cast<const BinaryOp*>(node)) {
-        std::cout << indentation << "BinaryOp: " << bo->op << std::endl;
-        printAST(bo->left.get(), indent + 1);
-        printAST(bo->right.get(), indent + 1);
-    } else if (auto nl = dynamic_cast<const NumberLiteral*>(node)) {
-        std::cout << indentation << "Number: " << nl->value << std::endl;
-    } else if (auto id = dynamic_cast<const Identifier*>(node)) {
-        std::cout << indentation << "Identifier: " << id->name << std::endl;
+enum class EmitKind {
+    NONE,
+    IR,
+    ASM,
+    OBJECT
+};
+
+
+enum class RunMode {
+    INTERPRET,
+    JIT,
+    JIT_DIFF,
+    PROFILE_FUSION,
+    PROFILE
+};
+
+
+struct DriverOptions {
+    int optimization_level = 0;
+    bool peephole_stats = false;
+    EmitKind emit = EmitKind::NONE;
+    // Where --emit=obj, -c and --link write; defaults to the input path with a .slo extension.
+    std::string output_path;
+    // -c: compile to a relocatable module for --link instead of a program.
+    bool relocatable = false;
+    bool link = false;
+    bool debug_info = false;
+    std::vector<std::string> live_out;
+    RunMode run_mode = RunMode::INTERPRET;
+    // --verify: print what the program verifier proved before running.
+    bool verify = false;
+    // --profile prints the execution profile; --profile-folded writes its folded stacks.
+    bool profile = false;
+    std::string profile_folded;
+    // --cycle-costs loads the cost table and, like --cycles, prints the cycle count after
+    // a run. --estimate-cycles prints the static estimate instead of running.
+    CycleCosts cycle_costs;
+    bool cycles = false;
+    bool estimate_cycles = false;
+    // --batch input (a directory or a file list) and its thread count; 0 is one per core.
+    std::string batch_path;
+    unsigned threads = 0;
+    // --cache directory, its size limit in bytes (0 is unlimited), and --cache-stats.
+    std::string cache_path;
+    uint64_t cache_size = 0;
+    bool cache_stats = false;
+    LoopOptions loops;
+    // --memory and --stack: the CPU the program runs on, and where variables must end.
+    MachineModel machine;
+};
+
+
+// Below -O2 code comes straight from the AST. From -O2 up the program is lowered to
+// SSA, repeated expressions are value-numbered, dead stores are removed and the IR
+// backend emits the code. When `ir_dump` is set the final IR is printed there as well.
+// Comments are only kept with `annotate`, for code that is going to be printed or
+// recorded as debug info. `variables` receives the variable name at each address.
+AsmBuffer generateCode(const Program& ast, const SymbolTable& symbols, const DriverOptions& options,
+                       bool annotate, std::vector<std::string>& variables, std::ostream* ir_dump = nullptr) {
+    if (options.optimization_level < 2 && !ir_dump) {
+        CodeGenOptions codegen_options;
+        codegen_options.annotate = annotate;
+        codegen_options.data_limit = static_cast<int>(options.machine.dataLimit());
+        CodeGenerator generator(symbols, codegen_options);
+        AsmBuffer code = generator.generate(ast);
+        variables = generator.variableNames();
+        return code;
+    }
+
+    std::unique_ptr<IrFunction> ir = buildIr(ast, symbols, options.live_out);
+    size_t reused = numberValues(*ir);
+    size_t removed = eliminateDeadStores(*ir);
+    if (ir_dump) {
+        computeLiveness(*ir);
+        printIr(*ir, *ir_dump);
+        *ir_dump << "; " << reused << " value(s) reused, " << removed << " dead store(s) removed" << std::endl;
+    }
+    variables = ir->slot_names;
+    IrBackendOptions backend_options;
+    backend_options.annotate = annotate;
+    backend_options.data_limit = static_cast<int>(options.machine.dataLimit());
+    return emitAssembly(*ir, backend_options);
+}
+
+
+std::vector<std::string> splitNames(const std::string& list) {
+    std::vector<std::string> names;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+        if (comma > start) names.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return names;
+}
+
+
+// A byte count with an optional K, M or G suffix (powers of 1024). Returns false if
+// `text` is not one.
+bool parseByteSize(const std::string& text, uint64_t& bytes) {
+    size_t digits = 0;
+    while (digits < text.size() && isdigit(static_cast<unsigned char>(text[digits]))) digits++;
+    if (digits == 0 || digits > 15) return false;
+    bytes = std::stoull(text.substr(0, digits));
+    if (digits == text.size()) return true;
+    if (digits + 1 != text.size()) return false;
+    switch (toupper(static_cast<unsigned char>(text[digits]))) {
+        case 'K': bytes <<= 10; return true;
+        case 'M': bytes <<= 20; return true;
+        case 'G': bytes <<= 30; return true;
+        default: return false;
+    }
+}
+
+
+// A non-negative count such as --unroll-limit's. Rejects anything but plain digits.
+bool parseCount(const std::string& text, int& count) {
+    if (text.empty() || text.size() > 9) return false;
+    for (char c : text) {
+        if (!isdigit(static_cast<unsigned char>(c))) return false;
+    }
+    count = std::stoi(text);
+    return true;
+}
+
+
+// Runs a program and prints the final state and the first `variable_count` addresses,
+// followed by the most frequent instruction sequences with --profile-fusion. With
+// --jit-diff it runs on both the interpreter and the JIT instead, and the printed state,
+// all of memory, the instruction count and any error are compared. --verify prints what
+// the verifier proved about the program first. With --profile and --profile-folded it
+// runs on the counting loop and reports where the instructions went, by source line
+// when `source` has a line table. --cycles adds the cycles the run took.
+int simulate(const MachineInstr* code, size_t count, size_t variable_count, const DriverOptions& options,
+             const ProfileSource& source = ProfileSource()) {
+    if (variable_count > options.machine.dataLimit()) {
+        throw std::runtime_error("CPU Error: The program's " + std::to_string(variable_count) +
+                                 " variables do not fit below the stack; use a larger --memory");
+    }
+    if (options.run_mode != RunMode::JIT_DIFF) {
+        CPU cpu(options.machine);
+        FusionProfile profile;
+        ExecutionProfile execution;
+        cpu.setCycleCosts(options.cycle_costs);
+        cpu.loadProgram(code, count);
+        if (options.verify) cpu.verification().print(std::cout);
+        if (options.run_mode == RunMode::JIT) {
+            cpu.runJit();
+        } else if (options.run_mode == RunMode::PROFILE_FUSION) {
+            cpu.runProfiled(profile);
+        } else if (options.run_mode == RunMode::PROFILE) {
+            cpu.runCounted(execution);
+        } else {
+            cpu.run();
+        }
+        std::cout << "--- Simulation Results ---" << std::endl;
+        cpu.printState();
+        if (options.cycles) {
+            std::cout << "Instructions: " << cpu.instructionCount() << " Cycles: " << cpu.cycleCount() << std::endl;
+        }
+        cpu.printMemory(0, static_cast<int>(variable_count));
+        if (options.run_mode == RunMode::PROFILE_FUSION) profile.print(std::cout);
+        if (options.profile) execution.print(std::cout, source);
+        if (!options.profile_folded.empty()) {
+            std::ofstream folded(options.profile_folded, std::ios::trunc);
+            execution.printFolded(folded, source);
+            if (!folded) throw std::runtime_error("Profiler Error: Cannot write '" + options.profile_folded + "'");
+        }
+        return 0;
+    }
+
+    auto capture = [&](bool jit) {
+        CPU cpu(options.machine);
+        cpu.setCycleCosts(options.cycle_costs);
+        cpu.loadProgram(code, count);
+        std::ostringstream out;
+        try {
+            jit ? cpu.runJit() : cpu.run();
+        } catch (const std::exception& e) {
+            out << "Error: " << e.what() << std::endl;
+        }
+        cpu.printState(out);
+        out << "Instructions: " << cpu.instructionCount() << " Cycles: " << cpu.cycleCount() << std::endl;
+        cpu.printMemory(0, static_cast<int>(options.machine.memory_size), out);
+        return out.str();
+    };
+    std::string interpreted = capture(false);
+    std::string compiled = capture(true);
+    std::cout << "--- JIT Differential ---" << std::endl;
+    if (!CPU::hasJit()) std::cout << "JIT not available on this platform; both runs used the interpreter" << std::endl;
+    if (interpreted == compiled) {
+        std::cout << "Interpreter and JIT agree" << std::endl;
+        std::cout << interpreted.substr(0, interpreted.find("--- CPU Memory State ---"));
+        return 0;
+    }
+    std::cout << "Interpreter and JIT differ" << std::endl;
+    std::cout << "--- Interpreter ---" << std::endl << interpreted;
+    std::cout << "--- JIT ---" << std::endl << compiled;
+    return 1;
+}
+
+
+// Runs a compiled object. The CPU executes the instructions straight out of `bytes`,
+// usually a file mapping; --emit=asm disassembles it instead. Without the source,
+// --estimate-cycles can only estimate the program as a whole.
+int runObject(std::string_view bytes, const DriverOptions& options) {
+    ObjectView object(bytes);
+    if (options.emit == EmitKind::ASM) {
+        std::cout << disassemble(object).toText();
+        return 0;
+    }
+    if (options.estimate_cycles && !object.isRelocatable()) {
+        estimateCycles(object.instructions(), object.instructionCount(), options.cycle_costs).print(std::cout);
+        return 0;
+    }
+    if (object.isRelocatable()) {
+        throw std::runtime_error("ObjectFile Error: Cannot run a relocatable module; link it with --link first");
+    }
+
+    return simulate(object.instructions(), object.instructionCount(), object.variableCount(), options);
+}
+
+
+std::string objectPath(const std::string& input_path, const DriverOptions& options) {
+    if (!options.output_path.empty()) return options.output_path;
+    return std::filesystem::path(input_path).replace_extension(".slo").string();
+}
+
+
+// Everything besides the source that decides what code is generated, for cache keys.
+std::string cacheFlags(const DriverOptions& options) {
+    std::string flags = "-O" + std::to_string(options.optimization_level);
+    if (options.debug_info) flags += " -g";
+    if (options.relocatable) flags += " -c";
+    if (options.optimization_level > 0) {
+        flags += " --unroll-limit=" + std::to_string(options.loops.unroll_limit);
+        flags += " --unroll-factor=" + std::to_string(options.loops.unroll_factor);
+        if (!options.loops.hoist_invariants) flags += " --no-licm";
+        if (!options.loops.reduce_strength) flags += " --no-strength-reduction";
+    }
+    if (options.optimization_level >= 2 && !options.live_out.empty()) {
+        flags += " --live-out=";
+        for (const std::string& name : options.live_out) flags += name + ",";
+    }
+    if (options.machine.memory_size != MachineModel().memory_size || options.machine.stack_size != MachineModel().stack_size) {
+        flags += " --memory=" + std::to_string(options.machine.memory_size);
+        flags += " --stack=" + std::to_string(options.machine.stack_size);
+    }
+    return flags;
+}
+
+
+// Optimizes and compiles a parsed program into the object --emit=obj writes, or with -c
+// into a relocatable module. Modules always come from CodeGenerator, since the SSA
+// pipeline assumes it sees the whole program, so -O2 and up compile modules like -O1.
+ObjectFile compileObject(Program& ast, SymbolTable& symbols, const DriverOptions& options) {
+    if (!options.relocatable) {
+        optimizeProgram(ast, symbols, options.optimization_level, true, options.loops);
+        std::vector<std::string> variables;
+        AsmBuffer code = generateCode(ast, symbols, options, options.debug_info, variables);
+        if (options.optimization_level > 0) PeepholeOptimizer().optimize(code);
+        return makeObject(code, variables, options.debug_info);
+    }
+
+    optimizeProgram(ast, symbols, std::min(options.optimization_level, 1), false, options.loops);
+    CodeGenOptions codegen_options;
+    codegen_options.annotate = options.debug_info;
+    codegen_options.externs = true;
+    codegen_options.data_limit = static_cast<int>(options.machine.dataLimit());
+    CodeGenerator generator(symbols, codegen_options);
+    AsmBuffer code = generator.generateModule(ast);
+    if (options.optimization_level > 0) PeepholeOptimizer().optimize(code);
+    return makeRelocatableObject(code, generator.variableNames(), generator.externAddresses(), options.debug_info);
+}
+
+
+// Compiles with a CompileCache. The cached result is the object --emit=obj (or -c) would
+// write, so running a program and writing its object share one entry. On a hit the
+// source is not lexed or parsed at all.
+int compileCached(const MappedFile& file, const std::string& path, const DriverOptions& options, CompileCache& cache) {
+    std::string key = cache.key(file.view(), cacheFlags(options));
+    std::unique_ptr<MappedFile> entry = cache.lookup(key);
+    std::string compiled;
+    std::string_view object;
+    if (entry) {
+        object = entry->view();
+    } else {
+        SymbolTable symbols;
+        Lexer lexer(file.view(), symbols);
+        Parser parser(lexer);
+        std::unique_ptr<Program> ast = parser.parse();
+        compiled = encodeObject(compileObject(*ast, symbols, options));
+        cache.store(key, compiled);
+        object = compiled;
+    }
+
+    if (options.emit == EmitKind::OBJECT || options.relocatable) {
+        writeObject(objectPath(path, options), object);
+        return 0;
     }
+    return runObject(object, options);
 }
 
 
-int main() {
+// Compiles and runs a source file, or runs an object file written by --emit=obj. The
+// file is memory-mapped and the parser pulls tokens straight from the lexer, so no
+// token vector is ever materialized. The code generators hand the CPU decoded
+// instructions; text is only produced for --emit=asm.
+int compileFile(const std::string& path, const DriverOptions& options) {
+    try {
+        MappedFile file(path);
+        if (ObjectView::isObject(file.view())) return runObject(file.view(), options);
+        if (!options.cache_path.empty() && !options.peephole_stats && options.run_mode != RunMode::PROFILE &&
+            !options.estimate_cycles && (options.emit == EmitKind::NONE || options.emit == EmitKind::OBJECT || options.relocatable)) {
+            CompileCache cache(options.cache_path, options.cache_size);
+            int status = compileCached(file, path, options, cache);
+            if (options.cache_stats) cache.printStats(std::cout);
+            return status;
+        }
+
+        SymbolTable symbols;
+        Lexer lexer(file.view(), symbols);
+        Parser parser(lexer);
+        std::unique_ptr<Program> ast = parser.parse();
+        if (options.relocatable) {
+            writeObject(objectPath(path, options), compileObject(*ast, symbols, options));
+            return 0;
+        }
+        optimizeProgram(*ast, symbols, options.optimization_level, true, options.loops);
+
+        std::vector<std::string> variables;
+        if (options.emit == EmitKind::IR) {
+            generateCode(*ast, symbols, options, false, variables, &std::cout);
+            return 0;
+        }
+        bool emit_asm = options.emit == EmitKind::ASM;
+        bool emit_object = options.emit == EmitKind::OBJECT;
+        AsmBuffer code = generateCode(*ast, symbols, options, emit_asm || (emit_object && options.debug_info), variables);
+        if (options.optimization_level > 0) {
+            PeepholeOptimizer peephole;
+            peephole.optimize(code);
+            if (options.peephole_stats) peephole.printStats(std::cout);
+        }
+        if (emit_asm) {
+            std::cout << code.toText();
+            return 0;
+        }
+        if (emit_object) {
+            writeObject(objectPath(path, options), makeObject(code, variables, options.debug_info));
+            return 0;
+        }
+
+        std::vector<MachineInstr> program = assemble(code);
+        if (options.estimate_cycles) {
+            LineIndex lines(file.view());
+            CycleEstimate estimate = estimateCycles(program.data(), program.size(), options.cycle_costs, *ast, sourceOffsets(code));
+            estimate.print(std::cout, &lines);
+            return 0;
+        }
+        if (options.run_mode == RunMode::PROFILE) {
+            LineIndex lines(file.view());
+            std::vector<SourceLocation> line_table = lineTable(code, lines);
+            ProfileSource source{std::filesystem::path(path).filename().string(), &line_table, &lines};
+            return simulate(program.data(), program.size(), variables.size(), options, source);
+        }
+        return simulate(program.data(), program.size(), variables.size(), options);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
+
+
+// Links the relocatable modules named on the command line, in order. With -o the
+// executable is written there; otherwise it is run, or disassembled with --emit=asm.
+int linkFiles(const std::vector<std::string>& paths, const DriverOptions& options) {
+    try {
+        std::vector<std::unique_ptr<MappedFile>> files;
+        std::vector<ObjectView> objects;
+        objects.reserve(paths.size());
+        for (const std::string& path : paths) {
+            files.push_back(std::make_unique<MappedFile>(path));
+            objects.emplace_back(files.back()->view());
+        }
+        std::vector<LinkInput> inputs;
+        for (size_t i = 0; i < paths.size(); ++i) {
+            inputs.push_back({std::filesystem::path(paths[i]).stem().string(), &objects[i]});
+        }
+
+        std::string linked = encodeObject(linkObjects(inputs));
+        if (!options.output_path.empty()) {
+            writeObject(options.output_path, linked);
+            return 0;
+        }
+        return runObject(linked, options);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
+
+
+// Compiles every file named by --batch on a work-stealing pool, then prints the
+// diagnostics in input order, so the output does not depend on the thread count.
+int compileBatchFiles(const DriverOptions& options) {
+    try {
+        std::vector<std::string> paths = collectSourceFiles(options.batch_path);
+        WorkStealingPool pool(options.threads);
+        BatchOptions batch_options;
+        batch_options.write_objects = options.emit == EmitKind::OBJECT || options.relocatable;
+        std::unique_ptr<CompileCache> cache;
+        if (!options.cache_path.empty()) {
+            cache = std::make_unique<CompileCache>(options.cache_path, options.cache_size);
+            batch_options.cache = cache.get();
+            batch_options.cache_flags = cacheFlags(options);
+        }
+
+        auto generate = [&](Program& ast, SymbolTable& symbols) { return compileObject(ast, symbols, options); };
+        std::vector<BatchFileResult> results = compileBatch(paths, batch_options, pool, generate);
+
+        size_t failed = 0;
+        size_t instructions = 0;
+        for (size_t i = 0; i < results.size(); ++i) {
+            if (!results[i].ok) {
+                std::cerr << paths[i] << ": " << results[i].diagnostic << std::endl;
+                failed++;
+            }
+            instructions += results[i].instructions;
+        }
+        std::cout << "Compiled " << results.size() - failed << " of " << results.size() << " file(s), "
+                  << instructions << " instructions, on " << pool.threadCount() << " thread(s)" << std::endl;
+        if (cache && options.cache_stats) cache->printStats(std::cout);
+        return failed ? 1 : 0;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
+
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> inputs;
+    DriverOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.size() == 3 && arg.rfind("-O", 0) == 0 && isdigit(static_cast<unsigned char>(arg[2]))) {
+            options.optimization_level = arg[2] - '0';
+        } else if (arg == "--peephole-stats") {
+            options.peephole_stats = true;
+        } else if (arg == "--emit=ir") {
+            options.emit = EmitKind::IR;
+        } else if (arg == "--emit=asm") {
+            options.emit = EmitKind::ASM;
+        } else if (arg == "--emit=obj") {
+            options.emit = EmitKind::OBJECT;
+        } else if (arg == "-o" && i + 1 < argc) {
+            options.output_path = argv[++i];
+        } else if (arg == "--jit") {
+            options.run_mode = RunMode::JIT;
+        } else if (arg == "--jit-diff") {
+            options.run_mode = RunMode::JIT_DIFF;
+        } else if (arg == "--verify") {
+            options.verify = true;
+        } else if (arg == "--profile-fusion") {
+            options.run_mode = RunMode::PROFILE_FUSION;
+        } else if (arg == "--profile") {
+            options.run_mode = RunMode::PROFILE;
+            options.profile = true;
+        } else if (arg.rfind("--profile-folded=", 0) == 0) {
+            options.run_mode = RunMode::PROFILE;
+            options.profile_folded = arg.substr(17);
+        } else if (arg.rfind("--cycle-costs=", 0) == 0) {
+            try {
+                options.cycle_costs = loadCycleCosts(arg.substr(14));
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+            options.cycles = true;
+        } else if (arg == "--cycles") {
+            options.cycles = true;
+        } else if (arg == "--estimate-cycles") {
+            options.estimate_cycles = true;
+        } else if (arg.rfind("--batch=", 0) == 0) {
+            options.batch_path = arg.substr(8);
+        } else if (arg.size() > 2 && arg.rfind("-j", 0) == 0 && isdigit(static_cast<unsigned char>(arg[2]))) {
+            options.threads = static_cast<unsigned>(std::stoul(arg.substr(2)));
+        } else if (arg.rfind("--cache=", 0) == 0) {
+            options.cache_path = arg.substr(8);
+        } else if (arg.rfind("--cache-size=", 0) == 0) {
+            if (!parseByteSize(arg.substr(13), options.cache_size)) {
+                std::cerr << "Invalid cache size '" << arg.substr(13) << "'" << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--unroll-limit=", 0) == 0) {
+            if (!parseCount(arg.substr(15), options.loops.unroll_limit)) {
+                std::cerr << "Invalid unroll limit '" << arg.substr(15) << "'" << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--unroll-factor=", 0) == 0) {
+            if (!parseCount(arg.substr(16), options.loops.unroll_factor) || options.loops.unroll_factor == 0) {
+                std::cerr << "Invalid unroll factor '" << arg.substr(16) << "'" << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--memory=", 0) == 0) {
+            uint64_t bytes = 0;
+            if (!parseByteSize(arg.substr(9), bytes) || bytes > UINT32_MAX) {
+                std::cerr << "Invalid memory size '" << arg.substr(9) << "'" << std::endl;
+                return 1;
+            }
+            options.machine.memory_size = static_cast<uint32_t>(bytes);
+        } else if (arg.rfind("--stack=", 0) == 0) {
+            int bytes = 0;
+            if (!parseCount(arg.substr(8), bytes)) {
+                std::cerr << "Invalid stack size '" << arg.substr(8) << "'" << std::endl;
+                return 1;
+            }
+            options.machine.stack_size = static_cast<uint32_t>(bytes);
+        } else if (arg == "--no-licm") {
+            options.loops.hoist_invariants = false;
+        } else if (arg == "--no-strength-reduction") {
+            options.loops.reduce_strength = false;
+        } else if (arg == "--cache-stats") {
+            options.cache_stats = true;
+        } else if (arg == "-c") {
+            options.relocatable = true;
+        } else if (arg == "--link") {
+            options.link = true;
+        } else if (arg == "-g") {
+            options.debug_info = true;
+        } else if (arg.rfind("--live-out=", 0) == 0) {
+            options.live_out = splitNames(arg.substr(11));
+        } else if (arg.rfind("--bench=", 0) == 0) {
+            std::string name = arg.substr(8);
+            if (!runBenchmark(name)) {
+                std::cerr << "Unknown benchmark '" << name << "'" << std::endl;
+                return 1;
+            }
+            return 0;
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Unknown option '" << arg << "'" << std::endl;
+            return 1;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+
+    if (!options.machine.valid()) {
+        std::cerr << "Invalid machine model: memory must be a power of two from 256 to 64K bytes, "
+                     "with a stack of at least one byte that leaves room for variables" << std::endl;
+        return 1;
+    }
+
+    if (!options.batch_path.empty()) {
+        return compileBatchFiles(options);
+    }
+    if (options.link) {
+        return linkFiles(inputs, options);
+    }
+    if (inputs.size() > 1) {
+        std::cerr << "Only one input file can be given, except with --link" << std::endl;
+        return 1;
+    }
+    if (!inputs.empty()) {
+        return compileFile(inputs[0], options);
+    }
+
     std::string source_code = R"(
         // Variable declaration
         int a;
@@ -85,15 +637,11 @@ int main() {
         }
     )";
    
-    size_t pos;
-    while ((pos = source_code.find("//")) != std::string::npos) {
-        size_t end_of_line = source_code.find('\n', pos);
-        source_code.erase(pos, end_of_line - pos);
-    }
-
 
-    Lexer lexer(source_code);
+    SymbolTable symbols;
+    Lexer lexer(source_code, symbols);
     std::vector<Token> tokens;
+    tokens.reserve(source_code.size() / 2);
     Token token;
     do {
         token = lexer.getNextToken();
@@ -106,36 +654,57 @@ int main() {
     std::cout << "--- Lexer Output ---" << std::endl;
     for(const auto& t : tokens){
          std::cout << "Type: " << tokenTypeToString(t.type)
-                  << ", Value: '" << t.value << "'" << std::endl;
+                  << ", Value: '" << lexer.text(t) << "'" << std::endl;
     }
 
 
     std::unique_ptr<Program> ast;
     try {
-        Parser parser(tokens);
+        Parser parser(tokens, source_code);
         ast = parser.parse();
        
         std::cout << "\n--- AST Output ---" << std::endl;
-        printAST(ast.get());
+        printAST(ast.get(), symbols);
         std::cout << "\nParsing completed successfully." << std::endl;
 
+        if (options.optimization_level > 0) {
+            optimizeProgram(*ast, symbols, options.optimization_level, true, options.loops);
+            std::cout << "\n--- Optimized AST (-O" << options.optimization_level << ") ---" << std::endl;
+            printAST(ast.get(), symbols);
+        }
+
 
     } catch (const std::exception& e) {
         std::cerr << "\n" << e.what() << std::endl;
         return 1; 
     }
 
-    std::string assembly;
+    std::vector<MachineInstr> program;
     if (ast) { 
         try {
-            CodeGenerator generator;
-            assembly = generator.generate(*ast);
+            std::vector<std::string> variables;
+            AsmBuffer code;
+            if (options.optimization_level >= 2) {
+                std::cout << "\n--- SSA IR ---" << std::endl;
+                code = generateCode(*ast, symbols, options, true, variables, &std::cout);
+            } else {
+                code = generateCode(*ast, symbols, options, true, variables);
+            }
 
 
             std::cout << "\n--- Assembly Output ---" << std::endl;
-            std::cout << assembly << std::endl;
+            std::cout << code.toText() << std::endl;
             std::cout << "Code generation completed successfully." << std::endl;
 
+            if (options.optimization_level > 0) {
+                PeepholeOptimizer peephole;
+                peephole.optimize(code);
+                std::cout << "\n--- Peephole Output ---" << std::endl;
+                std::cout << code.toText() << std::endl;
+                peephole.printStats(std::cout);
+            }
+            program = assemble(code);
+
 
         } catch (const std::exception& e) {
             std::cerr << "\n" << e.what() << std::endl;
@@ -144,10 +713,10 @@ int main() {
     }
 
 
-    if (!assembly.empty()) {
+    if (!program.empty()) {
         try {
-            CPU cpu;
-            cpu.loadProgram(assembly);
+            CPU cpu(options.machine);
+            cpu.loadProgram(std::move(program));
             cpu.run();
            
             std::cout << "\n--- Simulation Results ---" << std::endl;
@@ -1,97 +1,204 @@
 #include "parser.h"
 #include <iostream>
+#include <algorithm>
 #include <stdexcept>
 
 
-Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens), position(0) {}
+static const Token end_of_file_token = {TokenType::END_OF_FILE, 0, 0, 0};
 
 
-Token Parser::peek() {
-    if (isAtEnd()) return {TokenType::END_OF_FILE, ""};
-    return tokens[position];
+static BinaryOperator binaryOperatorFor(TokenType type) {
+    switch (type) {
+        case TokenType::PLUS: return BinaryOperator::ADD;
+        case TokenType::MINUS: return BinaryOperator::SUBTRACT;
+        case TokenType::NOT_EQUAL: return BinaryOperator::NOT_EQUAL;
+        default: return BinaryOperator::EQUAL;
+    }
+}
+
+
+template <typename T>
+static T* placed(T* node, uint32_t offset) {
+    node->offset = offset;
+    return node;
+}
+
+
+Parser::Parser(const std::vector<Token>& tokens, std::string_view source)
+    : tokens(&tokens), lexer(nullptr), source(source), position(0), lookahead(), lookahead_head(0), lookahead_count(0), previous_end(0), arena(nullptr) {}
+
+
+Parser::Parser(Lexer& lexer)
+    : tokens(nullptr), lexer(&lexer), source(lexer.sourceText()), position(0), lookahead(), lookahead_head(0), lookahead_count(0), previous_end(0), arena(nullptr) {}
+
+
+Token Parser::pullToken() {
+    Token token;
+    do {
+        token = lexer->getNextToken();
+    } while (token.type == TokenType::UNKNOWN);
+    return token;
+}
+
+
+const Token& Parser::peek(size_t ahead) {
+    if (tokens) {
+        if (position + ahead >= tokens->size()) return end_of_file_token;
+        return (*tokens)[position + ahead];
+    }
+    while (lookahead_count <= ahead) {
+        lookahead[(lookahead_head + lookahead_count) % LOOKAHEAD_CAPACITY] = pullToken();
+        lookahead_count++;
+    }
+    return lookahead[(lookahead_head + ahead) % LOOKAHEAD_CAPACITY];
 }
 
 
 Token Parser::advance() {
-    if (!isAtEnd()) position++;
-    return tokens[position - 1];
+    Token token = peek();
+    if (isAtEnd()) return token;
+    previous_end = token.offset + token.length;
+    if (tokens) {
+        position++;
+    } else {
+        lookahead_head = (lookahead_head + 1) % LOOKAHEAD_CAPACITY;
+        lookahead_count--;
+    }
+    return token;
 }
 
 
 bool Parser::isAtEnd() {
-    return position >= tokens.size() || tokens[position].type == TokenType::END_OF_FILE;
+    return peek().type == TokenType::END_OF_FILE;
 }
 
 
-void Parser::consume(TokenType type, const std::string& message) {
+void Parser::consume(TokenType type, const char* message) {
     if (peek().type == type) {
         advance();
         return;
     }
-    throw std::runtime_error("Parser Error: " + message);
+    throw std::runtime_error(std::string("Parser Error: ") + message);
 }
 
 std::unique_ptr<Program> Parser::parse() {
-    auto program = std::make_unique<Program>();
+    return parse(std::make_unique<Program>());
+}
+
+
+std::unique_ptr<Program> Parser::parse(std::unique_ptr<Program> recycled) {
+    auto program = std::move(recycled);
+    program->arena.reset();
+    program->statements = {};
+    program->temporaries = {};
+    arena = &program->arena;
+    loop_depth = 0;
+    size_t base = statement_stack.size();
     while (!isAtEnd()) {
-        program->statements.push_back(parseStatement());
+        statement_stack.push_back(parseStatement());
     }
+    program->statements = collectStatements(base);
+    arena = nullptr;
     return program;
 }
 
 
-std::unique_ptr<Statement> Parser::parseStatement() {
+void Parser::parseInto(Arena& target, std::vector<ParsedStatement>& out) {
+    arena = &target;
+    loop_depth = 0;
+    while (!isAtEnd()) {
+        uint32_t begin = peek().offset;
+        Statement* statement = parseStatement();
+        out.push_back({statement, begin, previous_end});
+    }
+    arena = nullptr;
+}
+
+
+NodeList<Statement> Parser::collectStatements(size_t base) {
+    NodeList<Statement> list;
+    list.count = static_cast<uint32_t>(statement_stack.size() - base);
+    list.items = arena->allocateArray<Statement*>(list.count);
+    std::copy(statement_stack.begin() + base, statement_stack.end(), list.items);
+    statement_stack.resize(base);
+    return list;
+}
+
+
+Statement* Parser::parseStatement() {
     if (peek().type == TokenType::INT) {
         return parseVarDeclaration();
     }
     if (peek().type == TokenType::IF) {
         return parseIfStatement();
     }
+    if (peek().type == TokenType::WHILE) {
+        return parseWhileStatement();
+    }
     if (peek().type == TokenType::IDENTIFIER) {
         
-        if (position + 1 < tokens.size() && tokens[position + 1].type == TokenType::ASSIGN) {
+        if (peek(1).type == TokenType::ASSIGN) {
              return parseAssignmentStatement(peek());
         }
     }
    
-    throw std::runtime_error("Parser Error: Unexpected token " + peek().value);
+    throw std::runtime_error("Parser Error: Unexpected token " + std::string(text(peek())));
 }
 
 
-std::unique_ptr<Statement> Parser::parseVarDeclaration() {
+Statement* Parser::parseVarDeclaration() {
+    uint32_t start = peek().offset;
     consume(TokenType::INT, "Expected 'int' keyword.");
-    Token identifier = peek();
+    if (loop_depth > 0) throw std::runtime_error("Parser Error: Variables cannot be declared inside a while loop.");
+    SymbolId symbol = peek().value;
     consume(TokenType::IDENTIFIER, "Expected identifier after 'int'.");
     consume(TokenType::SEMICOLON, "Expected ';' after variable declaration.");
-    return std::make_unique<VarDecl>(identifier.value);
+    return placed(arena->make<VarDecl>(symbol), start);
 }
 
 
-std::unique_ptr<Statement> Parser::parseAssignmentStatement(const Token& identifierToken) {
+Statement* Parser::parseAssignmentStatement(Token identifierToken) {
+    SymbolId symbol = identifierToken.value;
     consume(TokenType::IDENTIFIER, "Expected an identifier for assignment.");
     consume(TokenType::ASSIGN, "Expected '=' for assignment.");
     auto value = parseExpression();
     consume(TokenType::SEMICOLON, "Expected ';' after assignment.");
-    return std::make_unique<Assignment>(identifierToken.value, std::move(value));
+    return placed(arena->make<Assignment>(symbol, value), identifierToken.offset);
 }
 
 
-std::unique_ptr<Statement> Parser::parseIfStatement() {
+Statement* Parser::parseIfStatement() {
+    uint32_t start = peek().offset;
     consume(TokenType::IF, "Expected 'if' keyword.");
     consume(TokenType::LPAREN, "Expected '(' after 'if'.");
     auto condition = parseExpression();
     consume(TokenType::RPAREN, "Expected ')' after if condition.");
     auto body = parseBlockStatement();
-    return std::make_unique<IfStatement>(std::move(condition), std::move(body));
+    return placed(arena->make<IfStatement>(condition, body), start);
+}
+
+
+Statement* Parser::parseWhileStatement() {
+    uint32_t start = peek().offset;
+    consume(TokenType::WHILE, "Expected 'while' keyword.");
+    consume(TokenType::LPAREN, "Expected '(' after 'while'.");
+    auto condition = parseExpression();
+    consume(TokenType::RPAREN, "Expected ')' after while condition.");
+    loop_depth++;
+    auto body = parseBlockStatement();
+    loop_depth--;
+    return placed(arena->make<WhileStatement>(condition, body), start);
 }
 
 
-std::unique_ptr<BlockStatement> Parser::parseBlockStatement() {
-    auto block = std::make_unique<BlockStatement>();
+BlockStatement* Parser::parseBlockStatement() {
+    auto block = placed(arena->make<BlockStatement>(), peek().offset);
     consume(TokenType::LBRACE, "Expected '{' to start a block.");
+    size_t base = statement_stack.size();
     while (peek().type != TokenType::RBRACE && !isAtEnd()) {
-        block->statements.push_back(parseStatement());
+        statement_stack.push_back(parseStatement());
     }
+    block->statements = collectStatements(base);
     consume(TokenType::RBRACE, "Expected '}' to end a block.");
     return block;
 }
@@ -100,14 +207,15 @@ std::unique_ptr<BlockStatement> Parser::parseBlockStatement() {
 
 
 
-std::unique_ptr<Expression> Parser::parseExpression() {
+Expression* Parser::parseExpression() {
     auto left = parsePrimary();
 
 
-    while (peek().type == TokenType::PLUS || peek().type == TokenType::MINUS || peek().type == TokenType::EQUAL) {
-        Token op = advance();
+    while (peek().type == TokenType::PLUS || peek().type == TokenType::MINUS || peek().type == TokenType::EQUAL ||
+           peek().type == TokenType::NOT_EQUAL) {
+        TokenType op = advance().type;
         auto right = parsePrimary();
-        left = std::make_unique<BinaryOp>(op.value, std::move(left), std::move(right));
+        left = placed(arena->make<BinaryOp>(binaryOperatorFor(op), left, right), left->offset);
     }
 
 
@@ -115,15 +223,15 @@ std::unique_ptr<Expression> Parser::parseExpression() {
 }
 
 
-std::unique_ptr<Expression> Parser::parsePrimary() {
+Expression* Parser::parsePrimary() {
+    uint32_t start = peek().offset;
     if (peek().type == TokenType::INTEGER_LITERAL) {
-        int value = std::stoi(advance().value);
-        return std::make_unique<NumberLiteral>(value);
+        int value = static_cast<int>(advance().value);
+        return placed(arena->make<NumberLiteral>(value), start);
     }
     if (peek().type == TokenType::IDENTIFIER) {
-        std::string name = advance().value;
-        return std::make_unique<Identifier>(name);
+        return placed(arena->make<Identifier>(advance().value), start);
     }
    
-    throw std::runtime_error("Parser Error: Unexpected expression " + peek().value);
+    throw std::runtime_error("Parser Error: Unexpected expression " + std::string(text(peek())));
 }
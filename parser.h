@@ -6,33 +6,70 @@
 #include "ast.h"
 #include <vector>
 #include <memory>
+#include <string>
+#include <string_view>
+
+
+// A top-level statement together with the byte range of its tokens in the source.
+struct ParsedStatement {
+    Statement* statement;
+    uint32_t begin;
+    uint32_t end;
+};
 
 
 class Parser {
 public:
-    Parser(const std::vector<Token>& tokens);
+    // Tokens are borrowed, not copied; `source` is the buffer they span.
+    Parser(const std::vector<Token>& tokens, std::string_view source);
+    // Streaming mode: tokens are pulled from the lexer on demand, so only the lookahead window is held.
+    explicit Parser(Lexer& lexer);
     std::unique_ptr<Program> parse();
+    // Parses into `recycled`, a Program from an earlier parse whose arena is reset and
+    // reused, so a worker compiling many files keeps its AST memory.
+    std::unique_ptr<Program> parse(std::unique_ptr<Program> recycled);
+    // Parses the remaining input into `target`, recording each top-level statement's span.
+    void parseInto(Arena& target, std::vector<ParsedStatement>& out);
 
 
 private:
-    std::vector<Token> tokens;
+    static constexpr size_t LOOKAHEAD_CAPACITY = 4;
+
+    const std::vector<Token>* tokens;
+    Lexer* lexer;
+    std::string_view source;
     size_t position;
+    Token lookahead[LOOKAHEAD_CAPACITY];
+    size_t lookahead_head;
+    size_t lookahead_count;
+    uint32_t previous_end;
+
+    // Arena of the Program being built, and a scratch stack shared by nested statement lists.
+    Arena* arena;
+    std::vector<Statement*> statement_stack;
+    // Number of while bodies being parsed; declarations are rejected inside them.
+    int loop_depth = 0;
 
 
-    Token peek();
+    const Token& peek(size_t ahead = 0);
     Token advance();
+    Token pullToken();
+    std::string_view text(const Token& token) const { return source.substr(token.offset, token.length); }
     bool isAtEnd();
-    void consume(TokenType type, const std::string& message);
+    void consume(TokenType type, const char* message);
 
 
-    std::unique_ptr<Statement> parseStatement();
-    std::unique_ptr<Statement> parseVarDeclaration();
-    std::unique_ptr<Statement> parseIfStatement();
-    std::unique_ptr<Statement> parseAssignmentStatement(const Token& identifierToken);
-    std::unique_ptr<BlockStatement> parseBlockStatement();
+    Statement* parseStatement();
+    Statement* parseVarDeclaration();
+    Statement* parseIfStatement();
+    Statement* parseWhileStatement();
+    Statement* parseAssignmentStatement(Token identifierToken);
+    BlockStatement* parseBlockStatement();
    
-    std::unique_ptr<Expression> parseExpression();
-    std::unique_ptr<Expression> parsePrimary();
+    Expression* parseExpression();
+    Expression* parsePrimary();
+
+    NodeList<Statement> collectStatements(size_t base);
 };
 
 